@@ -18,6 +18,8 @@
 
 #include <clang/Lex/Preprocessor.h>
 
+#include <algorithm>
+
 using namespace clang;
 
 namespace instr {
@@ -33,6 +35,10 @@ Clause::Kind Clause::getKind() const {
   return this->kind;
 }
 
+const FullSourceLoc& Clause::getLoc() const {
+  return this->loc;
+}
+
 // ClName
 
 ClName::ClName(InstrContext& instrContext,
@@ -55,6 +61,10 @@ bool ClName::classof(const Clause* cl) {
 }
 
 ClName* ClName::parse(Parser& parser, const clang::SourceLocation& loc) {
+  // Sanity check.
+  if (parser.spell(parser.consume()) != Parser::tokName)
+    llvm_unreachable("Wrong parser called for clause");
+
   std::string name = "";
   if (not parser.parseToken(tok::l_paren))
     return nullptr;
@@ -156,6 +166,10 @@ bool ClFuncArgs::classof(const Clause* cl) {
 }
 
 ClFuncArgs* ClFuncArgs::parse(Parser& parser, const SourceLocation& loc) {
+  // Sanity check.
+  if (parser.spell(parser.consume()) != Parser::tokFuncArgs)
+    llvm_unreachable("Wrong parser called for clause");
+
   std::vector<std::string> argNames;
 
   if (not parser.parseToken(tok::l_paren))
@@ -170,4 +184,270 @@ ClFuncArgs* ClFuncArgs::parse(Parser& parser, const SourceLocation& loc) {
   return new ClFuncArgs(instrContext, FullSourceLoc(loc, srcMgr), argNames);
 }
 
+// ClCounters
+
+static const std::vector<std::string> counterNames = {
+    "cycles",
+    "instructions",
+    "cache-references",
+    "cache-misses",
+    "branches",
+    "branch-misses",
+    "task-clock",
+    "page-faults",
+    "context-switches",
+};
+
+ClCounters::ClCounters(InstrContext& instrContext,
+                       const FullSourceLoc& loc,
+                       const std::vector<std::string>& counters)
+    : Clause(instrContext, loc, Clause::Counters), counters(counters) {
+  ;
+}
+
+StringRef ClCounters::spell() const {
+  return Parser::tokCounters;
+}
+
+ClCounters::ConstIterator ClCounters::begin() const {
+  return this->counters.begin();
+}
+
+ClCounters::ConstIterator ClCounters::end() const {
+  return this->counters.end();
+}
+
+const std::vector<std::string>& ClCounters::getCounters() const {
+  return this->counters;
+}
+
+bool ClCounters::classof(const Clause* cl) {
+  return cl->getKind() == Clause::Counters;
+}
+
+ClCounters* ClCounters::parse(Parser& parser, const SourceLocation& loc) {
+  // Sanity check.
+  if (parser.spell(parser.consume()) != Parser::tokCounters)
+    llvm_unreachable("Wrong parser called for clause");
+
+  if (not parser.parseToken(tok::l_paren))
+    return nullptr;
+
+  // The counter names contain hyphens, so they are lexed as a sequence of
+  // identifiers separated by minus signs and have to be put back together.
+  std::vector<std::string> counters;
+  do {
+    if (not counters.empty() and not parser.parseToken(tok::comma))
+      return nullptr;
+
+    SourceLocation nameLoc = parser.loc();
+    std::string name;
+    if (not parser.parseIdentifierInto(name))
+      return nullptr;
+    while (parser.is(tok::minus)) {
+      parser.consume();
+      std::string part;
+      if (not parser.parseIdentifierInto(part))
+        return nullptr;
+      name += "-" + part;
+    }
+
+    if (std::find(counterNames.begin(), counterNames.end(), name)
+        == counterNames.end()) {
+      parser.error(Parser::UnknownEnumValue, nameLoc, name);
+      return nullptr;
+    }
+    counters.push_back(name);
+  } while (not parser.is(tok::r_paren) and not parser.eod());
+
+  if (not parser.parseToken(tok::r_paren))
+    return nullptr;
+
+  InstrContext& instrContext = parser.getInstrContext();
+  SourceManager& srcMgr = parser.getSourceManager();
+  return new ClCounters(instrContext, FullSourceLoc(loc, srcMgr), counters);
+}
+
+// ClAlloc
+
+ClAlloc::ClAlloc(InstrContext& instrContext, const FullSourceLoc& loc)
+    : Clause(instrContext, loc, Clause::Alloc) {
+  ;
+}
+
+StringRef ClAlloc::spell() const {
+  return Parser::tokAlloc;
+}
+
+bool ClAlloc::classof(const Clause* cl) {
+  return cl->getKind() == Clause::Alloc;
+}
+
+ClAlloc* ClAlloc::parse(Parser& parser, const SourceLocation& loc) {
+  // Sanity check.
+  if (parser.spell(parser.consume()) != Parser::tokAlloc)
+    llvm_unreachable("Wrong parser called for clause");
+
+  InstrContext& instrContext = parser.getInstrContext();
+  SourceManager& srcMgr = parser.getSourceManager();
+  return new ClAlloc(instrContext, FullSourceLoc(loc, srcMgr));
+}
+
+// ClTime
+
+ClTime::ClTime(InstrContext& instrContext, const FullSourceLoc& loc)
+    : Clause(instrContext, loc, Clause::Time) {
+  ;
+}
+
+StringRef ClTime::spell() const {
+  return Parser::tokTime;
+}
+
+bool ClTime::classof(const Clause* cl) {
+  return cl->getKind() == Clause::Time;
+}
+
+ClTime* ClTime::parse(Parser& parser, const SourceLocation& loc) {
+  // Sanity check.
+  if (parser.spell(parser.consume()) != Parser::tokTime)
+    llvm_unreachable("Wrong parser called for clause");
+
+  InstrContext& instrContext = parser.getInstrContext();
+  SourceManager& srcMgr = parser.getSourceManager();
+  return new ClTime(instrContext, FullSourceLoc(loc, srcMgr));
+}
+
+// Parse the parenthesized positive integer that is the argument of a clause.
+static bool parsePositiveInt(Parser& parser, uint64_t& out) {
+  if (not parser.parseToken(tok::l_paren))
+    return false;
+
+  SourceLocation valLoc = parser.loc();
+  if (not parser.parseIntLiteralInto(out))
+    return false;
+  if (not out)
+    return parser.error(Parser::ExpectedPositiveInt, valLoc);
+
+  return parser.parseToken(tok::r_paren);
+}
+
+// ClSample
+
+ClSample::ClSample(InstrContext& instrContext,
+                   const FullSourceLoc& loc,
+                   uint64_t period)
+    : Clause(instrContext, loc, Clause::Sample), period(period) {
+  ;
+}
+
+StringRef ClSample::spell() const {
+  return Parser::tokSample;
+}
+
+uint64_t ClSample::getPeriod() const {
+  return this->period;
+}
+
+bool ClSample::classof(const Clause* cl) {
+  return cl->getKind() == Clause::Sample;
+}
+
+ClSample* ClSample::parse(Parser& parser, const SourceLocation& loc) {
+  // Sanity check.
+  if (parser.spell(parser.consume()) != Parser::tokSample)
+    llvm_unreachable("Wrong parser called for clause");
+
+  uint64_t period = 0;
+  if (not parsePositiveInt(parser, period))
+    return nullptr;
+
+  InstrContext& instrContext = parser.getInstrContext();
+  SourceManager& srcMgr = parser.getSourceManager();
+  return new ClSample(instrContext, FullSourceLoc(loc, srcMgr), period);
+}
+
+// ClBudget
+
+ClBudget::ClBudget(InstrContext& instrContext,
+                   const FullSourceLoc& loc,
+                   uint64_t budget)
+    : Clause(instrContext, loc, Clause::Budget), budget(budget) {
+  ;
+}
+
+StringRef ClBudget::spell() const {
+  return Parser::tokBudget;
+}
+
+uint64_t ClBudget::getBudget() const {
+  return this->budget;
+}
+
+bool ClBudget::classof(const Clause* cl) {
+  return cl->getKind() == Clause::Budget;
+}
+
+ClBudget* ClBudget::parse(Parser& parser, const SourceLocation& loc) {
+  // Sanity check.
+  if (parser.spell(parser.consume()) != Parser::tokBudget)
+    llvm_unreachable("Wrong parser called for clause");
+
+  uint64_t budget = 0;
+  if (not parsePositiveInt(parser, budget))
+    return nullptr;
+
+  InstrContext& instrContext = parser.getInstrContext();
+  SourceManager& srcMgr = parser.getSourceManager();
+  return new ClBudget(instrContext, FullSourceLoc(loc, srcMgr), budget);
+}
+
+// ClIf
+
+ClIf::ClIf(InstrContext& instrContext,
+           const FullSourceLoc& loc,
+           const std::string& var,
+           const std::vector<Token>& cond)
+    : Clause(instrContext, loc, Clause::If), var(var), cond(cond) {
+  ;
+}
+
+StringRef ClIf::spell() const {
+  return Parser::tokIf;
+}
+
+const std::string& ClIf::getVar() const {
+  return this->var;
+}
+
+const std::vector<Token>& ClIf::getCond() const {
+  return this->cond;
+}
+
+bool ClIf::classof(const Clause* cl) {
+  return cl->getKind() == Clause::If;
+}
+
+ClIf* ClIf::parse(Parser& parser, const SourceLocation& loc) {
+  // Sanity check.
+  if (parser.spell(parser.consume()) != Parser::tokIf)
+    llvm_unreachable("Wrong parser called for clause");
+
+  if (not parser.parseToken(tok::l_paren))
+    return nullptr;
+
+  std::vector<Token> cond;
+  if (not parser.parseBalancedTokensInto(cond))
+    return nullptr;
+
+  // The location is unique to this clause, so it is used to give the
+  // variable a name that will not clash with that of any other. The
+  // declaration is only injected by the directive once it has been checked.
+  std::string var = "__instr_if_" + std::to_string(loc.getRawEncoding());
+
+  InstrContext& instrContext = parser.getInstrContext();
+  SourceManager& srcMgr = parser.getSourceManager();
+  return new ClIf(instrContext, FullSourceLoc(loc, srcMgr), var, cond);
+}
+
 } // namespace instr
@@ -32,6 +32,12 @@ public:
     Name,
     FuncStyle,
     FuncArgs,
+    Counters,
+    Alloc,
+    Time,
+    Sample,
+    Budget,
+    If,
   };
 
 private:
@@ -46,6 +52,7 @@ protected:
 
 public:
   Kind getKind() const;
+  const clang::FullSourceLoc& getLoc() const;
   virtual ~Clause() = default;
   virtual clang::StringRef spell() const = 0;
 };
@@ -132,6 +139,189 @@ public:
   static bool classof(const Clause* clause);
 };
 
+// Clause counters(<non-empty-list-of-counter-names>)
+//
+// The performance counters that the runtime should read when the loop or
+// region is entered and exited. The supported counters are cycles,
+// instructions, cache-references, cache-misses, branches, branch-misses,
+// task-clock, page-faults and context-switches.
+//
+// Example:
+//
+//     #pragma instrument loop counters(cycles, instructions, cache-misses)
+//
+class ClCounters : public Clause {
+private:
+  std::vector<std::string> counters;
+
+public:
+  using ConstIterator = decltype(counters)::const_iterator;
+
+protected:
+  ClCounters(InstrContext& instrContext,
+             const clang::FullSourceLoc& loc,
+             const std::vector<std::string>& counters);
+
+public:
+  virtual ~ClCounters() = default;
+  virtual clang::StringRef spell() const override;
+  ConstIterator begin() const;
+  ConstIterator end() const;
+  const std::vector<std::string>& getCounters() const;
+
+public:
+  static ClCounters* parse(Parser& parser, const clang::SourceLocation& loc);
+  static bool classof(const Clause* clause);
+};
+
+// Clause alloc
+//
+// The runtime should count the heap allocations made while control is in the
+// loop or region. An allocation made in a nested loop or region is charged to
+// the innermost one that has this clause.
+//
+// Example:
+//
+//     #pragma instrument loop alloc
+//
+class ClAlloc : public Clause {
+protected:
+  ClAlloc(InstrContext& instrContext, const clang::FullSourceLoc& loc);
+
+public:
+  virtual ~ClAlloc() = default;
+  virtual clang::StringRef spell() const override;
+
+public:
+  static ClAlloc* parse(Parser& parser, const clang::SourceLocation& loc);
+  static bool classof(const Clause* clause);
+};
+
+// Clause time
+//
+// The runtime should record when a line is first and last reached in
+// addition to counting how often it is reached. This costs a read of the
+// clock on every hit.
+//
+// Example:
+//
+//     #pragma instrument line time
+//
+class ClTime : public Clause {
+protected:
+  ClTime(InstrContext& instrContext, const clang::FullSourceLoc& loc);
+
+public:
+  virtual ~ClTime() = default;
+  virtual clang::StringRef spell() const override;
+
+public:
+  static ClTime* parse(Parser& parser, const clang::SourceLocation& loc);
+  static bool classof(const Clause* clause);
+};
+
+// Clause sample(<positive-integer>)
+//
+// The runtime should only time one in every N entries of the loop or region
+// on each thread. The other entries only cost a lookup of the descriptor.
+//
+// Example:
+//
+//     #pragma instrument loop sample(100)
+//
+class ClSample : public Clause {
+private:
+  uint64_t period;
+
+protected:
+  ClSample(InstrContext& instrContext,
+           const clang::FullSourceLoc& loc,
+           uint64_t period);
+
+public:
+  virtual ~ClSample() = default;
+  virtual clang::StringRef spell() const override;
+  uint64_t getPeriod() const;
+
+public:
+  static ClSample* parse(Parser& parser, const clang::SourceLocation& loc);
+  static bool classof(const Clause* clause);
+};
+
+// Clause budget(<positive-integer>)
+//
+// The runtime should time only as many entries of the loop or region as it
+// can without the instrumentation costing more than the given number of
+// nanoseconds in each second on each thread. The rate is adjusted while the
+// program runs. If sample is also given, at most one in every N entries is
+// timed.
+//
+// Example:
+//
+//     #pragma instrument region budget(50000)
+//
+class ClBudget : public Clause {
+private:
+  uint64_t budget;
+
+protected:
+  ClBudget(InstrContext& instrContext,
+           const clang::FullSourceLoc& loc,
+           uint64_t budget);
+
+public:
+  virtual ~ClBudget() = default;
+  virtual clang::StringRef spell() const override;
+  uint64_t getBudget() const;
+
+public:
+  static ClBudget* parse(Parser& parser, const clang::SourceLocation& loc);
+  static bool classof(const Clause* clause);
+};
+
+// Clause if(<expression>)
+//
+// The sentinels of the loop or region should only be called if the
+// expression is true. The expression is evaluated once, just before the loop
+// or region, in the scope of the loop or region. It is not parsed here.
+// Instead, once the directive has been parsed and checked, it puts the tokens
+// back into the token stream as the declaration
+//
+//     const int <var> = !!(<expression>);
+//
+// so that the compiler parses and checks it like any other code, and the
+// visitor then uses the variable to guard the sentinels. Because of this, the
+// loop or region must be directly in a block.
+//
+// Example:
+//
+//     #pragma instrument loop if(n > 1024)
+//
+class ClIf : public Clause {
+private:
+  // The name of the variable in which the value of the condition is kept.
+  std::string var;
+
+  // The tokens of the condition. These have already been macro-expanded.
+  std::vector<clang::Token> cond;
+
+protected:
+  ClIf(InstrContext& instrContext,
+       const clang::FullSourceLoc& loc,
+       const std::string& var,
+       const std::vector<clang::Token>& cond);
+
+public:
+  virtual ~ClIf() = default;
+  virtual clang::StringRef spell() const override;
+  const std::string& getVar() const;
+  const std::vector<clang::Token>& getCond() const;
+
+public:
+  static ClIf* parse(Parser& parser, const clang::SourceLocation& loc);
+  static bool classof(const Clause* clause);
+};
+
 } // namespace instr
 
 #endif // CLANG_PLUGIN_EXAMPLES_INSTRUMENT_CLAUSE_H
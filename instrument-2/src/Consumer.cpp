@@ -14,6 +14,7 @@
   limitations under the License.
 */
 
+#include "Config.h"
 #include "Consumer.h"
 #include "Handler.h"
 
@@ -28,6 +29,12 @@ Consumer::Consumer(CompilerInstance& ci)
     : visitor(ci, instrContext) {
   Preprocessor& pp = ci.getPreprocessor();
   pp.AddPragmaHandler(new Handler(pp, instrContext));
+
+  // The sentinels are declared in the runtime's header. The predefines are
+  // only read when the main file is entered, so the header is included before
+  // anything in it.
+  pp.setPredefines(pp.getPredefines() + "#include \""
+                   + CLANG_PLUGIN_EXAMPLES_RUNTIME_HEADER + "\"\n");
 }
 
 void Consumer::HandleTranslationUnit(ASTContext& astContext) {
@@ -55,18 +55,20 @@ InstrContext& Directive::getInstrContext() {
 DrFunction::DrFunction(InstrContext& instrContext,
                        const FullSourceLoc& loc,
                        const std::vector<std::string>& argNames,
-                       Style style)
+                       Style style,
+                       bool alloc)
     : Directive(instrContext, loc, Directive::Function), style(style),
-      printArgs(PrintArgs::Some), argNames(argNames) {
+      printArgs(PrintArgs::Some), argNames(argNames), alloc(alloc) {
   ;
 }
 
 DrFunction::DrFunction(InstrContext& instrContext,
                        const FullSourceLoc& loc,
                        PrintArgs printArgs,
-                       Style style)
+                       Style style,
+                       bool alloc)
     : Directive(instrContext, loc, Directive::Function), style(style),
-      printArgs(printArgs) {
+      printArgs(printArgs), alloc(alloc) {
   ;
 }
 
@@ -78,6 +80,14 @@ Style DrFunction::getStyle() const {
   return this->style;
 }
 
+const std::vector<std::string>& DrFunction::getArgNames() const {
+  return this->argNames;
+}
+
+bool DrFunction::getAlloc() const {
+  return this->alloc;
+}
+
 bool DrFunction::shouldPrint(const std::string& arg) const {
   switch (this->printArgs) {
   case PrintArgs::All:
@@ -120,30 +130,46 @@ bool DrFunction::classof(const Directive* dr) {
 }
 
 DrFunction* DrFunction::parse(Parser& parser, const SourceLocation& loc) {
-  // ClFuncArgs* clArgs = nullptr;
-  // Style style = Style::Qual;
-  // InstrContext& instrConetxt = parser.getInstrContext();
-  // for (Clause* clause : parser.parseClauses())
-  //   if (auto* clStyle = dyn_cast<ClFuncStyle>(clause))
-  //     style = clStyle->getStyle();
-  //   else if (auto* clFuncArgs = dyn_cast<ClFuncArgs>(clause))
-  //     clArgs = clFuncArgs;
-  //   else
-  //     parser.error(Parser::InvalidClauseForDirective,
-  //                  clause->spell(),
-  //                  Parser::tokFunction);
+  ClFuncArgs* clArgs = nullptr;
+  Style style = Style::Qual;
+  bool alloc = false;
+  for (Clause* clause : parser.parseClauses()) {
+    if (auto* clStyle = dyn_cast<ClFuncStyle>(clause)) {
+      style = clStyle->getStyle();
+    } else if (auto* clFuncArgs = dyn_cast<ClFuncArgs>(clause)) {
+      clArgs = clFuncArgs;
+    } else if (isa<ClAlloc>(clause)) {
+      alloc = true;
+    } else {
+      parser.error(Parser::InvalidClauseForDirective,
+                   loc,
+                   clause->spell(),
+                   Parser::tokFunction);
+      return nullptr;
+    }
+  }
 
   InstrContext& instrContext = parser.getInstrContext();
   SourceManager& srcMgr = parser.getSourceManager();
-  return new DrFunction(instrContext, FullSourceLoc(loc, srcMgr));
+  if (not clArgs or clArgs->empty())
+    return new DrFunction(instrContext,
+                          FullSourceLoc(loc, srcMgr),
+                          PrintArgs::None,
+                          style,
+                          alloc);
+
+  std::vector<std::string> argNames(clArgs->begin(), clArgs->end());
+  return new DrFunction(
+      instrContext, FullSourceLoc(loc, srcMgr), argNames, style, alloc);
 }
 
 // DrLine
 
 DrLine::DrLine(InstrContext& instrContext,
                const FullSourceLoc& loc,
-               const std::string& name)
-    : Directive(instrContext, loc, Directive::Line), name(name) {
+               const std::string& name,
+               bool time)
+    : Directive(instrContext, loc, Directive::Line), name(name), time(time) {
   ;
 }
 
@@ -155,32 +181,49 @@ const std::string& DrLine::getName() const {
   return this->name;
 }
 
+bool DrLine::getTime() const {
+  return this->time;
+}
+
 bool DrLine::classof(const Directive* dr) {
   return dr->getKind() == Directive::Line;
 }
 
 DrLine* DrLine::parse(Parser& parser, const SourceLocation& loc) {
   std::string name = "";
+  bool time = false;
   for (Clause* clause : parser.parseClauses()) {
     if (auto* clName = dyn_cast<ClName>(clause)) {
       name = clName->getName();
+    } else if (isa<ClTime>(clause)) {
+      time = true;
     } else {
-      parser.error(Parser::InvalidClauseForDirective, loc, name);
+      parser.error(Parser::InvalidClauseForDirective,
+                   loc,
+                   clause->spell(),
+                   Parser::tokLine);
       return nullptr;
     }
   }
 
   InstrContext& instrContext = parser.getInstrContext();
   SourceManager& srcMgr = parser.getSourceManager();
-  return new DrLine(instrContext, FullSourceLoc(loc, srcMgr), name);
+  return new DrLine(instrContext, FullSourceLoc(loc, srcMgr), name, time);
 }
 
 // DrLoop
 
 DrLoop::DrLoop(InstrContext& instrContext,
                const FullSourceLoc& loc,
-               const std::string& name)
-    : Directive(instrContext, loc, Directive::Loop), name(name) {
+               const std::string& name,
+               const std::vector<std::string>& counters,
+               bool alloc,
+               uint64_t sample,
+               uint64_t budget,
+               const std::string& cond)
+    : Directive(instrContext, loc, Directive::Loop), name(name),
+      counters(counters), alloc(alloc), sample(sample), budget(budget),
+      cond(cond) {
   ;
 }
 
@@ -192,30 +235,90 @@ const std::string& DrLoop::getName() const {
   return this->name;
 }
 
+const std::vector<std::string>& DrLoop::getCounters() const {
+  return this->counters;
+}
+
+bool DrLoop::getAlloc() const {
+  return this->alloc;
+}
+
+uint64_t DrLoop::getSample() const {
+  return this->sample;
+}
+
+uint64_t DrLoop::getBudget() const {
+  return this->budget;
+}
+
+const std::string& DrLoop::getCond() const {
+  return this->cond;
+}
+
 bool DrLoop::classof(const Directive* dr) {
   return dr->getKind() == Directive::Loop;
 }
 
 DrLoop* DrLoop::parse(Parser& parser, const SourceLocation& loc) {
   std::string name = "";
+  std::vector<std::string> counters;
+  bool alloc = false;
+  uint64_t sample = 0;
+  uint64_t budget = 0;
+  std::string cond;
+  ClIf* clIf = nullptr;
   for (Clause* clause : parser.parseClauses()) {
-    if (auto* clName = dyn_cast<ClName>(clause))
+    if (auto* clName = dyn_cast<ClName>(clause)) {
       name = clName->getName();
-    else
-      parser.error(Parser::InvalidClauseForDirective, loc, name);
+    } else if (auto* clCounters = dyn_cast<ClCounters>(clause)) {
+      counters = clCounters->getCounters();
+    } else if (isa<ClAlloc>(clause)) {
+      alloc = true;
+    } else if (auto* clSample = dyn_cast<ClSample>(clause)) {
+      sample = clSample->getPeriod();
+    } else if (auto* clBudget = dyn_cast<ClBudget>(clause)) {
+      budget = clBudget->getBudget();
+    } else if (auto* clCond = dyn_cast<ClIf>(clause)) {
+      clIf = clCond;
+      cond = clIf->getVar();
+    } else {
+      parser.error(Parser::InvalidClauseForDirective,
+                   loc,
+                   clause->spell(),
+                   Parser::tokLoop);
+      return nullptr;
+    }
   }
 
+  // Nothing is added to the token stream unless the directive is valid.
+  if (clIf)
+    parser.injectDeclaration(clIf->getVar(), clIf->getCond(), clIf->getLoc());
+
   InstrContext& instrContext = parser.getInstrContext();
   SourceManager& srcMgr = parser.getSourceManager();
-  return new DrLoop(instrContext, FullSourceLoc(loc, srcMgr), name);
+  return new DrLoop(instrContext,
+                   FullSourceLoc(loc, srcMgr),
+                   name,
+                   counters,
+                   alloc,
+                   sample,
+                   budget,
+                   cond);
 }
 
 // DrRegion
 
 DrRegion::DrRegion(InstrContext& instrContext,
                    const FullSourceLoc& loc,
-                   const std::string& name)
-    : Directive(instrContext, loc, Directive::Region), name(name) {
+                   const std::string& name,
+                   const std::vector<std::string>& counters,
+                   bool alloc,
+                   uint64_t sample,
+                   uint64_t budget,
+                   const std::string& cond)
+    : Directive(instrContext, loc, Directive::Region), name(name),
+      counters(counters), alloc(alloc), sample(sample), budget(budget),
+      cond(cond) {
   ;
 }
 
@@ -227,22 +330,75 @@ const std::string& DrRegion::getName() const {
   return this->name;
 }
 
+const std::vector<std::string>& DrRegion::getCounters() const {
+  return this->counters;
+}
+
+bool DrRegion::getAlloc() const {
+  return this->alloc;
+}
+
+uint64_t DrRegion::getSample() const {
+  return this->sample;
+}
+
+uint64_t DrRegion::getBudget() const {
+  return this->budget;
+}
+
+const std::string& DrRegion::getCond() const {
+  return this->cond;
+}
+
 bool DrRegion::classof(const Directive* dr) {
   return dr->getKind() == Directive::Region;
 }
 
 DrRegion* DrRegion::parse(Parser& parser, const SourceLocation& loc) {
   std::string name = "";
+  std::vector<std::string> counters;
+  bool alloc = false;
+  uint64_t sample = 0;
+  uint64_t budget = 0;
+  std::string cond;
+  ClIf* clIf = nullptr;
   for (Clause* clause : parser.parseClauses()) {
-    if (auto* clName = dyn_cast<ClName>(clause))
+    if (auto* clName = dyn_cast<ClName>(clause)) {
       name = clName->getName();
-    else
-      parser.error(Parser::InvalidClauseForDirective, loc, name);
+    } else if (auto* clCounters = dyn_cast<ClCounters>(clause)) {
+      counters = clCounters->getCounters();
+    } else if (isa<ClAlloc>(clause)) {
+      alloc = true;
+    } else if (auto* clSample = dyn_cast<ClSample>(clause)) {
+      sample = clSample->getPeriod();
+    } else if (auto* clBudget = dyn_cast<ClBudget>(clause)) {
+      budget = clBudget->getBudget();
+    } else if (auto* clCond = dyn_cast<ClIf>(clause)) {
+      clIf = clCond;
+      cond = clIf->getVar();
+    } else {
+      parser.error(Parser::InvalidClauseForDirective,
+                   loc,
+                   clause->spell(),
+                   Parser::tokRegion);
+      return nullptr;
+    }
   }
 
+  // Nothing is added to the token stream unless the directive is valid.
+  if (clIf)
+    parser.injectDeclaration(clIf->getVar(), clIf->getCond(), clIf->getLoc());
+
   InstrContext& instrContext = parser.getInstrContext();
   SourceManager& srcMgr = parser.getSourceManager();
-  return new DrRegion(instrContext, FullSourceLoc(loc, srcMgr), name);
+  return new DrRegion(instrContext,
+                     FullSourceLoc(loc, srcMgr),
+                     name,
+                     counters,
+                     alloc,
+                     sample,
+                     budget,
+                     cond);
 }
 
 } // namespace instr
@@ -97,24 +97,31 @@ private:
   // this will be resized.
   std::vector<bool> args;
 
+  // True if the heap allocations made in the function should be counted.
+  bool alloc;
+
 protected:
   // This should only be called with printArgs = PrintArgs::All or
   // PrintArgs::None.
   DrFunction(InstrContext& instrContext,
              const clang::FullSourceLoc& loc,
              PrintArgs printArgs = PrintArgs::All,
-             Style style = Style::Qual);
+             Style style = Style::Qual,
+             bool alloc = false);
 
   DrFunction(InstrContext& instrContext,
              const clang::FullSourceLoc& loc,
              const std::vector<std::string>& argNames,
-             Style style = Style::Qual);
+             Style style = Style::Qual,
+             bool alloc = false);
 
 public:
   virtual ~DrFunction() = default;
   virtual clang::StringRef spell() const override;
 
   Style getStyle() const;
+  const std::vector<std::string>& getArgNames() const;
+  bool getAlloc() const;
 
   // Check if the named argument should be printed. Will return true if either
   // the argument is present in the argNames member or if all the args should
@@ -144,15 +151,20 @@ class DrLine : public Directive {
 private:
   std::string name;
 
+  // True if the times at which the line is reached should be recorded.
+  bool time;
+
 protected:
   DrLine(InstrContext& instrContext,
          const clang::FullSourceLoc& loc,
-         const std::string& name = "");
+         const std::string& name = "",
+         bool time = false);
 
 public:
   virtual ~DrLine() = default;
   virtual clang::StringRef spell() const override;
   const std::string& getName() const;
+  bool getTime() const;
 
 public:
   static DrLine* parse(Parser& parser, const clang::SourceLocation& loc);
@@ -164,15 +176,43 @@ class DrLoop : public Directive {
 private:
   std::string name;
 
+  // The performance counters to read when control enters and exits the
+  // loop.
+  std::vector<std::string> counters;
+
+  // True if the heap allocations made in the loop should be counted.
+  bool alloc;
+
+  // Only one in every sample entries of the loop should be timed. The
+  // budget is the overhead, in nanoseconds per second, that the runtime
+  // should keep the instrumentation of the loop under. Both are 0 if they
+  // were not given.
+  uint64_t sample;
+  uint64_t budget;
+
+  // The variable that holds the value of the condition in the if clause.
+  // This is empty if there is no such clause.
+  std::string cond;
+
 protected:
   DrLoop(InstrContext& instrContext,
          const clang::FullSourceLoc& loc,
-         const std::string& name = "");
+         const std::string& name = "",
+         const std::vector<std::string>& counters = {},
+         bool alloc = false,
+         uint64_t sample = 0,
+         uint64_t budget = 0,
+         const std::string& cond = "");
 
 public:
   virtual ~DrLoop() = default;
   virtual clang::StringRef spell() const override;
   const std::string& getName() const;
+  const std::vector<std::string>& getCounters() const;
+  bool getAlloc() const;
+  uint64_t getSample() const;
+  uint64_t getBudget() const;
+  const std::string& getCond() const;
 
 public:
   static DrLoop* parse(Parser& parser, const clang::SourceLocation& loc);
@@ -184,15 +224,43 @@ class DrRegion : public Directive {
 private:
   std::string name;
 
+  // The performance counters to read when control enters and exits the
+  // region.
+  std::vector<std::string> counters;
+
+  // True if the heap allocations made in the region should be counted.
+  bool alloc;
+
+  // Only one in every sample entries of the region should be timed. The
+  // budget is the overhead, in nanoseconds per second, that the runtime
+  // should keep the instrumentation of the region under. Both are 0 if they
+  // were not given.
+  uint64_t sample;
+  uint64_t budget;
+
+  // The variable that holds the value of the condition in the if clause.
+  // This is empty if there is no such clause.
+  std::string cond;
+
 protected:
   DrRegion(InstrContext& instrContext,
            const clang::FullSourceLoc& loc,
-           const std::string& name = "");
+           const std::string& name = "",
+           const std::vector<std::string>& counters = {},
+           bool alloc = false,
+           uint64_t sample = 0,
+           uint64_t budget = 0,
+           const std::string& cond = "");
 
 public:
   virtual ~DrRegion() = default;
   virtual clang::StringRef spell() const override;
   const std::string& getName() const;
+  const std::vector<std::string>& getCounters() const;
+  bool getAlloc() const;
+  uint64_t getSample() const;
+  uint64_t getBudget() const;
+  const std::string& getCond() const;
 
 public:
   static DrRegion* parse(Parser& parser, const clang::SourceLocation& loc);
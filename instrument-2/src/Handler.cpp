@@ -32,9 +32,10 @@ Handler::Handler(Preprocessor& pp, InstrContext& instrContext)
 }
 
 void Handler::HandlePragma(Preprocessor& pp, PragmaIntroducer, Token& tok) {
+  // The directive adds itself to the context when it is created, so there is
+  // nothing more to do with it here.
   this->parser.prepareToParse();
-  if (Directive* dr = parser.parseDirective(tok))
-    this->instrContext.add(dr);
+  this->parser.parseDirective(tok);
 }
 
 } // namespace instr
@@ -34,8 +34,8 @@ unsigned InstrContext::peek(const FileEntry* file) const {
   return this->lines.at(file).front()->getLineNumber();
 }
 
-unsigned InstrContext::pop(const FileEntry* file) {
-  unsigned front = this->lines.at(file).front()->getLineNumber();
+Directive* InstrContext::pop(const FileEntry* file) {
+  Directive* front = this->lines.at(file).front();
   this->lines.at(file).pop();
   return front;
 }
@@ -56,18 +56,38 @@ Clause* InstrContext::add(Clause* cl) {
 }
 
 unsigned InstrContext::findNearestAndPop(const FullSourceLoc& loc) {
+  if (Directive* nearest = this->findNearestDirectiveAndPop(loc))
+    return nearest->getLineNumber();
+  return InstrContext::invalid;
+}
+
+Directive* InstrContext::findNearestDirectiveAndPop(const FullSourceLoc& loc) {
   const FileEntry* file = loc.getFileEntry();
   unsigned lno = loc.getLineNumber();
 
   // There may be orphaned pragmas that are not associated with any loop
   // with another pragma being nearer the current loop.
-  unsigned nearest = InstrContext::invalid;
+  Directive* nearest = nullptr;
   while ((not this->empty(file)) and (this->peek(file) < lno))
     nearest = this->pop(file);
 
   return nearest;
 }
 
+Directive* InstrContext::peekDirective(const FullSourceLoc& loc) const {
+  const FileEntry* file = loc.getFileEntry();
+  if (this->empty(file) or this->peek(file) >= loc.getLineNumber())
+    return nullptr;
+  return this->lines.at(file).front();
+}
+
+Directive* InstrContext::popDirective(const FullSourceLoc& loc) {
+  const FileEntry* file = loc.getFileEntry();
+  if (this->empty(file))
+    return nullptr;
+  return this->pop(file);
+}
+
 const unsigned InstrContext::invalid = std::numeric_limits<unsigned>::max();
 
 } // namespace instr
@@ -43,12 +43,24 @@ public:
 private:
   bool empty(const clang::FileEntry* file) const;
   unsigned peek(const clang::FileEntry* file) const;
-  unsigned pop(const clang::FileEntry* file);
+  Directive* pop(const clang::FileEntry* file);
 
 public:
   Directive* add(Directive* dr);
   Clause* add(Clause* cl);
   unsigned findNearestAndPop(const clang::FullSourceLoc& loc);
+
+  // Like findNearestAndPop, but returns the directive itself. Returns nullptr
+  // if there is no directive before the location.
+  Directive* findNearestDirectiveAndPop(const clang::FullSourceLoc& loc);
+
+  // Get the next directive in the file if it is before the location. Unlike
+  // findNearestDirectiveAndPop, this does not pop it. Returns nullptr if the
+  // next directive is not before the location.
+  Directive* peekDirective(const clang::FullSourceLoc& loc) const;
+
+  // Pop the next directive in the file of the location.
+  Directive* popDirective(const clang::FullSourceLoc& loc);
 };
 
 } // namespace instr
@@ -16,6 +16,9 @@
 
 #include <clang/Lex/Preprocessor.h>
 
+#include <algorithm>
+#include <memory>
+
 #include "Clause.h"
 #include "Directive.h"
 #include "Parser.h"
@@ -37,6 +40,12 @@ StringRef Parser::tokFuncStyle = "style";
 StringRef Parser::tokFuncStyleDecl = "decl";
 StringRef Parser::tokFuncStyleQual = "qual";
 StringRef Parser::tokFuncStyleFull = "full";
+StringRef Parser::tokCounters = "counters";
+StringRef Parser::tokAlloc = "alloc";
+StringRef Parser::tokTime = "time";
+StringRef Parser::tokSample = "sample";
+StringRef Parser::tokBudget = "budget";
+StringRef Parser::tokIf = "if";
 
 Parser::Parser(Preprocessor& pp, InstrContext& instrContext)
     : pp(pp), diags(pp.getDiagnostics()), instrContext(instrContext),
@@ -50,6 +59,12 @@ Parser::Parser(Preprocessor& pp, InstrContext& instrContext)
           {Parser::tokName.str(), &ClName::parse},
           {Parser::tokFuncStyle.str(), &ClFuncStyle::parse},
           {Parser::tokFuncArgs.str(), &ClFuncArgs::parse},
+          {Parser::tokCounters.str(), &ClCounters::parse},
+          {Parser::tokAlloc.str(), &ClAlloc::parse},
+          {Parser::tokTime.str(), &ClTime::parse},
+          {Parser::tokSample.str(), &ClSample::parse},
+          {Parser::tokBudget.str(), &ClBudget::parse},
+          {Parser::tokIf.str(), &ClIf::parse},
       }),
       errMsgs(
           {{Parser::MissingDirectiveKind,
@@ -61,6 +76,8 @@ Parser::Parser(Preprocessor& pp, InstrContext& instrContext)
             "Invalid clause '%0' for directive '%1'"},
            {Parser::ExpectedToken, "Expected token '%0'"},
            {Parser::ExpectedIntLiteral, "Expected integer literal, not '%0'"},
+           {Parser::ExpectedPositiveInt, "Expected a positive integer"},
+           {Parser::ExpectedExpression, "Expected expression"},
            {Parser::ExpectedStringLiteral, "Expected string literal, not '%0'"},
            {Parser::ExpectedIdentifier, "Expected identifier, not '%0'"},
            {Parser::UnknownEnumValue, "Unknown enum value '%0'"},
@@ -283,10 +300,74 @@ Directive* Parser::parseDirective(Token& tokSentinel) {
     this->error(Error::UnknownDirectiveKind, loc, dr);
     return nullptr;
   } else {
+    // The directive parsers expect the kind to have been consumed.
+    this->consume();
     return this->parseDirective(dr, loc);
   }
 }
 
+bool Parser::parseBalancedTokensInto(std::vector<Token>& out) {
+  unsigned depth = 0;
+  while (not this->eod()) {
+    if (this->is(tok::r_paren) and not depth) {
+      if (out.empty())
+        return this->error(Parser::ExpectedExpression, this->loc());
+      this->consume();
+      return true;
+    }
+
+    if (this->is(tok::l_paren))
+      depth++;
+    else if (this->is(tok::r_paren))
+      depth--;
+    out.push_back(this->consume());
+  }
+
+  return this->error(Parser::UnexpectedEod, this->loc());
+}
+
+void Parser::injectDeclaration(const std::string& var,
+                               const std::vector<Token>& init,
+                               const SourceLocation& loc) {
+  std::vector<Token> toks;
+  auto add = [&](tok::TokenKind kind, const char* ident = nullptr) {
+    toks.emplace_back();
+    Token& tok = toks.back();
+    tok.startToken();
+    tok.setKind(kind);
+    tok.setLocation(loc);
+    tok.setLength(0);
+    if (ident)
+      tok.setIdentifierInfo(this->pp.getIdentifierInfo(ident));
+  };
+
+  // The attribute keeps the compiler from warning about the variable being
+  // unused. It is only used by the instrumentation, which is added after the
+  // function has been parsed.
+  add(tok::kw___attribute, "__attribute__");
+  add(tok::l_paren);
+  add(tok::l_paren);
+  add(tok::identifier, "__unused__");
+  add(tok::r_paren);
+  add(tok::r_paren);
+  add(tok::kw_const, "const");
+  add(tok::kw_int, "int");
+  add(tok::identifier, var.c_str());
+  add(tok::equal);
+  add(tok::exclaim);
+  add(tok::exclaim);
+  add(tok::l_paren);
+  toks.insert(toks.end(), init.begin(), init.end());
+  add(tok::r_paren);
+  add(tok::semi);
+
+  // The tokens of the expression have already been macro-expanded when the
+  // directive was lexed.
+  std::unique_ptr<Token[]> stream(new Token[toks.size()]);
+  std::copy(toks.begin(), toks.end(), stream.get());
+  this->pp.EnterTokenStream(std::move(stream), toks.size(), true, false);
+}
+
 void Parser::lex() {
   // lex all tokens until the end of the directive. This is usually till the
   // end of the line, unless continuation lines have been used.
@@ -294,7 +375,6 @@ void Parser::lex() {
     this->toks.emplace_back();
     this->getPreprocessor().Lex(this->toks.back());
   } while (not this->toks.back().is(tok::eod));
-  this->toks.pop_back();
 }
 
 void Parser::prepareToParse() {
@@ -50,6 +50,8 @@ public:
     InvalidClauseForDirective,
     ExpectedIdentifier,
     ExpectedIntLiteral,
+    ExpectedPositiveInt,
+    ExpectedExpression,
     ExpectedList,
     ExpectedStringLiteral,
     ExpectedToken,
@@ -91,13 +93,6 @@ private:
   // tok::eod.
   void lex();
 
-  // Check if the end of the directive has been reached. This will be if the
-  // token of kind eod is at the front of the list of unconsumed tokens.
-  bool eod() const;
-
-  // Check if the token at the front of the list is of the given kind.
-  bool is(clang::tok::TokenKind kind) const;
-
   bool isKnownClause(clang::StringRef cl) const;
   bool isKnownDirective(clang::StringRef dr) const;
 
@@ -147,6 +142,13 @@ public:
   // state.
   void prepareToParse();
 
+  // Check if the end of the directive has been reached. This will be if the
+  // token of kind eod is at the front of the list of unconsumed tokens.
+  bool eod() const;
+
+  // Check if the token at the front of the list is of the given kind.
+  bool is(clang::tok::TokenKind kind) const;
+
   // Peek (do not consume) the token at position n from the front of the list
   // of tokens. By default, this returns a reference to the token at the front
   // of the list of tokens. It is an error to call this with a position that is
@@ -204,6 +206,21 @@ public:
   // Parse a sequence of identifiers.
   bool parseIdentifierListInto(std::vector<std::string>& ids);
 
+  // Consume the tokens up to the closing parenthesis that matches an opening
+  // one that has already been consumed. The closing parenthesis is consumed
+  // as well, but is not returned. Raise a parse error if there is no such
+  // parenthesis or if there is nothing before it.
+  bool parseBalancedTokensInto(std::vector<clang::Token>& out);
+
+  // Have the preprocessor return the tokens of the declaration
+  //
+  //     __attribute__((__unused__)) const int <var> = !!(<init>);
+  //
+  // after the directive. All the tokens get the given location.
+  void injectDeclaration(const std::string& var,
+                         const std::vector<clang::Token>& init,
+                         const clang::SourceLocation& loc);
+
   // Parse the current pragma. The given token is the sentinel token whose
   // spelling is Parser::tokSentinel.
   Directive* parseDirective(clang::Token& tok);
@@ -224,6 +241,12 @@ public:
   static clang::StringRef tokFuncStyleDecl;
   static clang::StringRef tokFuncStyleQual;
   static clang::StringRef tokFuncStyleFull;
+  static clang::StringRef tokCounters;
+  static clang::StringRef tokAlloc;
+  static clang::StringRef tokTime;
+  static clang::StringRef tokSample;
+  static clang::StringRef tokBudget;
+  static clang::StringRef tokIf;
 };
 
 } // namespace instr
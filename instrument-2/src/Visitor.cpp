@@ -15,6 +15,10 @@
 */
 
 #include <clang/Frontend/CompilerInstance.h>
+#include <clang/Sema/Lookup.h>
+#include <clang/Sema/Sema.h>
+
+#include <llvm/Support/raw_ostream.h>
 
 #include <limits>
 
@@ -26,7 +30,8 @@ namespace instr {
 
 Visitor::Visitor(CompilerInstance& ci, InstrContext& instrContext)
     : ci(ci), astContext(ci.getASTContext()), srcMgr(ci.getSourceManager()),
-      instrContext(instrContext), parentMap(ci.getASTContext()) {
+      instrContext(instrContext), parentMap(ci.getASTContext()),
+      function(nullptr) {
   ;
 }
 
@@ -38,6 +43,10 @@ void Visitor::raiseMultipleParentsError(Stmt* stmt) {
 }
 
 Stmt* Visitor::getParent(Stmt* stmt) {
+  auto it = this->wrappers.find(stmt);
+  if (it != this->wrappers.end())
+    return it->second;
+
   DynTypedNodeList parents = parentMap.getParents(*stmt);
 
   // The documentation says that statements in templates can have multiple
@@ -55,10 +64,9 @@ Stmt* Visitor::getParent(Stmt* stmt) {
   return const_cast<Stmt*>(parent);
 }
 
-bool Visitor::shouldDemarcate(Stmt* stmt, Directive::Kind kind) {
+Directive* Visitor::getDirective(Stmt* stmt, Directive::Kind kind) {
   FullSourceLoc loc(stmt->getBeginLoc(), this->srcMgr);
-  unsigned plno = this->instrContext.findNearestAndPop(loc);
-  return plno != InstrContext::invalid;
+  return this->instrContext.findNearestDirectiveAndPop(loc);
 }
 
 DeclRefExpr* Visitor::getDeclRefExpr(FunctionDecl* fn) {
@@ -71,84 +79,642 @@ DeclRefExpr* Visitor::getDeclRefExpr(FunctionDecl* fn) {
                              fn,
                              false,
                              loc,
-                             ast.VoidTy,
+                             fn->getType(),
                              ExprValueKind::VK_LValue);
 }
 
-Stmt* Visitor::getCall(FunctionDecl* fn, SourceLocation loc) {
+Stmt* Visitor::getCall(FunctionDecl* fn,
+                       llvm::ArrayRef<Expr*> args,
+                       SourceLocation loc) {
   ASTContext& ast = this->astContext;
+
+  // The callee must be decayed to a function pointer, otherwise codegen will
+  // not know what to do with it.
+  Expr* callee = ImplicitCastExpr::Create(ast,
+                                          ast.getPointerType(fn->getType()),
+                                          CK_FunctionToPointerDecay,
+                                          this->getDeclRefExpr(fn),
+                                          nullptr,
+                                          VK_PRValue,
+                                          FPOptionsOverride());
+
   return CallExpr::Create(ast,
-                          this->getDeclRefExpr(fn),
-                          {},
-                          ast.VoidTy,
+                          callee,
+                          args,
+                          fn->getReturnType(),
                           ExprValueKind::VK_PRValue,
                           loc,
                           FPOptionsOverride());
 }
 
-FunctionDecl* Visitor::getDecl(DeclContext* declContext,
-                               SourceLocation loc,
-                               IdentifierInfo& ident) {
+QualType Visitor::getDescriptorType() {
   ASTContext& ast = this->astContext;
-  DeclarationName name(&ident);
-  return FunctionDecl::Create(ast,
-                              declContext,
-                              loc,
-                              loc,
-                              name,
-                              ast.VoidTy,
-                              nullptr,
-                              StorageClass::SC_None);
-}
-
-Stmt* Visitor::getEnterCall(DeclContext* declContext, SourceLocation loc) {
+  return ast.getPointerType(ast.CharTy.withConst());
+}
+
+Stmt* Visitor::getAssociatedLoop(OMPLoopBasedDirective* dir) {
+  Stmt* stmt = dir->getAssociatedStmt();
+  if (llvm::isa<CapturedStmt>(stmt))
+    stmt = dir->getInnermostCapturedStmt()->getCapturedStmt();
+  return stmt;
+}
+
+std::string Visitor::getDescriptor(Stmt* stmt, Directive* dr) {
+  auto* omp = llvm::dyn_cast<OMPLoopDirective>(stmt);
+  if (omp)
+    stmt = Visitor::getAssociatedLoop(omp);
+  PresumedLoc ploc = this->srcMgr.getPresumedLoc(stmt->getBeginLoc());
+  std::string desc;
+  llvm::raw_string_ostream ss(desc);
+
+  ss << ploc.getFilename() << ":" << ploc.getLine() << ":" << ploc.getColumn();
+  ss << "|";
+  if (this->function)
+    ss << this->function->getQualifiedNameAsString();
+  ss << "|";
+
+  std::vector<std::string> counters;
+  std::vector<std::string> options;
+  if (auto* loop = llvm::dyn_cast<DrLoop>(dr)) {
+    ss << loop->getName();
+    counters = loop->getCounters();
+    if (loop->getAlloc())
+      options.push_back("alloc");
+    if (loop->getSample())
+      options.push_back("sample=" + std::to_string(loop->getSample()));
+    if (loop->getBudget())
+      options.push_back("budget=" + std::to_string(loop->getBudget()));
+    if (omp)
+      options.push_back("omp");
+  } else if (auto* region = llvm::dyn_cast<DrRegion>(dr)) {
+    ss << region->getName();
+    counters = region->getCounters();
+    if (region->getAlloc())
+      options.push_back("alloc");
+    if (region->getSample())
+      options.push_back("sample=" + std::to_string(region->getSample()));
+    if (region->getBudget())
+      options.push_back("budget=" + std::to_string(region->getBudget()));
+  } else if (auto* line = llvm::dyn_cast<DrLine>(dr)) {
+    ss << line->getName();
+    if (line->getTime())
+      options.push_back("time");
+  }
+  ss << "|";
+  for (unsigned i = 0; i < counters.size(); i++)
+    ss << (i ? "," : "") << counters[i];
+
+  // The cost field is only filled in by loop-demarcator-3.
+  ss << "||";
+  for (unsigned i = 0; i < options.size(); i++)
+    ss << (i ? "," : "") << options[i];
+
+  return ss.str();
+}
+
+std::string Visitor::getFunctionName(FunctionDecl* fn, Style style) {
+  switch (style) {
+  case Style::Decl:
+    return fn->getNameAsString();
+  case Style::Qual:
+    return fn->getQualifiedNameAsString();
+  case Style::Full:
+    break;
+  }
+
+  std::string name;
+  llvm::raw_string_ostream ss(name);
+  fn->getNameForDiagnostic(ss, this->astContext.getPrintingPolicy(), true);
+  return ss.str();
+}
+
+// The tag tells the loop-args tool how to format the raw bytes of the
+// argument. Anything that is not a scalar is printed as bytes.
+static char getTypeTag(QualType type) {
+  if (type->isBooleanType())
+    return 'b';
+  else if (type->isAnyCharacterType())
+    return 'c';
+  else if (type->isSignedIntegerOrEnumerationType())
+    return 'i';
+  else if (type->isUnsignedIntegerOrEnumerationType())
+    return 'u';
+  else if (type->isRealFloatingType())
+    return 'f';
+  else if (type->isAnyPointerType() or type->isBlockPointerType()
+           or type->isNullPtrType())
+    return 'p';
+  return 'x';
+}
+
+std::string
+Visitor::getDescriptor(FunctionDecl* fn,
+                       DrFunction* dr,
+                       const std::vector<ParmVarDecl*>& params) {
   ASTContext& ast = this->astContext;
-  IdentifierTable& idents = ast.Idents;
-  IdentifierInfo& ident = idents.get("__enterLoop");
-  FunctionDecl* fn = this->getDecl(declContext, loc, ident);
+  PresumedLoc ploc = this->srcMgr.getPresumedLoc(fn->getLocation());
+  std::string desc;
+  llvm::raw_string_ostream ss(desc);
+
+  ss << ploc.getFilename() << ":" << ploc.getLine() << ":" << ploc.getColumn();
+  ss << "|" << this->getFunctionName(fn, dr->getStyle()) << "||||args=";
+  for (unsigned i = 0; i < params.size(); i++) {
+    ParmVarDecl* param = params[i];
+    QualType type = param->getType().getNonReferenceType();
+    ss << (i ? ";" : "");
+    if (param->getName().empty())
+      ss << "#" << param->getFunctionScopeIndex() + 1;
+    else
+      ss << param->getName();
+    ss << ":" << getTypeTag(type)
+       << ast.getTypeSizeInChars(type).getQuantity();
+  }
 
-  return this->getCall(fn, loc);
+  return ss.str();
 }
 
-Stmt* Visitor::getExitCall(DeclContext* declContext, SourceLocation loc) {
+std::string Visitor::getDescriptor(FunctionDecl* fn, DrFunction* dr) {
+  PresumedLoc ploc = this->srcMgr.getPresumedLoc(fn->getLocation());
+  std::string desc;
+  llvm::raw_string_ostream ss(desc);
+
+  ss << ploc.getFilename() << ":" << ploc.getLine() << ":" << ploc.getColumn();
+  ss << "|" << this->getFunctionName(fn, dr->getStyle()) << "||||function";
+  if (dr->getAlloc())
+    ss << ",alloc";
+
+  return ss.str();
+}
+
+Expr* Visitor::getDescriptorArg(StringRef desc, SourceLocation loc) {
+  ASTContext& ast = this->astContext;
+  QualType strTy = ast.getStringLiteralArrayType(ast.CharTy, desc.size());
+  Expr* lit
+      = StringLiteral::Create(ast, desc, StringLiteral::Ascii, false, strTy, loc);
+
+  // In C, the string literal is a char[] and the decayed pointer must also be
+  // qualified before it can be passed to the sentinel.
+  QualType ptrTy = ast.getArrayDecayedType(strTy);
+  Expr* arg = ImplicitCastExpr::Create(ast,
+                                       ptrTy,
+                                       CK_ArrayToPointerDecay,
+                                       lit,
+                                       nullptr,
+                                       VK_PRValue,
+                                       FPOptionsOverride());
+  if (ast.hasSameType(ptrTy, this->getDescriptorType()))
+    return arg;
+
+  return ImplicitCastExpr::Create(ast,
+                                  this->getDescriptorType(),
+                                  CK_NoOp,
+                                  arg,
+                                  nullptr,
+                                  VK_PRValue,
+                                  FPOptionsOverride());
+}
+
+FunctionDecl* Visitor::getSentinel(StringRef name, SourceLocation loc) {
+  auto it = this->sentinels.find(name.str());
+  if (it != this->sentinels.end())
+    return it->second;
+
+  ASTContext& ast = this->astContext;
+  Sema& sema = this->ci.getSema();
+  LookupResult result(sema,
+                      DeclarationName(&ast.Idents.get(name)),
+                      loc,
+                      Sema::LookupOrdinaryName);
+  sema.LookupQualifiedName(result, ast.getTranslationUnitDecl());
+  FunctionDecl* fn = result.getAsSingle<FunctionDecl>();
+  if (not fn) {
+    DiagnosticsEngine& diags = this->ci.getDiagnostics();
+    const auto id = diags.getCustomDiagID(
+        DiagnosticsEngine::Error,
+        "Sentinel '%0' is not declared. Was the loop runtime header included?");
+    diags.Report(loc, id) << name;
+  }
+  this->sentinels[name.str()] = fn;
+
+  return fn;
+}
+
+bool Visitor::hasSentinels(std::initializer_list<StringRef> names,
+                           SourceLocation loc) {
+  bool found = true;
+  for (StringRef name : names)
+    if (not this->getSentinel(name, loc))
+      found = false;
+  return found;
+}
+
+Stmt* Visitor::getEnterCall(StringRef desc, SourceLocation loc) {
+  FunctionDecl* fn = this->getSentinel("__enterLoop", loc);
+
+  return this->getCall(fn, this->getDescriptorArg(desc, loc), loc);
+}
+
+Stmt* Visitor::getExitCall(StringRef desc, SourceLocation loc) {
+  FunctionDecl* fn = this->getSentinel("__exitLoop", loc);
+
+  return this->getCall(fn, this->getDescriptorArg(desc, loc), loc);
+}
+
+const std::string& Visitor::getCond(Directive* dr) {
+  static const std::string none;
+  if (auto* loop = llvm::dyn_cast<DrLoop>(dr))
+    return loop->getCond();
+  else if (auto* region = llvm::dyn_cast<DrRegion>(dr))
+    return region->getCond();
+  return none;
+}
+
+VarDecl*
+Visitor::getCondVar(Stmt* stmt, Stmt* parent, const std::string& name) {
+  // If the statement is not directly in a block, the declaration will have
+  // ended up somewhere else, e.g. as the body of an if statement, and the
+  // statement itself would have been moved out of it.
+  auto* block = llvm::dyn_cast_or_null<CompoundStmt>(parent);
+  if (not block)
+    return nullptr;
+
+  Stmt* prev = nullptr;
+  for (Stmt* child : block->body()) {
+    if (child == stmt)
+      break;
+    prev = child;
+  }
+
+  auto* declStmt = llvm::dyn_cast_or_null<DeclStmt>(prev);
+  if (not declStmt or not declStmt->isSingleDecl())
+    return nullptr;
+  auto* var = llvm::dyn_cast<VarDecl>(declStmt->getSingleDecl());
+  if (not var or var->getName() != name)
+    return nullptr;
+  return var;
+}
+
+Expr* Visitor::getCondExpr(VarDecl* var, SourceLocation loc) {
+  ASTContext& ast = this->astContext;
+  Expr* ref = DeclRefExpr::Create(ast,
+                                  NestedNameSpecifierLoc(),
+                                  SourceLocation::getFromRawEncoding(0),
+                                  var,
+                                  false,
+                                  loc,
+                                  var->getType(),
+                                  ExprValueKind::VK_LValue);
+  Expr* cond = ImplicitCastExpr::Create(ast,
+                                        var->getType().getUnqualifiedType(),
+                                        CK_LValueToRValue,
+                                        ref,
+                                        nullptr,
+                                        VK_PRValue,
+                                        FPOptionsOverride());
+
+  // In C++, a condition must be a bool.
+  if (ast.getLangOpts().CPlusPlus)
+    cond = ImplicitCastExpr::Create(ast,
+                                    ast.BoolTy,
+                                    CK_IntegralToBoolean,
+                                    cond,
+                                    nullptr,
+                                    VK_PRValue,
+                                    FPOptionsOverride());
+
+  return cond;
+}
+
+Stmt* Visitor::getGuard(VarDecl* var, Stmt* call, SourceLocation loc) {
+  ASTContext& ast = this->astContext;
+  Expr* cond = this->getCondExpr(var, loc);
+
+  return IfStmt::Create(
+      ast, loc, false, nullptr, nullptr, cond, loc, loc, call);
+}
+
+bool Visitor::hasJumpTargets(const Stmt* stmt, bool inSwitch) {
+  if (not stmt)
+    return false;
+  else if (llvm::isa<LabelStmt>(stmt))
+    return true;
+  else if (llvm::isa<SwitchCase>(stmt) and not inSwitch)
+    return true;
+
+  // The cases of a switch that is itself in the statement can only be reached
+  // from inside it.
+  bool isSwitch = inSwitch or llvm::isa<SwitchStmt>(stmt);
+  for (const Stmt* child : stmt->children())
+    if (Visitor::hasJumpTargets(child, isSwitch))
+      return true;
+  return false;
+}
+
+std::vector<ParmVarDecl*> Visitor::getLoggedParams(FunctionDecl* fn,
+                                                   DrFunction* dr) {
+  ASTContext& ast = this->astContext;
+  DiagnosticsEngine& diags = this->ci.getDiagnostics();
+  std::vector<ParmVarDecl*> params;
+
+  for (const std::string& name : dr->getArgNames()) {
+    bool found = false;
+    for (ParmVarDecl* param : fn->parameters())
+      found |= param->getName() == name;
+    if (not found) {
+      const auto id = diags.getCustomDiagID(
+          DiagnosticsEngine::Warning, "'%0' is not an argument of '%1'");
+      diags.Report(dr->getLoc(), id) << name << fn->getNameAsString();
+    }
+  }
+
+  dr->setNumArgs(fn->getNumParams());
+  for (unsigned i = 0; i < fn->getNumParams(); i++) {
+    ParmVarDecl* param = fn->getParamDecl(i);
+    if (dr->shouldPrint(param->getName().str()))
+      dr->setArg(i);
+    else
+      dr->resetArg(i);
+
+    // The size of the argument must be known to copy it.
+    QualType type = param->getType().getNonReferenceType();
+    if (dr->shouldPrint(i) and not type->isIncompleteType()
+        and not type->isDependentType() and not type->isVariablyModifiedType()
+        and not ast.getTypeSizeInChars(type).isZero())
+      params.push_back(param);
+  }
+
+  return params;
+}
+
+Expr* Visitor::getArgAddr(ParmVarDecl* param, SourceLocation loc) {
+  ASTContext& ast = this->astContext;
+
+  // If the argument is a reference, it is the object to which it refers that
+  // is logged.
+  QualType type = param->getType().getNonReferenceType();
+  Expr* ref = DeclRefExpr::Create(ast,
+                                  NestedNameSpecifierLoc(),
+                                  SourceLocation::getFromRawEncoding(0),
+                                  param,
+                                  false,
+                                  loc,
+                                  type,
+                                  ExprValueKind::VK_LValue);
+  Expr* addr = UnaryOperator::Create(ast,
+                                     ref,
+                                     UO_AddrOf,
+                                     ast.getPointerType(type),
+                                     VK_PRValue,
+                                     OK_Ordinary,
+                                     loc,
+                                     false,
+                                     FPOptionsOverride());
+
+  // The runtime reads every argument as a const void*.
+  return ImplicitCastExpr::Create(ast,
+                                  ast.getPointerType(ast.VoidTy.withConst()),
+                                  CK_BitCast,
+                                  addr,
+                                  nullptr,
+                                  VK_PRValue,
+                                  FPOptionsOverride());
+}
+
+Stmt* Visitor::getLogArgsCall(StringRef desc,
+                              const std::vector<ParmVarDecl*>& params,
+                              SourceLocation loc) {
+  FunctionDecl* fn = this->getSentinel("__logArgs", loc);
+
+  std::vector<Expr*> args = {this->getDescriptorArg(desc, loc)};
+  for (ParmVarDecl* param : params)
+    args.push_back(this->getArgAddr(param, loc));
+
+  return this->getCall(fn, args, loc);
+}
+
+Stmt* Visitor::getScopeGuard(FunctionDecl* fn,
+                             StringRef enter,
+                             StringRef exit,
+                             StringRef desc,
+                             VarDecl* cond,
+                             SourceLocation loc) {
   ASTContext& ast = this->astContext;
   IdentifierTable& idents = ast.Idents;
-  IdentifierInfo& ident = idents.get("__exitLoop");
-  DeclarationName name(&ident);
-  FunctionDecl* fn = this->getDecl(declContext, loc, ident);
+  QualType descTy = this->getDescriptorType();
+
+  FunctionDecl* enterFn = this->getSentinel(enter, loc);
+  FunctionDecl* exitFn = this->getSentinel(exit, loc);
+  Expr* arg = this->getDescriptorArg(desc, loc);
+  auto* init = llvm::cast<Expr>(this->getCall(enterFn, arg, loc));
+  if (cond) {
+    Expr* zero = IntegerLiteral::Create(
+        ast, llvm::APInt(ast.getIntWidth(ast.IntTy), 0), ast.IntTy, loc);
+    Expr* null = ImplicitCastExpr::Create(ast,
+                                          descTy,
+                                          CK_NullToPointer,
+                                          zero,
+                                          nullptr,
+                                          VK_PRValue,
+                                          FPOptionsOverride());
+    init = new (ast) ConditionalOperator(this->getCondExpr(cond, loc),
+                                         loc,
+                                         init,
+                                         loc,
+                                         null,
+                                         descTy,
+                                         VK_PRValue,
+                                         OK_Ordinary);
+  }
 
-  return this->getCall(fn, loc);
+  VarDecl* var = VarDecl::Create(ast,
+                                 fn,
+                                 loc,
+                                 loc,
+                                 &idents.get("__instr_scope"),
+                                 descTy,
+                                 ast.getTrivialTypeSourceInfo(descTy, loc),
+                                 StorageClass::SC_None);
+  var->setInit(init);
+  var->addAttr(CleanupAttr::CreateImplicit(ast, exitFn));
+
+  return new (ast) DeclStmt(DeclGroupRef(var), loc, loc);
 }
 
-void Visitor::demarcate(Stmt* stmt) {
+void Visitor::instrument(FunctionDecl* fn, DrFunction* dr) {
+  ASTContext& ast = this->astContext;
+
+  // Constructors with function try blocks and coroutines have bodies that
+  // are not compound statements. These are not supported.
+  auto* body = llvm::dyn_cast_or_null<CompoundStmt>(fn->getBody());
+  if (not body)
+    return;
+
+  SourceLocation beg = body->getBeginLoc();
+  SourceLocation end = body->getEndLoc();
+  std::vector<ParmVarDecl*> params = this->getLoggedParams(fn, dr);
+  if (not this->hasSentinels({"__enterFunction", "__exitFunction"}, beg))
+    return;
+  if (not params.empty() and not this->hasSentinels({"__logArgs"}, beg))
+    return;
+
+  // The arguments are logged before the function is entered so that the
+  // cost of logging them is not counted in the time of the function. There
+  // is no call at all if no argument is logged.
+  std::vector<Stmt*> stmts;
+  if (not params.empty()) {
+    std::string argsDesc = this->getDescriptor(fn, dr, params);
+    stmts.push_back(this->getLogArgsCall(argsDesc, params, beg));
+  }
+  std::string desc = this->getDescriptor(fn, dr);
+  stmts.push_back(this->getScopeGuard(
+      fn, "__enterFunction", "__exitFunction", desc, nullptr, beg));
+  stmts.push_back(body);
+  fn->setBody(CompoundStmt::Create(ast, stmts, beg, end));
+}
+
+bool Visitor::isFullStmt(Stmt* stmt, Stmt* parent) {
+  // The labels themselves are skipped. The statement that they label is the
+  // one to which the directive is attached, so that the line is counted when
+  // control jumps to the label.
+  if (not parent or llvm::isa<SwitchCase>(stmt) or llvm::isa<LabelStmt>(stmt))
+    return false;
+  else if (llvm::isa<CompoundStmt>(parent))
+    return true;
+  else if (auto* label = llvm::dyn_cast<LabelStmt>(parent))
+    return label->getSubStmt() == stmt;
+  else if (auto* sc = llvm::dyn_cast<SwitchCase>(parent))
+    return sc->getSubStmt() == stmt;
+  else if (auto* ifStmt = llvm::dyn_cast<IfStmt>(parent))
+    return ifStmt->getThen() == stmt or ifStmt->getElse() == stmt;
+  else if (auto* forStmt = llvm::dyn_cast<ForStmt>(parent))
+    return forStmt->getBody() == stmt;
+  else if (auto* whileStmt = llvm::dyn_cast<WhileStmt>(parent))
+    return whileStmt->getBody() == stmt;
+  else if (auto* doStmt = llvm::dyn_cast<DoStmt>(parent))
+    return doStmt->getBody() == stmt;
+  else if (auto* rangeStmt = llvm::dyn_cast<CXXForRangeStmt>(parent))
+    return rangeStmt->getBody() == stmt;
+  return false;
+}
+
+Stmt* Visitor::getHitCall(StringRef desc, SourceLocation loc) {
+  FunctionDecl* fn = this->getSentinel("__hitLine", loc);
+
+  return this->getCall(fn, this->getDescriptorArg(desc, loc), loc);
+}
+
+void Visitor::hitLine(Stmt* stmt, Stmt* parent, DrLine* dr) {
   ASTContext& ast = this->astContext;
   SourceLocation beg = stmt->getBeginLoc();
   SourceLocation end = stmt->getEndLoc();
-  Stmt* parent = this->getParent(stmt);
 
-  // FIXME: Should check which language this is and use a different
-  // DeclContext. C++ should use ExternCContext while C can just use
-  // TranslationUnitDecl. Since this is just an example, it doesn't really
-  // matter, but in an actual application, this will probably be a library
-  // call (even if only to a sentinel) that needs to be caught in the LLVM-IR.
-  // If the correct context is not used, then the name will probably get
-  // mangled which is undesirable.
-  DeclContext* declContext = this->astContext.getTranslationUnitDecl();
+  // Wrapping a declaration in a compound statement would end the scope of
+  // whatever it declares.
+  if (llvm::isa<DeclStmt>(stmt)) {
+    DiagnosticsEngine& diags = this->ci.getDiagnostics();
+    const auto id = diags.getCustomDiagID(
+        DiagnosticsEngine::Warning,
+        "A line directive cannot be attached to a declaration.");
+    diags.Report(dr->getLoc(), id);
+    return;
+  }
+
+  if (not this->hasSentinels({"__hitLine"}, beg))
+    return;
+
+  std::string desc = this->getDescriptor(stmt, dr);
+  Stmt* call = this->getHitCall(desc, beg);
+
+  for (auto it = parent->child_begin(); it != parent->child_end(); it++) {
+    if (*it == stmt) {
+      *it = CompoundStmt::Create(ast, {call, stmt}, beg, end);
+      this->wrappers[stmt] = *it;
+      break;
+    }
+  }
+}
+
+void Visitor::demarcate(Stmt* stmt, Directive* dr) {
+  ASTContext& ast = this->astContext;
+  SourceLocation beg = stmt->getBeginLoc();
+  SourceLocation end = stmt->getEndLoc();
+  Stmt* parent = this->getParent(stmt);
+  if (not this->hasSentinels(
+          {"__enterLoop", "__exitLoop", "__enterLoopScope", "__exitLoopScope"},
+          beg))
+    return;
+
+  std::string desc = this->getDescriptor(stmt, dr);
+  const std::string& cond = this->getCond(dr);
+  VarDecl* var = nullptr;
+  if (not cond.empty()) {
+    var = this->getCondVar(stmt, parent, cond);
+    if (not var) {
+      DiagnosticsEngine& diags = this->ci.getDiagnostics();
+      const auto id = diags.getCustomDiagID(
+          DiagnosticsEngine::Error,
+          "The if clause can only be used on a loop or region that is "
+          "directly in a block.");
+      diags.Report(dr->getLoc(), id);
+      return;
+    }
+  }
 
-  Stmt* enterCall = this->getEnterCall(declContext, beg);
-  Stmt* exitCall = this->getExitCall(declContext, end);
+  // The statement is wrapped in a block that starts with a scope guard, so
+  // that it is exited on every path out of it, but there is still only one
+  // call on the normal path. If control could jump into the statement, the
+  // guard could be bypassed, so it is exited after the statement instead and
+  // the other ways out of it are missed.
+  Stmt* demarcated = nullptr;
+  if (this->function and not Visitor::hasJumpTargets(stmt)) {
+    Stmt* guard = this->getScopeGuard(this->function,
+                                      "__enterLoopScope",
+                                      "__exitLoopScope",
+                                      desc,
+                                      var,
+                                      beg);
+    demarcated = CompoundStmt::Create(ast, {guard, stmt}, beg, end);
+  } else {
+    Stmt* enterCall = this->getEnterCall(desc, beg);
+    Stmt* exitCall = this->getExitCall(desc, end);
+    if (var) {
+      enterCall = this->getGuard(var, enterCall, beg);
+      exitCall = this->getGuard(var, exitCall, end);
+    }
+    demarcated
+        = CompoundStmt::Create(ast, {enterCall, stmt, exitCall}, beg, end);
+  }
 
   for (auto it = parent->child_begin(); it != parent->child_end(); it++) {
     if (*it == stmt) {
-      *it = CompoundStmt::Create(ast, {enterCall, stmt, exitCall}, beg, end);
+      *it = demarcated;
       break;
     }
   }
 }
 
 void Visitor::maybeDemarcate(Stmt* stmt, Directive::Kind kind) {
-  if (this->shouldDemarcate(stmt, kind))
-    this->demarcate(stmt);
+  Directive* dr = this->getDirective(stmt, kind);
+  if (not dr)
+    return;
+
+  // The directive may have been put between an OpenMP directive and its
+  // loop. Only the outermost loop of a worksharing or simd directive can be
+  // instrumented.
+  auto it = this->ompLoops.find(stmt);
+  if (it == this->ompLoops.end()) {
+    this->demarcate(stmt, dr);
+  } else if (llvm::isa<OMPLoopDirective>(it->second)
+             and Visitor::getAssociatedLoop(it->second) == stmt) {
+    this->demarcate(it->second, dr);
+  } else {
+    DiagnosticsEngine& diags = this->ci.getDiagnostics();
+    const auto id = diags.getCustomDiagID(
+        DiagnosticsEngine::Error,
+        "A loop that is collapsed or transformed by an OpenMP directive "
+        "cannot be instrumented.");
+    diags.Report(dr->getLoc(), id);
+  }
 }
 
 // TODO: Should try to see what happens if a pragma is put inside a
@@ -160,6 +726,50 @@ bool Visitor::shouldVisitTemplateInstantiations() const {
   return true;
 }
 
+bool Visitor::TraverseDecl(Decl* decl) {
+  // The enclosing function is added to the descriptor. Functions can be
+  // nested in local classes, so the outer one must be restored afterwards.
+  FunctionDecl* outer = this->function;
+  if (auto* fn = llvm::dyn_cast_or_null<FunctionDecl>(decl))
+    this->function = fn;
+  bool ret = RecursiveASTVisitor<Visitor>::TraverseDecl(decl);
+  this->function = outer;
+
+  return ret;
+}
+
+bool Visitor::TraverseLambdaExpr(LambdaExpr* expr, DataRecursionQueue*) {
+  // The loops in the body of a lambda are in its call operator. The body is
+  // traversed now rather than queued so that the call operator is still the
+  // enclosing function when it is.
+  FunctionDecl* outer = this->function;
+  this->function = expr->getCallOperator();
+  bool ret = RecursiveASTVisitor<Visitor>::TraverseLambdaExpr(expr, nullptr);
+  this->function = outer;
+
+  return ret;
+}
+
+bool Visitor::VisitStmt(Stmt* stmt) {
+  // This is called for every statement before the more specific methods, so
+  // a line directive is popped before a loop or region directive that
+  // follows it is.
+  FullSourceLoc loc(stmt->getBeginLoc(), this->srcMgr);
+  auto* dr = llvm::dyn_cast_or_null<DrLine>(
+      this->instrContext.peekDirective(loc));
+  if (not dr)
+    return true;
+
+  Stmt* parent = this->getParent(stmt);
+  if (not this->isFullStmt(stmt, parent))
+    return true;
+
+  this->instrContext.popDirective(loc);
+  this->hitLine(stmt, parent, dr);
+
+  return true;
+}
+
 bool Visitor::VisitCompoundStmt(CompoundStmt* stmt) {
   this->maybeDemarcate(stmt, Directive::Region);
 
@@ -184,7 +794,55 @@ bool Visitor::VisitWhileStmt(WhileStmt* stmt) {
   return true;
 }
 
+bool Visitor::VisitCXXForRangeStmt(CXXForRangeStmt* stmt) {
+  this->maybeDemarcate(stmt, Directive::Loop);
+
+  return true;
+}
+
+bool Visitor::VisitOMPLoopBasedDirective(OMPLoopBasedDirective* dir) {
+  // This is called before the loops themselves are visited. With a collapse
+  // clause, there may be several nested loops associated with the directive.
+  OMPLoopBasedDirective::doForAllLoops(Visitor::getAssociatedLoop(dir),
+                                       true,
+                                       dir->getLoopsNumber(),
+                                       [this, dir](unsigned, Stmt* loop) {
+                                         this->ompLoops[loop] = dir;
+                                         return false;
+                                       });
+
+  // The directives that only transform the loops, such as tile, are always
+  // associated with another directive or loop.
+  if (llvm::isa<OMPLoopDirective>(dir))
+    this->maybeDemarcate(dir, Directive::Loop);
+
+  return true;
+}
+
 bool Visitor::VisitFunctionDecl(FunctionDecl* decl) {
+  if (not decl->doesThisDeclarationHaveABody())
+    return true;
+
+  // An instantiation has the same location as its template, whose directive
+  // will already have been popped.
+  if (FunctionDecl* pattern = decl->getTemplateInstantiationPattern()) {
+    auto it = this->templates.find(pattern);
+    if (it != this->templates.end())
+      this->instrument(decl, it->second);
+    return true;
+  }
+
+  FullSourceLoc loc(decl->getBeginLoc(), this->srcMgr);
+  auto* dr = llvm::dyn_cast_or_null<DrFunction>(
+      this->instrContext.findNearestDirectiveAndPop(loc));
+  if (not dr)
+    return true;
+
+  if (decl->isDependentContext())
+    this->templates[decl] = dr;
+  else
+    this->instrument(decl, dr);
+
   return true;
 }
 
@@ -22,6 +22,11 @@
 #include <clang/AST/ParentMapContext.h>
 #include <clang/AST/RecursiveASTVisitor.h>
 
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <vector>
+
 namespace clang {
 class ASTContext;
 class CompilerInstance;
@@ -40,33 +45,162 @@ private:
   InstrContext& instrContext;
   clang::ParentMapContext parentMap;
 
+  // The function whose body is currently being traversed.
+  clang::FunctionDecl* function;
+
+  // The function directives that were associated with function templates.
+  // The template itself is never instrumented, so the directive is applied
+  // to each instantiation instead. This is keyed by the pattern from which
+  // the instantiations are created.
+  std::map<clang::FunctionDecl*, DrFunction*> templates;
+
+  // The parent map is computed once and does not know about the statements
+  // that are added to the AST. When a statement is wrapped in a new compound
+  // statement, the wrapper is recorded here so that it can be found if the
+  // statement itself is demarcated later.
+  std::map<clang::Stmt*, clang::Stmt*> wrappers;
+
+  // The sentinels that have been looked up. This is null if the sentinel is
+  // not declared.
+  std::map<std::string, clang::FunctionDecl*> sentinels;
+
+  // The loops that are associated with an OpenMP loop directive, mapped to
+  // the directive. These are outlined or transformed by the OpenMP code
+  // generator, which expects them to be exactly as they were written, so the
+  // directive is demarcated instead of the loop.
+  std::map<clang::Stmt*, clang::OMPLoopBasedDirective*> ompLoops;
+
 private:
   void raiseMultipleParentsError(clang::Stmt* stmt);
-  bool shouldDemarcate(clang::Stmt* stmt, Directive::Kind kind);
+  Directive* getDirective(clang::Stmt* stmt, Directive::Kind kind);
   void maybeDemarcate(clang::Stmt* stmt, Directive::Kind kind);
-  void demarcate(clang::Stmt* stmt);
+  void demarcate(clang::Stmt* stmt, Directive* dr);
   clang::Stmt* getParent(clang::Stmt* stmt);
 
-  clang::Stmt* getCall(clang::FunctionDecl* fn, clang::SourceLocation loc);
+  clang::Stmt* getCall(clang::FunctionDecl* fn,
+                       llvm::ArrayRef<clang::Expr*> args,
+                       clang::SourceLocation loc);
   clang::DeclRefExpr* getDeclRefExpr(clang::FunctionDecl* fn);
-  clang::FunctionDecl* getDecl(clang::DeclContext* declContext,
-                               clang::SourceLocation loc,
-                               clang::IdentifierInfo& ident);
-  clang::Stmt* getEnterCall(clang::DeclContext* declContext,
-                            clang::SourceLocation loc);
-  clang::Stmt* getExitCall(clang::DeclContext* declContext,
+
+  // Look up the declaration of a sentinel. The sentinels are declared in the
+  // runtime's header, which the plugin includes before the main file (see
+  // Consumer), so each one is declared once in the translation unit with the
+  // linkage that the runtime expects. An error is reported the first time
+  // that a sentinel that is not declared is looked up and nullptr is
+  // returned.
+  clang::FunctionDecl* getSentinel(clang::StringRef name,
+                                   clang::SourceLocation loc);
+
+  // Check that all the sentinels are declared. This should be called before
+  // anything is instrumented so that the AST is never left half-modified.
+  bool hasSentinels(std::initializer_list<clang::StringRef> names,
+                    clang::SourceLocation loc);
+
+  // The sentinels take a descriptor that the runtime uses to identify the
+  // instrumented statement. It is of the form
+  // <file>:<line>:<column>|<function>|<name>|<counters>||<options> where the
+  // name and counters are those given in the name and counters clauses of the
+  // directive, if any. The options are the other clauses that the runtime
+  // needs to know about, such as alloc, time, sample and budget. An OpenMP
+  // loop directive has the location of its outermost loop and the omp
+  // option.
+  clang::QualType getDescriptorType();
+  std::string getDescriptor(clang::Stmt* stmt, Directive* dr);
+  static clang::Stmt* getAssociatedLoop(clang::OMPLoopBasedDirective* dir);
+
+  // The descriptor of a function whose arguments are logged is of the form
+  // <file>:<line>:<column>|<function>||||args=<name>:<tag><size>;... with one
+  // entry for each argument that is logged. The tag is derived from the type
+  // of the argument and is what the loop-args tool uses to format it. See
+  // ArgLogFile.h in the runtime.
+  std::string getDescriptor(clang::FunctionDecl* fn,
+                            DrFunction* dr,
+                            const std::vector<clang::ParmVarDecl*>& params);
+  std::string getFunctionName(clang::FunctionDecl* fn, Style style);
+
+  // The descriptor of an instrumented function that is passed to the
+  // sentinels that time it. This is of the form
+  // <file>:<line>:<column>|<function>||||function[,alloc] and is kept in the
+  // same table as the loops and regions.
+  std::string getDescriptor(clang::FunctionDecl* fn, DrFunction* dr);
+  clang::Expr* getDescriptorArg(clang::StringRef desc,
+                                clang::SourceLocation loc);
+
+  clang::Stmt* getEnterCall(clang::StringRef desc, clang::SourceLocation loc);
+  clang::Stmt* getExitCall(clang::StringRef desc,
                            clang::SourceLocation loc);
 
+  // A loop or region with an if clause is preceded by the declaration of the
+  // variable that holds the value of the condition (see ClIf). Its sentinels
+  // are only called if the variable is non-zero.
+  const std::string& getCond(Directive* dr);
+  clang::VarDecl* getCondVar(clang::Stmt* stmt,
+                             clang::Stmt* parent,
+                             const std::string& name);
+  clang::Expr* getCondExpr(clang::VarDecl* var, clang::SourceLocation loc);
+  clang::Stmt* getGuard(clang::VarDecl* var,
+                        clang::Stmt* call,
+                        clang::SourceLocation loc);
+
+  // Check if control could jump into the statement from outside it. A scope
+  // guard in front of such a statement could be bypassed, so it is demarcated
+  // with calls before and after it instead.
+  static bool hasJumpTargets(const clang::Stmt* stmt, bool inSwitch = false);
+
+  // The arguments of a function are logged by passing the address of each
+  // one to __logArgs() at the start of the body. Only the raw bytes are
+  // copied, so this is cheap enough to do even for hot functions.
+  std::vector<clang::ParmVarDecl*> getLoggedParams(clang::FunctionDecl* fn,
+                                                   DrFunction* dr);
+  clang::Expr* getArgAddr(clang::ParmVarDecl* param, clang::SourceLocation loc);
+  clang::Stmt* getLogArgsCall(clang::StringRef desc,
+                              const std::vector<clang::ParmVarDecl*>& params,
+                              clang::SourceLocation loc);
+
+  // The entries and exits of a function, loop or region are recorded by
+  // declaring
+  //
+  //     const char* __instr_scope __attribute__((cleanup(<exit>)))
+  //         = <enter>(<descriptor>);
+  //
+  // at the start of the function body or in a block that wraps the loop or
+  // region. The cleanup is run however control leaves the scope, whether by
+  // falling off the end, a break, return or goto or, in C++, an exception, so
+  // every exit is recorded. This is the same in C and C++. If there is a
+  // condition, the variable is initialized to null when it is false and the
+  // exit sentinel ignores it.
+  clang::Stmt* getScopeGuard(clang::FunctionDecl* fn,
+                             clang::StringRef enter,
+                             clang::StringRef exit,
+                             clang::StringRef desc,
+                             clang::VarDecl* cond,
+                             clang::SourceLocation loc);
+  void instrument(clang::FunctionDecl* fn, DrFunction* dr);
+
+  // A line directive is attached to the statement that follows it. The
+  // statement must be one that can be replaced by a compound statement, i.e.
+  // one in a block or the body of a control statement, so that the call to
+  // __hitLine() can be placed before it.
+  bool isFullStmt(clang::Stmt* stmt, clang::Stmt* parent);
+  clang::Stmt* getHitCall(clang::StringRef desc, clang::SourceLocation loc);
+  void hitLine(clang::Stmt* stmt, clang::Stmt* parent, DrLine* dr);
+
 public:
   explicit Visitor(clang::CompilerInstance& compiler,
                    InstrContext& instrContext);
   virtual ~Visitor() = default;
 
   bool shouldVisitTemplateInstantiations() const;
+  bool TraverseDecl(clang::Decl* decl);
+  bool TraverseLambdaExpr(clang::LambdaExpr* expr,
+                          DataRecursionQueue* queue = nullptr);
+  bool VisitStmt(clang::Stmt* stmt);
   bool VisitCompoundStmt(clang::CompoundStmt* stmt);
   bool VisitForStmt(clang::ForStmt* stmt);
   bool VisitDoStmt(clang::DoStmt* stmt);
   bool VisitWhileStmt(clang::WhileStmt* stmt);
+  bool VisitCXXForRangeStmt(clang::CXXForRangeStmt* stmt);
+  bool VisitOMPLoopBasedDirective(clang::OMPLoopBasedDirective* dir);
   bool VisitFunctionDecl(clang::FunctionDecl* decl);
 };
 
@@ -0,0 +1,30 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#pragma instrument function alloc
+std::string join(const std::vector<std::string>& words) {
+  std::string joined;
+  for (const std::string& word : words)
+    joined += word;
+  return joined;
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> words;
+  std::size_t length = 0;
+
+#pragma instrument loop name("build") alloc
+  for (int i = 0; i < 1000; i++)
+    words.push_back(std::to_string(i * 1000003));
+
+#pragma instrument region name("scan") alloc
+  {
+    for (const std::string& word : words)
+      length += std::string(word).size();
+  }
+
+  std::cout << length << " " << join(words).size() << "\n";
+
+  return 0;
+}
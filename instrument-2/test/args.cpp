@@ -0,0 +1,36 @@
+#include <iostream>
+
+struct Point {
+  double x;
+  double y;
+};
+
+#pragma instrument function args(n, scale)
+double sum(const double* a, int n, double scale) {
+  double s = 0;
+  for (int i = 0; i < n; i++)
+    s += a[i];
+  return s * scale;
+}
+
+#pragma instrument function style(full)
+template <typename T>
+T dot(const T& lhs, const T& rhs, char tag) {
+  return lhs * rhs;
+}
+
+#pragma instrument function style(decl)
+double norm(Point p, bool squared) {
+  double n = p.x * p.x + p.y * p.y;
+  return squared ? n : n / 2;
+}
+
+int main(int argc, char* argv[]) {
+  double a[4] = {1, 2, 3, 4};
+
+  std::cout << sum(a, 4, 0.5) << "\n";
+  std::cout << dot(3, 4, 'i') << " " << dot(1.5f, 2.0f, 'f') << "\n";
+  std::cout << norm({3, 4}, true) << "\n";
+
+  return 0;
+}
@@ -0,0 +1,23 @@
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char* argv[]) {
+  const unsigned n = 1 << 20;
+  double* a = new double[n];
+  double sum = 0;
+
+#pragma instrument loop name("init") counters(cycles, instructions, page-faults)
+  for (unsigned i = 0; i < n; i++)
+    a[i] = i;
+
+#pragma instrument region name("gather") counters(cache-references, cache-misses)
+  {
+    for (unsigned i = 0; i < n; i++)
+      sum += a[std::rand() % n];
+  }
+
+  std::cout << sum << "\n";
+  delete[] a;
+
+  return 0;
+}
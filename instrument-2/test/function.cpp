@@ -0,0 +1,42 @@
+#include <iostream>
+#include <stdexcept>
+
+#pragma instrument function args()
+int parse(int n) {
+  if (n < 0)
+    return -1;
+  if (n % 7 == 0)
+    throw std::invalid_argument("multiple of seven");
+
+  int digits = 0;
+  do {
+    digits++;
+    n /= 10;
+  } while (n);
+  return digits;
+}
+
+#pragma instrument function style(full) args()
+template <typename T>
+T clamp(T v, T lo, T hi) {
+  if (v < lo)
+    return lo;
+  if (v > hi)
+    return hi;
+  return v;
+}
+
+int main(int argc, char* argv[]) {
+  int total = 0;
+  for (int i = -10; i < 100; i++) {
+    try {
+      total += parse(i);
+    } catch (const std::invalid_argument&) {
+      total--;
+    }
+  }
+
+  std::cout << clamp(total, 0, 100) << " " << clamp(2.5, 0.0, 1.0) << "\n";
+
+  return 0;
+}
@@ -0,0 +1,37 @@
+#include <iostream>
+#include <vector>
+
+#define THRESHOLD 1024
+
+double sum(const std::vector<double>& v) {
+  double s = 0;
+
+#pragma instrument loop name("sum") if(v.size() > THRESHOLD)
+  for (std::size_t i = 0; i < v.size(); i++)
+    s += v[i];
+
+  return s;
+}
+
+void scale(std::vector<double>& v, double by) {
+  std::size_t n = v.size();
+
+#pragma instrument region if(n >= 4096 && by != 1.0)
+  {
+    for (std::size_t i = 0; i < n; i++)
+      v[i] *= by;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  double total = 0;
+  for (int n = 1; n <= 100000; n *= 10) {
+    std::vector<double> v(n, 1.0);
+    scale(v, 2.0);
+    total += sum(v);
+  }
+
+  std::cout << total << "\n";
+
+  return 0;
+}
@@ -0,0 +1,31 @@
+#include <iostream>
+
+int classify(int n) {
+  int evens = 0;
+  for (int i = 0; i < n; i++) {
+    if (i % 2 == 0)
+#pragma instrument line name("even")
+      evens++;
+    else
+#pragma instrument line
+      continue;
+
+    switch (i % 3) {
+    case 0:
+#pragma instrument line name("multiple of three") time
+      evens += 0;
+      break;
+    default:
+      break;
+    }
+  }
+
+#pragma instrument line time
+  return evens;
+}
+
+int main(int argc, char* argv[]) {
+  std::cout << classify(argc * 100) << "\n";
+
+  return 0;
+}
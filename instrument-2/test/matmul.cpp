@@ -13,7 +13,7 @@ void init(T a[3][3], T b[3][3], T c[3][3]) {
   }
 }
 
-#pragma instrument function mode(full) args()
+#pragma instrument function style(full) args()
 template <typename T>
 void matmul(const T a[3][3], const T b[3][3], T c[3][3]) {
   for (unsigned i = 0; i < 3; i++)
@@ -0,0 +1,21 @@
+#include <iostream>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+  std::vector<double> v(1 << 20, 1.0);
+  double sum = 0;
+
+#pragma instrument loop name("scale")
+#pragma omp parallel for
+  for (std::size_t i = 0; i < v.size(); i++)
+    v[i] *= argc;
+
+#pragma instrument loop name("sum")
+#pragma omp parallel for reduction(+ : sum)
+  for (std::size_t i = 0; i < v.size(); i++)
+    sum += v[i];
+
+  std::cout << sum << "\n";
+
+  return 0;
+}
@@ -0,0 +1,22 @@
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+  std::vector<double> v(argc * 1000, 1.0);
+  double sum = 0;
+
+#pragma instrument loop name("sum")
+  for (double x : v)
+    sum += x;
+
+  std::for_each(v.begin(), v.end(), [](double& x) {
+#pragma instrument loop name("halve")
+    for (int i = 0; i < 4; i++)
+      x /= 2;
+  });
+
+  std::cout << sum << " " << v[0] << "\n";
+
+  return 0;
+}
@@ -0,0 +1,28 @@
+#include <cmath>
+#include <iostream>
+
+double step(double x) {
+  double y = 0;
+#pragma instrument loop name("inner") sample(100)
+  for (int i = 0; i < 16; i++)
+    y += std::sin(x + i);
+  return y;
+}
+
+int main(int argc, char* argv[]) {
+  double sum = 0;
+
+#pragma instrument region name("hot") budget(20000)
+  {
+    for (int i = 0; i < 100000; i++)
+      sum += step(i * 0.001);
+  }
+
+#pragma instrument loop sample(10) budget(5000)
+  for (int i = 0; i < 1000; i++)
+    sum += step(sum);
+
+  std::cout << sum << "\n";
+
+  return 0;
+}
@@ -0,0 +1,308 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Cost.h"
+
+#include <clang/AST/ASTContext.h>
+
+#include <llvm/Support/raw_ostream.h>
+
+using namespace clang;
+
+// Get the integer value of the expression if it is a constant.
+static bool getConstant(ASTContext& ast, const Expr* expr, llvm::APSInt& val) {
+  Expr::EvalResult result;
+  if (expr->isValueDependent()
+      or not expr->EvaluateAsInt(result, ast, Expr::SE_NoSideEffects))
+    return false;
+  val = result.Val.getInt();
+  return true;
+}
+
+// Get the variable if the expression is a reference to one.
+static const VarDecl* getVar(const Expr* expr) {
+  if (const auto* ref = dyn_cast<DeclRefExpr>(expr->IgnoreParenImpCasts()))
+    return dyn_cast<VarDecl>(ref->getDecl());
+  return nullptr;
+}
+
+// Get the trip count of a for loop of the form
+//
+//     for (i = <start>; i <op> <end>; <step>)
+//
+// where start and end are constants, op is one of <, <=, >, >= or != and step
+// is one of ++i, i++, --i, i--, i += <constant> or i -= <constant>. Returns 0
+// if the loop does not have this form. The body is assumed not to write to the
+// loop variable.
+static uint64_t getTrips(ASTContext& ast, ForStmt* stmt) {
+  const VarDecl* var = nullptr;
+  const Expr* startExpr = nullptr;
+  if (const auto* decl = dyn_cast_or_null<DeclStmt>(stmt->getInit())) {
+    if (decl->isSingleDecl())
+      if ((var = dyn_cast<VarDecl>(decl->getSingleDecl())))
+        startExpr = var->getInit();
+  } else if (const auto* init = dyn_cast_or_null<BinaryOperator>(
+                 stmt->getInit())) {
+    if (init->getOpcode() == BO_Assign) {
+      var = getVar(init->getLHS());
+      startExpr = init->getRHS();
+    }
+  }
+
+  llvm::APSInt start, end, step;
+  if (not var or not startExpr or not getConstant(ast, startExpr, start))
+    return 0;
+
+  const Expr* inc = stmt->getInc();
+  if (not inc)
+    return 0;
+  inc = inc->IgnoreParens();
+  if (const auto* op = dyn_cast<UnaryOperator>(inc)) {
+    if (not op->isIncrementDecrementOp() or getVar(op->getSubExpr()) != var)
+      return 0;
+    step = llvm::APSInt::get(op->isIncrementOp() ? 1 : -1);
+  } else if (const auto* op = dyn_cast<CompoundAssignOperator>(inc)) {
+    if ((op->getOpcode() != BO_AddAssign and op->getOpcode() != BO_SubAssign)
+        or getVar(op->getLHS()) != var
+        or not getConstant(ast, op->getRHS(), step))
+      return 0;
+    if (op->getOpcode() == BO_SubAssign)
+      step = -step;
+  } else {
+    return 0;
+  }
+
+  const Expr* condExpr = stmt->getCond();
+  const auto* cond
+      = condExpr ? dyn_cast<BinaryOperator>(condExpr->IgnoreParens()) : nullptr;
+  if (not cond or getVar(cond->getLHS()) != var
+      or not getConstant(ast, cond->getRHS(), end))
+    return 0;
+
+  // Give up on loops whose bounds are so far apart that the distance between
+  // them does not fit in 64 bits. Nobody will wait for those to finish anyway.
+  int64_t s = start.getExtValue();
+  int64_t e = end.getExtValue();
+  int64_t d = step.getExtValue();
+  int64_t distance = 0;
+  bool overflow = false;
+  switch (cond->getOpcode()) {
+  case BO_LT:
+  case BO_LE:
+    if (d <= 0)
+      return 0;
+    overflow = __builtin_sub_overflow(e, s, &distance);
+    if (cond->getOpcode() == BO_LE)
+      overflow = overflow or __builtin_add_overflow(distance, 1, &distance);
+    break;
+  case BO_GT:
+  case BO_GE:
+    if (d >= 0)
+      return 0;
+    overflow = __builtin_sub_overflow(s, e, &distance);
+    if (cond->getOpcode() == BO_GE)
+      overflow = overflow or __builtin_add_overflow(distance, 1, &distance);
+    d = -d;
+    break;
+  case BO_NE:
+    // The loop only terminates if the step divides the distance exactly.
+    if (d == 0 or __builtin_sub_overflow(e, s, &distance)
+        or distance % d != 0 or distance / d < 0)
+      return 0;
+    return distance / d;
+  default:
+    return 0;
+  }
+  if (overflow or distance <= 0)
+    return 0;
+
+  return distance / d + (distance % d ? 1 : 0);
+}
+
+// The trip count of a range-based for loop is only known if the range is an
+// array.
+static uint64_t getTrips(ASTContext& ast, CXXForRangeStmt* stmt) {
+  // The type may be sugared, for instance by a typedef of the array type.
+  QualType type = stmt->getRangeInit()->getType();
+  if (const ConstantArrayType* array = ast.getAsConstantArrayType(type))
+    return array->getSize().getZExtValue();
+  return 0;
+}
+
+Cost Cost::get(ASTContext& astContext, Stmt* loop) {
+  CostVisitor visitor(astContext);
+
+  // The initialization of a for loop is only executed once, so it is not
+  // part of the cost of an iteration.
+  if (auto* stmt = dyn_cast<ForStmt>(loop)) {
+    visitor.TraverseStmt(stmt->getCond());
+    visitor.TraverseStmt(stmt->getInc());
+    visitor.TraverseStmt(stmt->getBody());
+  } else if (auto* stmt = dyn_cast<WhileStmt>(loop)) {
+    visitor.TraverseStmt(stmt->getCond());
+    visitor.TraverseStmt(stmt->getBody());
+  } else if (auto* stmt = dyn_cast<DoStmt>(loop)) {
+    visitor.TraverseStmt(stmt->getCond());
+    visitor.TraverseStmt(stmt->getBody());
+  } else if (auto* stmt = dyn_cast<CXXForRangeStmt>(loop)) {
+    // The comparison and increment of the iterators are implicit calls that
+    // are not counted.
+    visitor.TraverseStmt(stmt->getBody());
+  }
+
+  Cost cost = visitor.getCost();
+  if (auto* stmt = dyn_cast<ForStmt>(loop))
+    cost.trips = getTrips(astContext, stmt);
+  else if (auto* stmt = dyn_cast<CXXForRangeStmt>(loop))
+    cost.trips = getTrips(astContext, stmt);
+  else if (not isa<WhileStmt>(loop) and not isa<DoStmt>(loop))
+    cost.known = false;
+
+  return cost;
+}
+
+std::string Cost::str() const {
+  std::string s;
+  llvm::raw_string_ostream ss(s);
+
+  ss << "flops=" << this->flops << ",loads=" << this->loads
+     << ",stores=" << this->stores;
+  if (this->trips)
+    ss << ",trips=" << this->trips;
+
+  return ss.str();
+}
+
+CostVisitor::CostVisitor(ASTContext& astContext)
+    : astContext(astContext), cost({true, 0, 0, 0, 0}) {
+  ;
+}
+
+const Cost& CostVisitor::getCost() const {
+  return this->cost;
+}
+
+// The body of a lambda is not executed where the lambda is defined.
+bool CostVisitor::shouldVisitLambdaBody() const {
+  return false;
+}
+
+bool CostVisitor::isArrayAccess(Expr* expr) {
+  // A subscript of a multi-dimensional array that results in another array
+  // does not access memory by itself. It is the innermost one that does.
+  auto* subscript = dyn_cast<ArraySubscriptExpr>(expr->IgnoreParens());
+  return subscript and not subscript->getType()->isArrayType();
+}
+
+uint64_t CostVisitor::getSize(Expr* expr) {
+  QualType type = expr->getType();
+  if (type->isDependentType() or type->isIncompleteType()) {
+    this->cost.known = false;
+    return 0;
+  }
+  return this->astContext.getTypeSizeInChars(type).getQuantity();
+}
+
+bool CostVisitor::addNested(Stmt* loop) {
+  Cost nested = Cost::get(this->astContext, loop);
+  if (not nested.known or not nested.trips) {
+    this->cost.known = false;
+    return true;
+  }
+  this->cost.flops += nested.flops * nested.trips;
+  this->cost.loads += nested.loads * nested.trips;
+  this->cost.stores += nested.stores * nested.trips;
+
+  return true;
+}
+
+bool CostVisitor::TraverseForStmt(ForStmt* stmt) {
+  // The initialization of the nested loop is executed once per iteration of
+  // this loop.
+  this->TraverseStmt(stmt->getInit());
+  return this->addNested(stmt);
+}
+
+bool CostVisitor::TraverseDoStmt(DoStmt* stmt) {
+  return this->addNested(stmt);
+}
+
+bool CostVisitor::TraverseWhileStmt(WhileStmt* stmt) {
+  return this->addNested(stmt);
+}
+
+bool CostVisitor::TraverseCXXForRangeStmt(CXXForRangeStmt* stmt) {
+  // The range is evaluated once per iteration of this loop.
+  this->TraverseStmt(stmt->getInit());
+  this->TraverseStmt(stmt->getRangeInit());
+  return this->addNested(stmt);
+}
+
+bool CostVisitor::VisitArraySubscriptExpr(ArraySubscriptExpr* expr) {
+  // Every element that is accessed is assumed to be read. This is corrected
+  // when the element turns out to be the target of an assignment or its
+  // address is taken.
+  if (this->isArrayAccess(expr))
+    this->cost.loads += this->getSize(expr);
+
+  return true;
+}
+
+bool CostVisitor::VisitBinaryOperator(BinaryOperator* op) {
+  QualType type = op->getType();
+  if (auto* compound = dyn_cast<CompoundAssignOperator>(op))
+    type = compound->getComputationResultType();
+
+  switch (op->getOpcode()) {
+  case BO_Add:
+  case BO_Sub:
+  case BO_Mul:
+  case BO_Div:
+  case BO_AddAssign:
+  case BO_SubAssign:
+  case BO_MulAssign:
+  case BO_DivAssign:
+    if (type->isRealFloatingType())
+      this->cost.flops++;
+    break;
+  default:
+    break;
+  }
+
+  // A compound assignment reads the element as well as writing it, so only a
+  // simple assignment needs the load to be undone.
+  if (op->isAssignmentOp() and this->isArrayAccess(op->getLHS())) {
+    uint64_t size = this->getSize(op->getLHS());
+    this->cost.stores += size;
+    if (op->getOpcode() == BO_Assign)
+      this->cost.loads -= size;
+  }
+
+  return true;
+}
+
+bool CostVisitor::VisitUnaryOperator(UnaryOperator* op) {
+  if (not this->isArrayAccess(op->getSubExpr()))
+    return true;
+
+  uint64_t size = this->getSize(op->getSubExpr());
+  if (op->isIncrementDecrementOp())
+    this->cost.stores += size;
+  else if (op->getOpcode() == UO_AddrOf)
+    this->cost.loads -= size;
+
+  return true;
+}
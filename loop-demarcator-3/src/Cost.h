@@ -0,0 +1,84 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_LOOP_DEMARCATOR_COST_H
+#define CLANG_PLUGIN_EXAMPLES_LOOP_DEMARCATOR_COST_H
+
+#include <clang/AST/RecursiveASTVisitor.h>
+
+#include <cstdint>
+#include <string>
+
+// A static estimate of the work done in a single iteration of a loop. This is
+// only a rough estimate that is good enough to place the loop on a roofline.
+// The floating point operations are the additions, subtractions,
+// multiplications and divisions on real floating point values. The bytes are
+// those of the array elements that are read and written using subscripts.
+// Any other memory accesses are ignored, as is the fact that many of the
+// accesses will hit in the cache.
+//
+// Loops nested in the body are included if their trip count is known.
+// Otherwise, the cost of the enclosing loop is not known either.
+struct Cost {
+  bool known;
+  uint64_t flops;
+  uint64_t loads;
+  uint64_t stores;
+
+  // The number of iterations of the loop if it can be determined at compile
+  // time, 0 otherwise.
+  uint64_t trips;
+
+  // Estimate the cost of an iteration of the loop. The cost is only known for
+  // a ForStmt, WhileStmt, DoStmt or CXXForRangeStmt.
+  static Cost get(clang::ASTContext& astContext, clang::Stmt* loop);
+
+  // The cost as it is added to the loop's descriptor. This is of the form
+  //
+  //     flops=<flops>,loads=<bytes>,stores=<bytes>[,trips=<trips>]
+  //
+  // The trips are omitted if they are not known.
+  std::string str() const;
+};
+
+// Walks the condition, increment and body of a loop and accumulates the cost.
+class CostVisitor : public clang::RecursiveASTVisitor<CostVisitor> {
+private:
+  clang::ASTContext& astContext;
+  Cost cost;
+
+private:
+  bool isArrayAccess(clang::Expr* expr);
+  uint64_t getSize(clang::Expr* expr);
+  bool addNested(clang::Stmt* loop);
+
+public:
+  explicit CostVisitor(clang::ASTContext& astContext);
+  virtual ~CostVisitor() = default;
+
+  const Cost& getCost() const;
+
+  bool shouldVisitLambdaBody() const;
+  bool TraverseForStmt(clang::ForStmt* stmt);
+  bool TraverseDoStmt(clang::DoStmt* stmt);
+  bool TraverseWhileStmt(clang::WhileStmt* stmt);
+  bool TraverseCXXForRangeStmt(clang::CXXForRangeStmt* stmt);
+  bool VisitArraySubscriptExpr(clang::ArraySubscriptExpr* expr);
+  bool VisitBinaryOperator(clang::BinaryOperator* op);
+  bool VisitUnaryOperator(clang::UnaryOperator* op);
+};
+
+#endif // CLANG_PLUGIN_EXAMPLES_LOOP_DEMARCATOR_COST_H
@@ -17,7 +17,9 @@
 #include <clang/Frontend/CompilerInstance.h>
 #include <clang/Frontend/FrontendAction.h>
 #include <clang/Frontend/FrontendPluginRegistry.h>
+#include <clang/Lex/Preprocessor.h>
 
+#include "Config.h"
 #include "Visitor.h"
 
 using namespace clang;
@@ -30,7 +32,13 @@ private:
 
 public:
   explicit Consumer(CompilerInstance& ci) : visitor(ci) {
-    ;
+    // The sentinels are declared in the runtime's header. The predefines are
+    // only read when the main file is entered, which is after the consumer
+    // has been created, so the header is included before any of the code in
+    // the main file.
+    Preprocessor& pp = ci.getPreprocessor();
+    pp.setPredefines(pp.getPredefines() + "#include \""
+                     + CLANG_PLUGIN_EXAMPLES_RUNTIME_HEADER + "\"\n");
   }
 
   virtual ~Consumer() = default;
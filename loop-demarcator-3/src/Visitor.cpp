@@ -15,20 +15,29 @@
 */
 
 #include "Visitor.h"
+#include "Cost.h"
 
 #include <clang/AST/ParentMapContext.h>
 #include <clang/AST/Type.h>
+#include <clang/Analysis/Analyses/Dominators.h>
+#include <clang/Analysis/CFG.h>
 #include <clang/Frontend/CompilerInstance.h>
+#include <clang/Sema/Lookup.h>
+#include <clang/Sema/Sema.h>
+
+#include <llvm/Support/raw_ostream.h>
 
 #include <limits>
+#include <memory>
+#include <set>
+#include <vector>
 
 using namespace clang;
 
 Visitor::Visitor(CompilerInstance& ci)
     : ci(ci), astContext(ci.getASTContext()), srcMgr(ci.getSourceManager()),
-      lang(LangStandard::getLangStandardForKind(ci.getLangOpts().LangStd)
-               .getLanguage()),
-      enterDecl(nullptr), exitDecl(nullptr) {
+      lookedUp(false), enterDecl(nullptr), exitDecl(nullptr),
+      enterScopeDecl(nullptr), exitScopeDecl(nullptr), function(nullptr) {
   ;
 }
 
@@ -65,7 +74,7 @@ DeclRefExpr* Visitor::getDeclRefExpr(FunctionDecl* fn) {
                              ExprValueKind::VK_LValue);
 }
 
-Stmt* Visitor::getCall(FunctionDecl* fn, SourceLocation loc) {
+Stmt* Visitor::getCall(FunctionDecl* fn, Expr* arg, SourceLocation loc) {
   ASTContext& ast = this->astContext;
 
   // Simply passing the FunctionDecl wrapped in a DeclRefExpr to the CallExpr
@@ -76,64 +85,138 @@ Stmt* Visitor::getCall(FunctionDecl* fn, SourceLocation loc) {
       ast, ast.getPointerType(fn->getType()), CK_FunctionToPointerDecay,
       this->getDeclRefExpr(fn), nullptr, VK_PRValue, FPOptionsOverride());
 
-  return CallExpr::Create(ast, callee, {}, fn->getCallResultType(),
+  return CallExpr::Create(ast, callee, {arg}, fn->getCallResultType(),
                           ExprValueKind::VK_PRValue, loc, FPOptionsOverride());
 }
 
-FunctionDecl* Visitor::getDecl(SourceLocation loc, IdentifierInfo& ident) {
+QualType Visitor::getDescriptorType() {
   ASTContext& ast = this->astContext;
-  DeclarationName name(&ident);
-  QualType fty
-      = ast.getFunctionType(ast.VoidTy, {}, FunctionProtoType::ExtProtoInfo());
-
-  // Pick the right context for the decl because that will ensure that the
-  // resulting decl doesn't get mangled. Not sure what the purpose of an
-  // externCContextDecl is because it doesn't work. A LinkageSpecDecl has to
-  // be created explicitly for the function to have the correct "extern C"
-  // linkage in C++.
-  DeclContext* declContext = ast.getTranslationUnitDecl();
-  if (this->lang == Language::CXX) {
-    declContext
-        = LinkageSpecDecl::Create(ast, ast.getTranslationUnitDecl(), loc, loc,
-                                  LinkageSpecDecl::lang_c, false);
-  }
 
-  return FunctionDecl::Create(
-      ast,                   // The AST context
-      declContext,           // The context in which to create the function
-      loc,                   // Location of the function body
-      loc,                   // Location of the function name
-      name,                  // Name of the function
-      fty,                   // Function type
-      nullptr,               // Type source info
-      StorageClass::SC_None, // Storage class
-      false,                 // isInlineSpecified
-      false);                // hasWrittenPrototype
-}
-
-Stmt* Visitor::getEnterCall(SourceLocation loc) {
-  if (not this->enterDecl) {
-    ASTContext& ast = this->astContext;
-    IdentifierInfo& ident = ast.Idents.get("__enterLoop");
-
-    this->enterDecl = this->getDecl(loc, ident);
-  }
-  return this->getCall(this->enterDecl, loc);
+  return ast.getPointerType(ast.CharTy.withConst());
+}
+
+Stmt* Visitor::getAssociatedLoop(OMPLoopBasedDirective* dir) {
+  Stmt* stmt = dir->getAssociatedStmt();
+  if (isa<CapturedStmt>(stmt))
+    stmt = dir->getInnermostCapturedStmt()->getCapturedStmt();
+  return stmt;
+}
+
+std::string Visitor::getDescriptor(Stmt* stmt) {
+  auto* dir = dyn_cast<OMPLoopDirective>(stmt);
+  Stmt* loop = dir ? Visitor::getAssociatedLoop(dir) : stmt;
+  PresumedLoc ploc = this->srcMgr.getPresumedLoc(loop->getBeginLoc());
+  std::string desc;
+  llvm::raw_string_ostream ss(desc);
+
+  ss << ploc.getFilename() << ":" << ploc.getLine() << ":" << ploc.getColumn();
+  ss << "|";
+  if (this->function)
+    ss << this->function->getQualifiedNameAsString();
+
+  Cost cost = Cost::get(this->astContext, loop);
+  if (cost.known)
+    ss << "|||" << cost.str();
+  if (dir)
+    ss << (cost.known ? "" : "|||") << "|omp";
+
+  return ss.str();
+}
+
+Expr* Visitor::getDescriptorArg(StringRef desc, SourceLocation loc) {
+  ASTContext& ast = this->astContext;
+  QualType strTy = ast.getStringLiteralArrayType(ast.CharTy, desc.size());
+  Expr* lit = StringLiteral::Create(
+      ast, desc, StringLiteral::Ascii, false, strTy, loc);
+
+  // The string literal has to decay to a pointer before it can be passed to
+  // the sentinel. In C++, the literal is a const char[] so the pointer will
+  // already have the right type. In C, it is a char[] so the pointer also has
+  // to be qualified.
+  QualType ptrTy = ast.getArrayDecayedType(strTy);
+  Expr* arg = ImplicitCastExpr::Create(ast, ptrTy, CK_ArrayToPointerDecay, lit,
+                                       nullptr, VK_PRValue,
+                                       FPOptionsOverride());
+  if (ast.hasSameType(ptrTy, this->getDescriptorType()))
+    return arg;
+
+  return ImplicitCastExpr::Create(ast, this->getDescriptorType(), CK_NoOp, arg,
+                                  nullptr, VK_PRValue, FPOptionsOverride());
 }
 
-Stmt* Visitor::getExitCall(SourceLocation loc) {
-  if (not this->exitDecl) {
-    ASTContext& ast = this->astContext;
-    IdentifierInfo& ident = ast.Idents.get("__exitLoop");
+FunctionDecl* Visitor::lookupSentinel(StringRef name, SourceLocation loc) {
+  ASTContext& ast = this->astContext;
+  Sema& sema = this->ci.getSema();
+  LookupResult result(sema, DeclarationName(&ast.Idents.get(name)), loc,
+                      Sema::LookupOrdinaryName);
+  sema.LookupQualifiedName(result, ast.getTranslationUnitDecl());
+  if (FunctionDecl* fn = result.getAsSingle<FunctionDecl>())
+    return fn;
+
+  DiagnosticsEngine& diags = ci.getDiagnostics();
+  unsigned id = diags.getCustomDiagID(
+      DiagnosticsEngine::Error,
+      "Sentinel '%0' is not declared. Was the loop runtime header included?");
+  diags.Report(loc, id) << name;
+  return nullptr;
+}
 
-    this->exitDecl = this->getDecl(loc, ident);
+bool Visitor::lookupSentinels(SourceLocation loc) {
+  if (not this->lookedUp) {
+    this->lookedUp = true;
+    this->enterDecl = this->lookupSentinel("__enterLoop", loc);
+    this->exitDecl = this->lookupSentinel("__exitLoop", loc);
+    this->enterScopeDecl = this->lookupSentinel("__enterLoopScope", loc);
+    this->exitScopeDecl = this->lookupSentinel("__exitLoopScope", loc);
   }
-  return this->getCall(this->exitDecl, loc);
+  return this->enterDecl and this->exitDecl and this->enterScopeDecl
+         and this->exitScopeDecl;
 }
 
-void Visitor::demarcate(Stmt* stmt) {
-  // Don't demarcate loops that are not in the file being compiled. This will
-  // eliminate loops that are contained in any included files.
+Stmt* Visitor::getEnterCall(StringRef desc, SourceLocation loc) {
+  return this->getCall(
+      this->enterDecl, this->getDescriptorArg(desc, loc), loc);
+}
+
+Stmt* Visitor::getExitCall(StringRef desc, SourceLocation loc) {
+  return this->getCall(
+      this->exitDecl, this->getDescriptorArg(desc, loc), loc);
+}
+
+Stmt* Visitor::getScopeGuard(StringRef desc, SourceLocation loc) {
+  ASTContext& ast = this->astContext;
+  QualType descTy = this->getDescriptorType();
+
+  // The variable is local to the function that contains the loop.
+  auto* init = cast<Expr>(this->getCall(
+      this->enterScopeDecl, this->getDescriptorArg(desc, loc), loc));
+  VarDecl* var = VarDecl::Create(
+      ast, this->function, loc, loc, &ast.Idents.get("__loop"), descTy,
+      ast.getTrivialTypeSourceInfo(descTy, loc), StorageClass::SC_None);
+  var->setInit(init);
+  var->addAttr(CleanupAttr::CreateImplicit(ast, this->exitScopeDecl));
+
+  return new (ast) DeclStmt(DeclGroupRef(var), loc, loc);
+}
+
+bool Visitor::hasJumpTargets(const Stmt* stmt, bool inSwitch) {
+  if (not stmt)
+    return false;
+  else if (isa<LabelStmt>(stmt))
+    return true;
+  else if (isa<SwitchCase>(stmt) and not inSwitch)
+    return true;
+
+  // The cases of a switch that is itself in the loop can only be reached
+  // from inside the loop.
+  bool isSwitch = inSwitch or isa<SwitchStmt>(stmt);
+  for (const Stmt* child : stmt->children())
+    if (Visitor::hasJumpTargets(child, isSwitch))
+      return true;
+  return false;
+}
+
+bool Visitor::isInMainFile(Stmt* stmt) {
   SourceManager& srcMgr = this->srcMgr;
   const FileEntry* file
       = FullSourceLoc(stmt->getBeginLoc(), srcMgr).getFileEntry();
@@ -141,7 +224,15 @@ void Visitor::demarcate(Stmt* stmt) {
   // Not sure under what conditions file will be null. Probably when the
   // statement being visited is in a constructor that has been automatically
   // generated.
-  if (not file or not srcMgr.isMainFile(*file))
+  return file and srcMgr.isMainFile(*file);
+}
+
+void Visitor::demarcate(Stmt* stmt) {
+  // Don't demarcate loops that are not in the file being compiled. This will
+  // eliminate loops that are contained in any included files.
+  if (not this->isInMainFile(stmt) or this->ompLoops.count(stmt))
+    return;
+  if (not this->lookupSentinels(stmt->getBeginLoc()))
     return;
 
   ASTContext& ast = this->astContext;
@@ -166,17 +257,126 @@ void Visitor::demarcate(Stmt* stmt) {
   //
   Stmt* parent = const_cast<Stmt*>(this->getParent(stmt));
 
-  Stmt* enterCall = this->getEnterCall(beg);
-  Stmt* exitCall = this->getExitCall(end);
+  // The loop is wrapped in a compound statement that starts with the scope
+  // guard, so the loop is exited on every path out of it, including break,
+  // return, goto and exceptions, but there is still only one call on the
+  // normal path. If control could jump into the loop, the guard could be
+  // bypassed, so the loop is exited after it instead and any other way out of
+  // the loop is missed.
+  std::string desc = this->getDescriptor(stmt);
+  Stmt* demarcated = nullptr;
+  if (this->function and not Visitor::hasJumpTargets(stmt)) {
+    Stmt* guard = this->getScopeGuard(desc, beg);
+    demarcated = CompoundStmt::Create(ast, {guard, stmt}, beg, end);
+  } else {
+    Stmt* enterCall = this->getEnterCall(desc, beg);
+    Stmt* exitCall = this->getExitCall(desc, end);
+    demarcated
+        = CompoundStmt::Create(ast, {enterCall, stmt, exitCall}, beg, end);
+  }
 
   for (auto it = parent->child_begin(); it != parent->child_end(); it++) {
     if (*it == stmt) {
-      *it = CompoundStmt::Create(ast, {enterCall, stmt, exitCall}, beg, end);
+      *it = demarcated;
       break;
     }
   }
 }
 
+unsigned Visitor::countGotos(const Stmt* stmt,
+                             const LabelDecl* label,
+                             bool& addressTaken) {
+  if (not stmt)
+    return 0;
+
+  unsigned count = 0;
+  if (auto* gotoStmt = dyn_cast<GotoStmt>(stmt))
+    count += gotoStmt->getLabel() == label;
+  else if (auto* addr = dyn_cast<AddrLabelExpr>(stmt))
+    addressTaken |= addr->getLabel() == label;
+  for (const Stmt* child : stmt->children())
+    count += Visitor::countGotos(child, label, addressTaken);
+  return count;
+}
+
+void Visitor::demarcateGotoLoop(LabelStmt* label) {
+  auto* block = dyn_cast_or_null<CompoundStmt>(
+      const_cast<Stmt*>(this->getParent(label)));
+  if (not block)
+    return;
+
+  bool addressTaken = false;
+  unsigned total
+      = Visitor::countGotos(this->function->getBody(), label->getDecl(),
+                            addressTaken);
+  if (addressTaken or not total)
+    return;
+
+  // The loop ends with the first statement after which every goto to the
+  // label has been seen. The statements are moved into a new block, so none
+  // of them may be a declaration that could be used after the loop, and
+  // control may not jump into any of them other than at the label.
+  Stmt** body = block->body_begin();
+  unsigned first = 0;
+  while (first < block->size() and body[first] != label)
+    first++;
+
+  unsigned seen = 0;
+  unsigned last = first;
+  for (; last < block->size(); last++) {
+    Stmt* stmt = last == first ? label->getSubStmt() : body[last];
+    if (isa<DeclStmt>(stmt) or Visitor::hasJumpTargets(stmt))
+      return;
+    seen += Visitor::countGotos(stmt, label->getDecl(), addressTaken);
+    if (seen == total)
+      break;
+  }
+  if (seen != total or not this->lookupSentinels(label->getBeginLoc()))
+    return;
+
+  ASTContext& ast = this->astContext;
+  SourceLocation beg = label->getBeginLoc();
+  SourceLocation end = body[last]->getEndLoc();
+  std::string desc = this->getDescriptor(label);
+  std::vector<Stmt*> stmts = {this->getScopeGuard(desc, beg)};
+  for (unsigned i = first; i <= last; i++) {
+    stmts.push_back(body[i]);
+    body[i] = new (ast) NullStmt(body[i]->getBeginLoc());
+  }
+  body[first] = CompoundStmt::Create(ast, stmts, beg, end);
+}
+
+void Visitor::demarcateGotoLoops(FunctionDecl* fn) {
+  // The CFG cannot be built for a template that has not been instantiated.
+  Stmt* body = fn->getBody();
+  if (not body or fn->isDependentContext() or not this->isInMainFile(body))
+    return;
+
+  std::unique_ptr<CFG> cfg = CFG::buildCFG(
+      fn, body, &this->astContext, CFG::BuildOptions());
+  if (not cfg)
+    return;
+
+  CFGDomTree dom(cfg.get());
+  std::set<LabelStmt*> seen;
+  std::vector<LabelStmt*> labels;
+  for (CFGBlock* src : *cfg) {
+    auto* gotoStmt = dyn_cast_or_null<GotoStmt>(src->getTerminatorStmt());
+    if (not gotoStmt)
+      continue;
+    for (const CFGBlock::AdjacentBlock& dst : src->succs())
+      if (dst and dom.dominates(dst, src))
+        if (LabelStmt* label = gotoStmt->getLabel()->getStmt())
+          if (seen.insert(label).second)
+            labels.push_back(label);
+  }
+
+  // The CFG is no longer needed once the labels have been found, so it does
+  // not matter that the AST is changed afterwards.
+  for (LabelStmt* label : labels)
+    this->demarcateGotoLoop(label);
+}
+
 // TODO: Should try to see what happens if a pragma is put inside a
 // template body which may be instantiated several times. I think the
 // idea here is to allow the visitor to traverse over those as well, but
@@ -186,6 +386,35 @@ bool Visitor::shouldVisitTemplateInstantiations() const {
   return true;
 }
 
+bool Visitor::TraverseDecl(Decl* decl) {
+  // Keep track of the enclosing function so that it can be added to the
+  // descriptor. Functions can be nested (in local classes, for instance), so
+  // the outer one has to be restored once the inner one has been traversed.
+  FunctionDecl* outer = this->function;
+  if (auto* fn = dyn_cast_or_null<FunctionDecl>(decl)) {
+    this->function = fn;
+    this->demarcateGotoLoops(fn);
+  }
+  bool ret = RecursiveASTVisitor<Visitor>::TraverseDecl(decl);
+  this->function = outer;
+
+  return ret;
+}
+
+bool Visitor::TraverseLambdaExpr(LambdaExpr* expr, DataRecursionQueue*) {
+  // The body of a lambda is traversed as part of the enclosing function, but
+  // its loops are in the call operator. The body must be traversed now
+  // rather than queued so that the call operator is still the function when
+  // it is.
+  FunctionDecl* outer = this->function;
+  this->function = expr->getCallOperator();
+  this->demarcateGotoLoops(this->function);
+  bool ret = RecursiveASTVisitor<Visitor>::TraverseLambdaExpr(expr, nullptr);
+  this->function = outer;
+
+  return ret;
+}
+
 bool Visitor::VisitForStmt(ForStmt* stmt) {
   this->demarcate(stmt);
 
@@ -203,3 +432,31 @@ bool Visitor::VisitWhileStmt(WhileStmt* stmt) {
 
   return true;
 }
+
+bool Visitor::VisitCXXForRangeStmt(CXXForRangeStmt* stmt) {
+  this->demarcate(stmt);
+
+  return true;
+}
+
+bool Visitor::VisitOMPLoopBasedDirective(OMPLoopBasedDirective* dir) {
+  // This is called before the loops themselves are visited. With a collapse
+  // clause, there may be several nested loops associated with the directive.
+  OMPLoopBasedDirective::doForAllLoops(
+      Visitor::getAssociatedLoop(dir),
+      true,
+      dir->getLoopsNumber(),
+      [this](unsigned, Stmt* loop) {
+        this->ompLoops.insert(loop);
+        return false;
+      });
+
+  // A worksharing or simd loop is demarcated in its entirety on each thread
+  // that encounters it. The directives that only transform the loops, such
+  // as tile, are left alone since they are always associated with another
+  // directive or loop.
+  if (isa<OMPLoopDirective>(dir))
+    this->demarcate(dir);
+
+  return true;
+}
@@ -19,6 +19,9 @@
 
 #include <clang/AST/RecursiveASTVisitor.h>
 
+#include <set>
+#include <string>
+
 namespace clang {
 class CompilerInstance;
 } // namespace clang
@@ -30,53 +33,128 @@ private:
   clang::CompilerInstance& ci;
   clang::ASTContext& astContext;
   clang::SourceManager& srcMgr;
-  clang::Language lang;
 
+  bool lookedUp;
   clang::FunctionDecl* enterDecl;
   clang::FunctionDecl* exitDecl;
+  clang::FunctionDecl* enterScopeDecl;
+  clang::FunctionDecl* exitScopeDecl;
+
+  // The function whose body is currently being traversed. This is only used
+  // to describe the loops and will be null outside a function.
+  clang::FunctionDecl* function;
+
+  // The loops that are associated with an OpenMP loop directive. These are
+  // outlined or transformed by the OpenMP code generator, which expects them
+  // to be exactly as they were written, so they are never demarcated
+  // themselves. The directive is demarcated instead.
+  std::set<clang::Stmt*> ompLoops;
 
 private:
   void raiseMultipleParentsError(clang::Stmt* stmt);
+  bool isInMainFile(clang::Stmt* stmt);
   void demarcate(clang::Stmt* stmt);
+
+  // Loops that are formed with a goto are found from the back edges in the
+  // control flow graph of the function. An edge is a back edge if its target
+  // dominates its source. If the source ends in a goto, the target is a label
+  // and the loop is the range of statements in the label's block from the
+  // label to the last one that contains a goto to it. It is only demarcated
+  // if every goto to the label is in that range.
+  void demarcateGotoLoops(clang::FunctionDecl* fn);
+  void demarcateGotoLoop(clang::LabelStmt* label);
+
+  // Count the gotos to the label in the statement. Set addressTaken if the
+  // address of the label is taken since it could then be the target of an
+  // indirect goto.
+  static unsigned countGotos(const clang::Stmt* stmt,
+                             const clang::LabelDecl* label,
+                             bool& addressTaken);
   const clang::Stmt* getParent(clang::Stmt* stmt);
 
-  // Create a CallExpr where the given FunctionDecl is called with no
-  // arguments. The SourceLocation should, ideally, be a reasonable location
+  // Create a CallExpr where the given FunctionDecl is called with the given
+  // argument. The SourceLocation should, ideally, be a reasonable location
   // at which the call is inserted, but it could also be an invalid location.
-  clang::Stmt* getCall(clang::FunctionDecl* fn, clang::SourceLocation loc);
+  clang::Stmt* getCall(clang::FunctionDecl* fn,
+                       clang::Expr* arg,
+                       clang::SourceLocation loc);
+
+  // The type of the argument to the sentinels (const char*).
+  clang::QualType getDescriptorType();
+
+  // Get the descriptor of the loop. This is passed to the sentinels and is
+  // used by the runtime to identify the loop. It is of the form
+  // <file>:<line>:<column>|<function>|||<cost> where the location is that of
+  // the start of the loop. The presumed location is used so that #line
+  // directives are respected. The empty fields are the name and counters that
+  // only the instrument plugin sets. The cost is the static estimate of the
+  // work done in each iteration (see Cost.h) and is left out if it could not
+  // be determined. If the statement is an OpenMP loop directive, the
+  // location and cost are those of the outermost loop associated with it and
+  // the descriptor has the omp option.
+  std::string getDescriptor(clang::Stmt* stmt);
+
+  // Get the outermost loop that is associated with the OpenMP directive.
+  static clang::Stmt* getAssociatedLoop(clang::OMPLoopBasedDirective* dir);
+
+  // Create a string literal containing the descriptor that can be passed
+  // directly to the sentinels.
+  clang::Expr* getDescriptorArg(clang::StringRef desc,
+                                clang::SourceLocation loc);
 
   // Wrap the FunctionDecl in a DeclRefExpr. This is necessary for it to be
   // used in a CallExpr.
   clang::DeclRefExpr* getDeclRefExpr(clang::FunctionDecl* fn);
 
-  // Create a function declaration in the given DeclContext. The DeclContext
-  // may be the top-level context obtained by getTranslationUnitDecl(), or it
-  // could be a different decl context. Another useful one to use may be the
-  // externCContext() which is a DeclContext for extern "C" declarations.
-  // The SourceLocation may or may not be valid. If it is not valid, it could
-  // cause problems in debugging if it were to ever trigger a compile error for
-  // some reason.
-  clang::FunctionDecl* getDecl(clang::SourceLocation loc,
-                               clang::IdentifierInfo& ident);
-
-  // Create a call to __enterLoop(). The DeclContext is used to obtain the
-  // FunctionDecl for the __enterLoop function. The SourceLocation may or may
-  // not be valid.
-  clang::Stmt* getEnterCall(clang::SourceLocation loc);
-
-  // Create a call to __exitLoop(). The DeclContext is used to obtain the
-  // FunctionDecl for the __exitLoop function. The SourceLocation may or may
-  // not be valid.
-  clang::Stmt* getExitCall(clang::SourceLocation loc);
+  // Look up the declaration of the sentinel with the given name. The
+  // sentinels are declared in the runtime's header, which the plugin includes
+  // before the main file, so each is declared once in the translation unit
+  // and has the linkage that the runtime expects. An error is reported if the
+  // sentinel is not declared.
+  clang::FunctionDecl* lookupSentinel(clang::StringRef name,
+                                      clang::SourceLocation loc);
+
+  // Look up all the sentinels the first time that this is called. Returns
+  // false if any of them is not declared, in which case no loop can be
+  // demarcated.
+  bool lookupSentinels(clang::SourceLocation loc);
+
+  // Create a call to __enterLoop(desc). The SourceLocation may or may not be
+  // valid.
+  clang::Stmt* getEnterCall(clang::StringRef desc, clang::SourceLocation loc);
+
+  // Create a call to __exitLoop(desc). The SourceLocation may or may not be
+  // valid.
+  clang::Stmt* getExitCall(clang::StringRef desc, clang::SourceLocation loc);
+
+  // Create the declaration of a variable that exits the loop however control
+  // leaves the scope in which it is declared. This is equivalent to
+  //
+  //     const char* __loop __attribute__((cleanup(__exitLoopScope)))
+  //         = __enterLoopScope(desc);
+  //
+  // The cleanup attribute is used in both C and C++. In C++, it is also run
+  // when an exception propagates out of the loop.
+  clang::Stmt* getScopeGuard(clang::StringRef desc, clang::SourceLocation loc);
+
+  // Check if control could jump into the loop from outside it. The scope guard
+  // would not be initialized in that case, so such loops are demarcated with
+  // calls before and after the loop instead.
+  static bool hasJumpTargets(const clang::Stmt* stmt, bool inSwitch = false);
 
 public:
   explicit Visitor(clang::CompilerInstance& ci);
   virtual ~Visitor() = default;
 
   bool shouldVisitTemplateInstantiations() const;
+  bool TraverseDecl(clang::Decl* decl);
+  bool TraverseLambdaExpr(clang::LambdaExpr* expr,
+                          DataRecursionQueue* queue = nullptr);
   bool VisitForStmt(clang::ForStmt* stmt);
   bool VisitDoStmt(clang::DoStmt* stmt);
   bool VisitWhileStmt(clang::WhileStmt* stmt);
+  bool VisitCXXForRangeStmt(clang::CXXForRangeStmt* stmt);
+  bool VisitOMPLoopBasedDirective(clang::OMPLoopBasedDirective* dir);
 };
 
 #endif // CLANG_PLUGIN_EXAMPLES_LOOP_DEMARCATOR_VISITOR_H
@@ -0,0 +1,25 @@
+int find(int* a, int n, int x) {
+  for (int i = 0; i < n; i++)
+    if (a[i] == x)
+      return i;
+  return -1;
+}
+
+int main(int argc, char* argv[]) {
+  int a[16];
+  int ret = 0;
+  for (int i = 0; i < 16; i++)
+    a[i] = i * argc;
+
+  while (1) {
+    if (ret++ > 4)
+      break;
+  }
+
+  for (int i = 0; i < 16; i++)
+    for (int j = 0; j < 16; j++)
+      if (a[i] + a[j] == 15)
+        goto found;
+found:
+  return find(a, 16, ret);
+}
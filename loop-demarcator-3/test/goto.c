@@ -0,0 +1,12 @@
+int main(int argc, char* argv[]) {
+  int i = 0;
+  int sum = 0;
+
+top:
+  sum += i;
+  i++;
+  if (i < argc * 10)
+    goto top;
+
+  return sum;
+}
@@ -0,0 +1,30 @@
+#include <stdio.h>
+
+#define N 1048576
+
+static double a[N];
+static double b[N];
+
+int main(int argc, char* argv[]) {
+  double sum = 0;
+
+#pragma omp parallel for
+  for (int i = 0; i < N; i++)
+    a[i] = i * 0.5;
+
+#pragma omp parallel for collapse(2) reduction(+ : sum)
+  for (int i = 0; i < 1024; i++)
+    for (int j = 0; j < 1024; j++)
+      sum += a[i * 1024 + j];
+
+#pragma omp parallel
+  {
+#pragma omp for
+    for (int i = 0; i < N; i++)
+      b[i] = a[i] * argc;
+  }
+
+  printf("%g %g\n", sum, b[N - 1]);
+
+  return 0;
+}
@@ -0,0 +1,26 @@
+#include <algorithm>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+  double a[8] = {0};
+  std::vector<double> v(argc * 8, 1.0);
+
+  for (double& x : a)
+    x = argc * 2.0;
+
+  double sum = 0;
+  for (double x : v)
+    sum += x;
+
+  using Row = double[4];
+  Row row = {1.0, 2.0, 3.0, 4.0};
+  for (double x : row)
+    sum += x;
+
+  std::for_each(v.begin(), v.end(), [&](double& x) {
+    for (double y : a)
+      x += y;
+  });
+
+  return sum > 0;
+}
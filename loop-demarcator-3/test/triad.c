@@ -0,0 +1,29 @@
+#define N 1024
+
+double a[N];
+double b[N];
+double c[N];
+
+void triad(double s, int n) {
+  // The trip count is not known, so only the intensity of this loop can be
+  // computed.
+  for (int i = 0; i < n; i++)
+    a[i] = b[i] + s * c[i];
+}
+
+int main(int argc, char* argv[]) {
+  for (int i = 0; i < N; i++) {
+    b[i] = i;
+    c[i] = N - i;
+  }
+
+  for (int r = 0; r < 100; r++)
+    for (int i = 0; i < N; i += 2) {
+      a[i] += b[i] * c[i];
+      a[i + 1] -= b[i + 1] / c[i + 1];
+    }
+
+  triad(3.0, argc * N);
+
+  return a[argc] > 0;
+}
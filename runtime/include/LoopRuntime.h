@@ -0,0 +1,87 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_LOOP_RUNTIME_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_LOOP_RUNTIME_H
+
+/* The interface between the instrumented code and the loop runtime. The
+   plugins include this header in every translation unit that they process and
+   call the functions declared here. They never declare the sentinels
+   themselves.
+
+   This must remain valid C and C++, including C89, since it is included in
+   every file whatever the standard. Hence the comments and __inline__. */
+
+/* This is incremented whenever the signature or the semantics of any of the
+   functions here changes. */
+#define LOOP_RUNTIME_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void __enterLoop(const char* loop) __attribute__((nothrow));
+void __exitLoop(const char* loop) __attribute__((nothrow));
+void __hitLine(const char* line) __attribute__((nothrow));
+
+/* Each of the variadic arguments is a pointer to an argument of the
+   function. */
+void __logArgs(const char* function, ...) __attribute__((nothrow));
+
+/* The scope guards. The result of the enter function initializes a variable
+   whose cleanup function is the corresponding exit function. The variable is
+   null if the loop was not entered, which is the case when the condition of an
+   if clause is false.
+
+   These are defined here so that they can be inlined into the instrumented
+   code. The runtime also exports out-of-line definitions for code that was
+   compiled with LOOP_RUNTIME_NO_INLINE. */
+#ifdef LOOP_RUNTIME_NO_INLINE
+const char* __enterLoopScope(const char* loop) __attribute__((nothrow));
+void __exitLoopScope(const char** loop) __attribute__((nothrow));
+const char* __enterFunction(const char* function) __attribute__((nothrow));
+void __exitFunction(const char** function) __attribute__((nothrow));
+#else
+static __inline__ __attribute__((always_inline, unused)) const char*
+__enterLoopScope(const char* loop) {
+  __enterLoop(loop);
+  return loop;
+}
+
+static __inline__ __attribute__((always_inline, unused)) void
+__exitLoopScope(const char** loop) {
+  if (*loop)
+    __exitLoop(*loop);
+}
+
+static __inline__ __attribute__((always_inline, unused)) const char*
+__enterFunction(const char* function) {
+  __enterLoop(function);
+  return function;
+}
+
+static __inline__ __attribute__((always_inline, unused)) void
+__exitFunction(const char** function) {
+  __exitLoop(*function);
+}
+#endif /* LOOP_RUNTIME_NO_INLINE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLANG_PLUGIN_EXAMPLES_RUNTIME_LOOP_RUNTIME_H */
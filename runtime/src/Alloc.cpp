@@ -0,0 +1,184 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Alloc.h"
+#include "ThreadState.h"
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace lrt {
+
+// Set once any loop asks for its allocations to be tracked. Until then, the
+// allocator does nothing else.
+static std::atomic<bool> active(false);
+
+// The state of the calling thread. This is in the initial-exec TLS model so
+// that reading it never allocates, which would recurse into malloc().
+static thread_local ThreadState* charged
+    __attribute__((tls_model("initial-exec"))) = nullptr;
+
+static inline void charge(size_t size) {
+  if (active.load(std::memory_order_relaxed))
+    if (ThreadState* state = charged)
+      if (not Allocs::getEntered())
+        state->allocate(size);
+}
+
+Allocs::Allocs() {
+  for (std::atomic<uint64_t>& word : this->tracked)
+    word.store(0, std::memory_order_relaxed);
+}
+
+void Allocs::resolve(LoopTable& loops, uint32_t slot) {
+  std::string value;
+  if (not LoopTable::getOption(loops.getDescriptor(slot), "alloc", value))
+    return;
+
+  this->tracked[slot / Allocs::bitsPerWord].fetch_or(
+      1ULL << (slot % Allocs::bitsPerWord), std::memory_order_relaxed);
+  active.store(true, std::memory_order_relaxed);
+}
+
+void Allocs::start(LoopTable& loops) {
+  loops.onInsert([this, &loops](uint32_t slot) { this->resolve(loops, slot); });
+}
+
+void Allocs::startThread(ThreadState& state) {
+  charged = &state;
+}
+
+} // namespace lrt
+
+using namespace lrt;
+
+using MallocFn = void* (*)(size_t);
+using CallocFn = void* (*)(size_t, size_t);
+using ReallocFn = void* (*)(void*, size_t);
+using FreeFn = void (*)(void*);
+using PosixMemalignFn = int (*)(void**, size_t, size_t);
+using AlignedAllocFn = void* (*)(size_t, size_t);
+
+static MallocFn nextMalloc = nullptr;
+static CallocFn nextCalloc = nullptr;
+static ReallocFn nextRealloc = nullptr;
+static FreeFn nextFree = nullptr;
+static PosixMemalignFn nextPosixMemalign = nullptr;
+static AlignedAllocFn nextAlignedAlloc = nullptr;
+
+// dlsym() may itself allocate while the next allocator is being looked up.
+// Those allocations are served from here and are never freed. This happens
+// before main() is entered, when there is only one thread.
+alignas(std::max_align_t) static char bootstrap[4096];
+static size_t bootstrapUsed = 0;
+static bool lookingUp = false;
+
+static void* allocBootstrap(size_t size) {
+  const size_t align = alignof(std::max_align_t);
+  size = (size + align - 1) / align * align;
+  if (size > sizeof(bootstrap) - bootstrapUsed)
+    return nullptr;
+  void* p = bootstrap + bootstrapUsed;
+  bootstrapUsed += size;
+  return p;
+}
+
+static bool isBootstrap(void* p) {
+  return p >= bootstrap and p < bootstrap + sizeof(bootstrap);
+}
+
+static bool lookup() {
+  if (nextMalloc)
+    return true;
+  if (lookingUp)
+    return false;
+
+  lookingUp = true;
+  nextCalloc = reinterpret_cast<CallocFn>(dlsym(RTLD_NEXT, "calloc"));
+  nextRealloc = reinterpret_cast<ReallocFn>(dlsym(RTLD_NEXT, "realloc"));
+  nextFree = reinterpret_cast<FreeFn>(dlsym(RTLD_NEXT, "free"));
+  nextPosixMemalign = reinterpret_cast<PosixMemalignFn>(
+      dlsym(RTLD_NEXT, "posix_memalign"));
+  nextAlignedAlloc
+      = reinterpret_cast<AlignedAllocFn>(dlsym(RTLD_NEXT, "aligned_alloc"));
+  nextMalloc = reinterpret_cast<MallocFn>(dlsym(RTLD_NEXT, "malloc"));
+  lookingUp = false;
+
+  return nextMalloc;
+}
+
+extern "C" void* malloc(size_t size) {
+  if (not lookup())
+    return allocBootstrap(size);
+  charge(size);
+  return nextMalloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size) {
+  // The product could wrap around, which would charge the wrong size and
+  // return a buffer that is too small.
+  if (n and size > SIZE_MAX / n) {
+    errno = ENOMEM;
+    return nullptr;
+  }
+
+  // The bootstrap buffer is static and never reused, so it is already zero.
+  if (not lookup())
+    return allocBootstrap(n * size);
+  charge(n * size);
+  return nextCalloc(n, size);
+}
+
+extern "C" void* realloc(void* p, size_t size) {
+  if (not lookup())
+    return allocBootstrap(size);
+  charge(size);
+  if (isBootstrap(p)) {
+    // The size of the old block is not known, but it cannot extend past the
+    // end of the buffer.
+    size_t left = bootstrap + sizeof(bootstrap) - static_cast<char*>(p);
+    void* q = nextMalloc(size);
+    if (q)
+      std::memcpy(q, p, std::min(size, left));
+    return q;
+  }
+  return nextRealloc(p, size);
+}
+
+extern "C" void free(void* p) {
+  if (isBootstrap(p) or not lookup())
+    return;
+  nextFree(p);
+}
+
+extern "C" int posix_memalign(void** p, size_t align, size_t size) {
+  if (not lookup())
+    return ENOMEM;
+  charge(size);
+  return nextPosixMemalign(p, align, size);
+}
+
+extern "C" void* aligned_alloc(size_t align, size_t size) {
+  if (not lookup())
+    return nullptr;
+  charge(size);
+  return nextAlignedAlloc(align, size);
+}
@@ -0,0 +1,97 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_ALLOC_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_ALLOC_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "LoopTable.h"
+
+namespace lrt {
+
+class ThreadState;
+
+// Charges heap allocations to the loops that ask for it with the alloc option
+// (the alloc clause of the instrument plugin). The runtime defines malloc(),
+// calloc(), realloc(), posix_memalign() and aligned_alloc(), which forward to
+// whatever allocator comes after it in the search order, usually the one in
+// libc. operator new is counted because it calls malloc().
+//
+// Each thread keeps the innermost active loop that is being tracked and an
+// allocation is charged to that loop in the thread's own aggregates, so no
+// locks or atomic read-modify-write operations are needed. Until the first
+// loop with the option is seen, the cost to the program is a single load in
+// each call to the allocator.
+class Allocs {
+private:
+  static const unsigned bitsPerWord = 64;
+  std::atomic<uint64_t> tracked[LoopTable::capacity / bitsPerWord];
+
+private:
+  void resolve(LoopTable& loops, uint32_t slot);
+
+public:
+  Allocs();
+  Allocs(const Allocs&) = delete;
+  Allocs(Allocs&&) = delete;
+
+  // Check the options of every loop that is added to the table from now on.
+  void start(LoopTable& loops);
+
+  bool isTracked(uint32_t slot) const {
+    if (slot >= LoopTable::capacity)
+      return false;
+    uint64_t word = this->tracked[slot / Allocs::bitsPerWord].load(
+        std::memory_order_relaxed);
+    return word & (1ULL << (slot % Allocs::bitsPerWord));
+  }
+
+  // Charge the allocations made by the calling thread to the loops in the
+  // given state.
+  static void startThread(ThreadState& state);
+
+  // The number of entry points into the runtime that are active on the
+  // calling thread. This is in the initial-exec TLS model for the same reason
+  // as the state that is charged (see Alloc.cpp).
+  static unsigned& getEntered() {
+    static thread_local unsigned entered
+        __attribute__((tls_model("initial-exec"))) = 0;
+    return entered;
+  }
+
+  // The runtime's own allocations, such as the copies of the descriptors in
+  // the loop table or the buffers that are created the first time a thread
+  // enters a loop, must not be charged to the loop that the program is in.
+  // Every entry point into the runtime that may allocate, i.e. the sentinels
+  // and the OpenMP callbacks, keeps one of these for as long as it runs.
+  class Entered {
+  public:
+    Entered() {
+      Allocs::getEntered()++;
+    }
+    Entered(const Entered&) = delete;
+    Entered(Entered&&) = delete;
+    ~Entered() {
+      Allocs::getEntered()--;
+    }
+  };
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_ALLOC_H
@@ -0,0 +1,181 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "ArgLog.h"
+#include "Clock.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+namespace lrt {
+
+// A single call should never be able to fill a large part of the log.
+static const uint32_t maxArgsSize = 4096;
+
+ArgBuffer::ArgBuffer(args::Header* header, size_t size)
+    : header(header), data(args::getData(header)), size(size) {
+  ;
+}
+
+ArgBuffer::~ArgBuffer() {
+  munmap(this->header, this->size);
+}
+
+ArgLog::ArgLog(const std::string& dir, uint64_t capacity)
+    : dir(dir), capacity(capacity), functionsFd(-1) {
+  ;
+}
+
+ArgLog::~ArgLog() {
+  if (this->functionsFd >= 0)
+    close(this->functionsFd);
+}
+
+static int openFunctions(const std::string& dir) {
+  std::string name = args::getFunctionsName(dir, getpid());
+  int fd = open(name.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_APPEND, 0644);
+  if (fd < 0)
+    std::fprintf(stderr, "loop-runtime: Could not create %s\n", name.c_str());
+  return fd;
+}
+
+bool ArgLog::start() {
+  this->functionsFd = openFunctions(this->dir);
+  if (this->functionsFd < 0)
+    return false;
+
+  this->functions.onInsert([this](uint32_t slot) {
+    this->resolve(slot);
+    this->addFunction(slot);
+  });
+
+  return true;
+}
+
+bool ArgLog::restart() {
+  // The descriptor is shared with the parent, which is still appending to it.
+  if (this->functionsFd >= 0)
+    close(this->functionsFd);
+
+  this->functionsFd = openFunctions(this->dir);
+  if (this->functionsFd < 0)
+    return false;
+
+  for (uint32_t slot = 0; slot < this->functions.size(); slot++)
+    this->addFunction(slot);
+
+  return true;
+}
+
+void ArgLog::resolve(uint32_t slot) {
+  const std::string& desc = this->functions.getDescriptor(slot);
+  this->layouts[slot] = ArgLog::parse(desc);
+  if (not this->layouts[slot].valid)
+    std::fprintf(stderr,
+                 "loop-runtime: Cannot log the arguments of %s\n",
+                 desc.c_str());
+}
+
+void ArgLog::addFunction(uint32_t slot) {
+  if (this->functionsFd < 0)
+    return;
+
+  char prefix[64];
+  std::snprintf(prefix,
+                sizeof(prefix),
+                "%u %016" PRIx64 " ",
+                slot,
+                this->functions.getId(slot));
+  std::string line = prefix;
+  line.append(this->functions.getDescriptor(slot));
+  line.append("\n");
+  if (write(this->functionsFd, line.c_str(), line.size())
+      != (ssize_t)line.size())
+    std::fprintf(stderr, "loop-runtime: Could not record function %u\n", slot);
+}
+
+ArgBuffer* ArgLog::createBuffer(unsigned tid) {
+  // The arguments cannot be interpreted without the descriptors.
+  if (this->functionsFd < 0)
+    return nullptr;
+
+  std::string name = args::getName(this->dir, getpid(), tid);
+  int fd = open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::fprintf(stderr, "loop-runtime: Could not create %s\n", name.c_str());
+    return nullptr;
+  }
+
+  // The file is sparse, so only the part of the log that is actually written
+  // takes up any space.
+  size_t size = args::getSize(this->capacity);
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return nullptr;
+
+  args::Header* header = static_cast<args::Header*>(addr);
+  header->version = args::version;
+  header->pid = getpid();
+  header->tid = tid;
+  header->ppid = getppid();
+  header->nsPerTick = Clock::getNsPerTick();
+  header->baseTicks = now();
+  header->baseNs = Clock::toMonotonic(header->baseTicks);
+  header->capacity = this->capacity;
+  header->magic = args::magic;
+
+  return new ArgBuffer(header, size);
+}
+
+ArgLayout ArgLog::parse(const std::string& desc) {
+  ArgLayout layout = {{}, 0, false};
+  std::string value;
+  if (not LoopTable::getOption(desc, "args", value))
+    return layout;
+
+  // Each argument is <name>:<tag><size>. Only the size is needed here.
+  std::istringstream ss(value);
+  std::string arg;
+  while (std::getline(ss, arg, ';')) {
+    size_t colon = arg.rfind(':');
+    if (colon == std::string::npos or colon + 2 >= arg.size())
+      return layout;
+
+    char* end = nullptr;
+    unsigned long size = std::strtoul(arg.c_str() + colon + 2, &end, 10);
+    if (*end or not size or size > maxArgsSize - layout.size)
+      return layout;
+    layout.sizes.push_back(size);
+    layout.size += size;
+  }
+  layout.valid = true;
+
+  return layout;
+}
+
+} // namespace lrt
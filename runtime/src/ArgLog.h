@@ -0,0 +1,141 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_ARG_LOG_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_ARG_LOG_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "ArgLogFile.h"
+#include "LoopTable.h"
+
+namespace lrt {
+
+// The arguments of a function that are logged when it is called. This is
+// parsed from the args option of the function's descriptor.
+struct ArgLayout {
+  // The size in bytes of each argument, in the order in which they are passed
+  // to the sentinel.
+  std::vector<uint32_t> sizes;
+
+  // The sum of the sizes.
+  uint32_t size;
+
+  // False if the option could not be parsed. Calls to the function are not
+  // logged.
+  bool valid;
+};
+
+// A per-thread log of the arguments with which functions were called that
+// lives in a memory-mapped file. See ArgLogFile.h for the layout. Once the
+// log is full, calls are counted as dropped.
+class ArgBuffer {
+private:
+  args::Header* header;
+  char* data;
+  size_t size;
+
+public:
+  ArgBuffer(args::Header* header, size_t size);
+  ArgBuffer(const ArgBuffer&) = delete;
+  ArgBuffer(ArgBuffer&&) = delete;
+  ~ArgBuffer();
+
+  // Get the space for the arguments of a call to the function in the slot.
+  // Returns nullptr if there is not enough space. Nothing is visible to a
+  // reader until commit() is called.
+  char* append(uint32_t slot, uint64_t time, uint32_t size) {
+    const auto relaxed = std::memory_order_relaxed;
+    uint64_t end = this->header->end.load(relaxed);
+    if (args::getRecordSize(size) > this->header->capacity - end) {
+      this->header->dropped.store(this->header->dropped.load(relaxed) + 1,
+                                  relaxed);
+      return nullptr;
+    }
+
+    args::Record* rec = reinterpret_cast<args::Record*>(this->data + end);
+    rec->time = time;
+    rec->slot = slot;
+    rec->size = size;
+    return reinterpret_cast<char*>(rec + 1);
+  }
+
+  void commit(uint32_t size) {
+    uint64_t end = this->header->end.load(std::memory_order_relaxed);
+    this->header->end.store(end + args::getRecordSize(size),
+                            std::memory_order_release);
+  }
+};
+
+// Logs the raw bytes of the arguments of the functions that were demarcated
+// with the args clause of the instrument plugin. Formatting the arguments is
+// left to the loop-args tool, so the cost of a call is a lookup of the
+// descriptor and a copy of each argument.
+//
+// The functions are kept in a loop table of their own, so they do not take up
+// slots that are meant for loops and never appear in the profile.
+class ArgLog {
+private:
+  std::string dir;
+  uint64_t capacity;
+  int functionsFd;
+  LoopTable functions;
+
+  // Indexed by slot. An entry is written before the slot is published.
+  ArgLayout layouts[LoopTable::capacity];
+
+private:
+  void resolve(uint32_t slot);
+  void addFunction(uint32_t slot);
+
+public:
+  // The capacity is the number of bytes in each thread's log.
+  ArgLog(const std::string& dir, uint64_t capacity);
+  ArgLog(const ArgLog&) = delete;
+  ArgLog(ArgLog&&) = delete;
+  ~ArgLog();
+
+  // Create the descriptor file. Returns false if it could not be created.
+  bool start();
+
+  // Called in the child after a fork. This creates the descriptor file for
+  // the child and copies every function that is already in the table to it.
+  // Returns false if the file could not be created, in which case no logs
+  // will be created in the child.
+  bool restart();
+
+  LoopTable& getFunctions() {
+    return this->functions;
+  }
+
+  const ArgLayout& getLayout(uint32_t slot) const {
+    return this->layouts[slot];
+  }
+
+  // Create a log for the thread with the given tid. Returns nullptr if the
+  // file could not be created, in which case the thread's calls are not
+  // logged.
+  ArgBuffer* createBuffer(unsigned tid);
+
+  // Parse the args option of a descriptor.
+  static ArgLayout parse(const std::string& desc);
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_ARG_LOG_H
@@ -0,0 +1,137 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_ARG_LOG_FILE_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_ARG_LOG_FILE_H
+
+// The layout of the argument logs. These are written by the runtime and read
+// by the loop-args tool, so this should not include anything from the rest of
+// the runtime.
+//
+// Each thread has its own file, loop-args.<pid>.<tid>, that is mapped into
+// memory and so survives the process being killed, just like the trace. The
+// descriptors of the functions are in a separate file,
+// loop-args.<pid>.functions, that is appended to whenever a new function is
+// seen. Each line of that file is of the form
+//
+//     <slot> <id> <descriptor>
+//
+// The args option of the descriptor is the type table for the function. It is
+// of the form args=<name>:<tag><size>;... with one entry for each argument
+// that is logged, in the order in which they are logged. The tag is one of
+//
+//     b    bool
+//     c    a character type
+//     i    a signed integer or an enum
+//     u    an unsigned integer
+//     f    a floating point type
+//     p    a pointer
+//     x    anything else. This is only printed as raw bytes.
+//
+// and the size is the size of the argument in bytes.
+//
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+
+namespace lrt {
+namespace args {
+
+const uint64_t magic = 0x4752412d54524c00ULL; // "LRT-ARG"
+const uint32_t version = 1;
+
+// Each record is followed by size bytes of arguments, which are the raw bytes
+// of each argument one after the other. The arguments are padded so that
+// every record starts at a multiple of the alignment. The time is in clock
+// ticks. Use the nsPerTick field of the header to convert it to nanoseconds.
+struct Record {
+  uint64_t time;
+  uint32_t slot;
+  uint32_t size;
+};
+
+const size_t alignment = sizeof(Record);
+
+struct Header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t pid;
+  uint32_t tid;
+  uint32_t ppid;
+
+  double nsPerTick;
+
+  // A time in ticks and the same time on the monotonic clock. These are used
+  // to put the calls in different processes on the same timeline.
+  uint64_t baseTicks;
+  uint64_t baseNs;
+
+  // The number of bytes that follow the header.
+  uint64_t capacity;
+
+  // The number of bytes of records that have been written. A record is always
+  // completely written before this is incremented past it, so a record that
+  // was being written when the process died will not be visible.
+  std::atomic<uint64_t> end;
+
+  // The number of calls that were not logged because the log was full.
+  std::atomic<uint64_t> dropped;
+};
+
+inline std::string getName(const std::string& dir, pid_t pid, pid_t tid) {
+  return dir + "/loop-args." + std::to_string(pid) + "." + std::to_string(tid);
+}
+
+inline std::string getFunctionsName(const std::string& dir, pid_t pid) {
+  return dir + "/loop-args." + std::to_string(pid) + ".functions";
+}
+
+inline size_t getSize(uint64_t capacity) {
+  return sizeof(Header) + capacity;
+}
+
+// The number of bytes taken up by a record with the given number of bytes of
+// arguments.
+inline uint64_t getRecordSize(uint32_t size) {
+  return sizeof(Record) + (size + alignment - 1) / alignment * alignment;
+}
+
+inline char* getData(Header* header) {
+  return reinterpret_cast<char*>(header + 1);
+}
+
+inline const char* getData(const Header* header) {
+  return reinterpret_cast<const char*>(header + 1);
+}
+
+// Convert a time in ticks from the log to a time on the monotonic clock.
+inline uint64_t toMonotonic(const Header* header, uint64_t ticks) {
+  if (ticks < header->baseTicks)
+    return header->baseNs
+           - static_cast<uint64_t>((header->baseTicks - ticks)
+                                   * header->nsPerTick);
+  return header->baseNs
+         + static_cast<uint64_t>((ticks - header->baseTicks)
+                                 * header->nsPerTick);
+}
+
+} // namespace args
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_ARG_LOG_FILE_H
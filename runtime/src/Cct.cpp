@@ -0,0 +1,123 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Cct.h"
+#include "LoopTable.h"
+
+namespace lrt {
+
+static const uint64_t emptyKey = UINT64_MAX;
+
+static uint64_t getKey(uint32_t parent, uint32_t slot) {
+  return (static_cast<uint64_t>(parent) << 32) | slot;
+}
+
+Cct::Cct(uint32_t capacity)
+    : capacity(std::max(capacity, Cct::truncated + 1)),
+      nodes(new CctNode[this->capacity]), numNodes(0), buckets(1) {
+  while (this->buckets < 2 * this->capacity)
+    this->buckets *= 2;
+  this->keys.reset(new uint64_t[this->buckets]);
+  this->values.reset(new uint32_t[this->buckets]);
+  this->reset();
+}
+
+void Cct::reset() {
+  for (uint32_t i = 0; i < this->buckets; i++)
+    this->keys[i] = emptyKey;
+
+  this->numNodes.store(0, std::memory_order_relaxed);
+  this->create(Cct::root, LoopTable::invalid);
+  this->create(Cct::root, LoopTable::invalid);
+}
+
+void Cct::clear() {
+  const auto relaxed = std::memory_order_relaxed;
+  for (uint32_t i = 0; i < this->size(); i++) {
+    CctNode& node = this->nodes[i];
+    node.count.store(0, relaxed);
+    node.total.store(0, relaxed);
+    node.self.store(0, relaxed);
+    node.samples.store(0, relaxed);
+  }
+}
+
+uint32_t Cct::create(uint32_t parent, uint32_t slot) {
+  const auto relaxed = std::memory_order_relaxed;
+  uint32_t id = this->numNodes.load(relaxed);
+  CctNode& node = this->nodes[id];
+  node.slot = slot;
+  node.parent = parent;
+  node.numChildren = 0;
+  node.count.store(0, relaxed);
+  node.total.store(0, relaxed);
+  node.self.store(0, relaxed);
+  node.samples.store(0, relaxed);
+
+  // Readers in other threads only look at nodes below numNodes, so the node
+  // must be filled in before it is published.
+  this->numNodes.store(id + 1, std::memory_order_release);
+  return id;
+}
+
+uint32_t Cct::getChildSlow(uint32_t parent, uint32_t slot) {
+  // Everything charged to a truncated context stays there.
+  if (parent == Cct::truncated)
+    return Cct::truncated;
+
+  CctNode& node = this->nodes[parent];
+  uint64_t key = getKey(parent, slot);
+  uint32_t b = static_cast<uint32_t>((key * 0x9e3779b97f4a7c15ULL) >> 32)
+               & (this->buckets - 1);
+  if (node.numChildren > CctNode::inlineChildren) {
+    while (this->keys[b] != emptyKey) {
+      if (this->keys[b] == key)
+        return this->values[b];
+      b = (b + 1) & (this->buckets - 1);
+    }
+  }
+
+  if (this->numNodes.load(std::memory_order_relaxed) == this->capacity)
+    return Cct::truncated;
+
+  uint32_t child = this->create(parent, slot);
+  if (node.numChildren < CctNode::inlineChildren) {
+    node.childSlots[node.numChildren] = slot;
+    node.children[node.numChildren] = child;
+  } else {
+    // If the children did not overflow before, b was not probed. This is
+    // safe because the key cannot already be in the table.
+    while (this->keys[b] != emptyKey)
+      b = (b + 1) & (this->buckets - 1);
+    this->keys[b] = key;
+    this->values[b] = child;
+  }
+  node.numChildren++;
+
+  return child;
+}
+
+uint32_t Cct::size() const {
+  return this->numNodes.load(std::memory_order_acquire);
+}
+
+const CctNode& Cct::getNode(uint32_t node) const {
+  return this->nodes[node];
+}
+
+const unsigned CctNode::inlineChildren;
+
+} // namespace lrt
@@ -0,0 +1,127 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_CCT_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_CCT_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace lrt {
+
+// A node in the calling-context tree. Each node is a loop in the context of
+// the loops that enclose it. The node is never moved once it is created.
+struct CctNode {
+  // The number of children that are found without going to the overflow
+  // table. Most loops have very few distinct loops nested directly in them.
+  static const unsigned inlineChildren = 4;
+
+  // These never change after the node has been published.
+  uint32_t slot;
+  uint32_t parent;
+
+  // These are only accessed by the owning thread.
+  uint32_t numChildren;
+  uint32_t childSlots[inlineChildren];
+  uint32_t children[inlineChildren];
+
+  // These are the same as those in LoopStats.
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> total;
+  std::atomic<uint64_t> self;
+  std::atomic<uint64_t> samples;
+};
+
+// A per-thread calling-context tree. The nodes are allocated from a fixed
+// arena, so the memory used is bounded. Once the arena is full, any new
+// context is charged to a single node for truncated contexts.
+class Cct {
+public:
+  // The root is not a loop. Its children are the outermost loops.
+  static const uint32_t root = 0;
+
+  // The node to which contexts that do not fit in the arena are charged.
+  static const uint32_t truncated = 1;
+
+private:
+  uint32_t capacity;
+  std::unique_ptr<CctNode[]> nodes;
+  std::atomic<uint32_t> numNodes;
+
+  // Children that do not fit in the parent's inline map. This is an
+  // open-addressed hash table keyed by the parent and the slot. Since every
+  // node has at most one parent, it can never have more entries than there
+  // are nodes.
+  uint32_t buckets;
+  std::unique_ptr<uint64_t[]> keys;
+  std::unique_ptr<uint32_t[]> values;
+
+private:
+  uint32_t create(uint32_t parent, uint32_t slot);
+  uint32_t getChildSlow(uint32_t parent, uint32_t slot);
+
+public:
+  // The capacity is the maximum number of nodes, including the root and the
+  // node for truncated contexts.
+  explicit Cct(uint32_t capacity);
+  Cct(const Cct&) = delete;
+  Cct(Cct&&) = delete;
+
+  // Get the node for the loop in the given slot nested in the context of the
+  // parent node, creating it if necessary.
+  uint32_t getChild(uint32_t parent, uint32_t slot) {
+    CctNode& node = this->nodes[parent];
+    unsigned n = std::min(node.numChildren, CctNode::inlineChildren);
+    for (unsigned i = 0; i < n; i++)
+      if (node.childSlots[i] == slot)
+        return node.children[i];
+    return this->getChildSlow(parent, slot);
+  }
+
+  void add(uint32_t node, uint64_t total, uint64_t self) {
+    const auto relaxed = std::memory_order_relaxed;
+    CctNode& n = this->nodes[node];
+    n.count.store(n.count.load(relaxed) + 1, relaxed);
+    n.total.store(n.total.load(relaxed) + total, relaxed);
+    n.self.store(n.self.load(relaxed) + self, relaxed);
+  }
+
+  void addSamples(uint32_t node, uint64_t samples) {
+    const auto relaxed = std::memory_order_relaxed;
+    CctNode& n = this->nodes[node];
+    n.samples.store(n.samples.load(relaxed) + samples, relaxed);
+  }
+
+  // Remove everything but the root and the node for truncated contexts.
+  // This must only be called by the owning thread when it is not in a loop.
+  void reset();
+
+  // Clear the aggregates of every node, but keep the nodes themselves. This
+  // is used in the child after a fork, when the active loops still refer to
+  // their nodes.
+  void clear();
+
+  // The nodes can be read by any thread. Only the slot, the parent and the
+  // aggregates should be used.
+  uint32_t size() const;
+  const CctNode& getNode(uint32_t node) const;
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_CCT_H
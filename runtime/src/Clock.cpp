@@ -0,0 +1,108 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Clock.h"
+
+#ifdef LOOP_RUNTIME_HAVE_TSC
+#include <cpuid.h>
+#endif
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace lrt {
+
+bool Clock::tsc = false;
+double Clock::nsPerTick = 1.0;
+uint64_t Clock::tickBase = 0;
+uint64_t Clock::nsBase = 0;
+
+#ifdef LOOP_RUNTIME_HAVE_TSC
+static bool isTscInvariant() {
+  unsigned eax, ebx, ecx, edx;
+  if (not __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+    return false;
+  return edx & (1 << 8);
+}
+
+// Read the TSC and the monotonic clock as close together as possible. The
+// monotonic clock is read between two reads of the TSC and the pair with the
+// smallest gap out of a few attempts is used.
+static void readPair(uint64_t& ticks, uint64_t& ns) {
+  uint64_t best = UINT64_MAX;
+  for (unsigned i = 0; i < 8; i++) {
+    uint64_t t0 = __rdtsc();
+    uint64_t n = Clock::monotonic();
+    uint64_t t1 = __rdtsc();
+    if (t1 - t0 < best) {
+      best = t1 - t0;
+      ticks = t0 + (t1 - t0) / 2;
+      ns = n;
+    }
+  }
+}
+#endif
+
+void Clock::calibrate(const char* mode, unsigned ms) {
+  Clock::tsc = false;
+  Clock::nsPerTick = 1.0;
+  Clock::tickBase = 0;
+  Clock::nsBase = 0;
+
+#ifdef LOOP_RUNTIME_HAVE_TSC
+  bool useTsc = mode ? std::strcmp(mode, "tsc") == 0 : isTscInvariant();
+  if (not useTsc)
+    return;
+
+  uint64_t t0 = 0, n0 = 0, t1 = 0, n1 = 0;
+  readPair(t0, n0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms ? ms : 1));
+  readPair(t1, n1);
+  if (t1 <= t0 or n1 <= n0)
+    return;
+
+  Clock::tsc = true;
+  Clock::nsPerTick = static_cast<double>(n1 - n0) / (t1 - t0);
+  Clock::tickBase = t0;
+  Clock::nsBase = n0;
+#else
+  (void)mode;
+  (void)ms;
+#endif
+}
+
+bool Clock::isTsc() {
+  return Clock::tsc;
+}
+
+double Clock::getNsPerTick() {
+  return Clock::nsPerTick;
+}
+
+uint64_t Clock::toNs(uint64_t ticks) {
+  return static_cast<uint64_t>(ticks * Clock::nsPerTick);
+}
+
+uint64_t Clock::toMonotonic(uint64_t ticks) {
+  if (not Clock::tsc)
+    return ticks;
+  if (ticks < Clock::tickBase)
+    return Clock::nsBase - Clock::toNs(Clock::tickBase - ticks);
+  return Clock::nsBase + Clock::toNs(ticks - Clock::tickBase);
+}
+
+} // namespace lrt
@@ -0,0 +1,128 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_CLOCK_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_CLOCK_H
+
+#include <sched.h>
+
+#include <cstdint>
+#include <ctime>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LOOP_RUNTIME_HAVE_TSC 1
+#endif
+
+namespace lrt {
+
+// The clock used to timestamp loop events. On x86, this reads the time-stamp
+// counter if it is invariant, which is several times cheaper than
+// clock_gettime(). The ticks are converted to nanoseconds only when the
+// results are reported. Everywhere else, the clock falls back to the
+// monotonic clock and a tick is a nanosecond.
+//
+// The tools that read the runtime's output only ever use monotonic() and do
+// not need to link against the runtime.
+class Clock {
+public:
+  // Returned instead of the CPU when the CPU is not known.
+  static const uint32_t noCpu = UINT32_MAX;
+
+private:
+  static bool tsc;
+  static double nsPerTick;
+  static uint64_t tickBase;
+  static uint64_t nsBase;
+
+public:
+  // Decide which clock to use and, if it is the TSC, measure its frequency
+  // against the monotonic clock over the given number of milliseconds. This
+  // must be called before any other thread could call ticks(). The clock can
+  // be forced by setting mode to "tsc" or "monotonic". If mode is null, the
+  // TSC will be used if it is invariant.
+  static void calibrate(const char* mode, unsigned ms);
+
+  // The current time in nanoseconds. This uses the monotonic clock because it
+  // is the one that is shared between processes on the same machine. The
+  // monitor tool relies on this to work out how long ago a loop was last seen.
+  static uint64_t monotonic() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  static uint64_t ticks() {
+#ifdef LOOP_RUNTIME_HAVE_TSC
+    if (Clock::tsc)
+      return __rdtsc();
+#endif
+    return Clock::monotonic();
+  }
+
+  // The current time in ticks and the CPU on which it was read. The CPU is
+  // encoded as (node << 12) | cpu, which is what Linux puts in the TSC_AUX
+  // register that rdtscp returns, so with the TSC this costs no more than
+  // reading the time. Otherwise, the CPU is read using getcpu(), which goes
+  // through the vDSO.
+  static uint64_t ticks(uint32_t& cpu) {
+#ifdef LOOP_RUNTIME_HAVE_TSC
+    if (Clock::tsc) {
+      unsigned aux;
+      uint64_t ticks = __rdtscp(&aux);
+      cpu = aux;
+      return ticks;
+    }
+#endif
+    unsigned c = 0, node = 0;
+    if (getcpu(&c, &node) != 0)
+      cpu = Clock::noCpu;
+    else
+      cpu = (node << 12) | c;
+    return Clock::monotonic();
+  }
+
+  static unsigned getCpu(uint32_t cpu) {
+    return cpu & 0xfff;
+  }
+
+  static unsigned getNode(uint32_t cpu) {
+    return cpu >> 12;
+  }
+
+  static bool isTsc();
+  static double getNsPerTick();
+
+  // Convert a duration in ticks to nanoseconds.
+  static uint64_t toNs(uint64_t ticks);
+
+  // Convert a timestamp in ticks to a time on the monotonic clock.
+  static uint64_t toMonotonic(uint64_t ticks);
+};
+
+// The current time in ticks.
+inline uint64_t now() {
+  return Clock::ticks();
+}
+
+// The current time in ticks and the CPU on which it was read.
+inline uint64_t now(uint32_t& cpu) {
+  return Clock::ticks(cpu);
+}
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_CLOCK_H
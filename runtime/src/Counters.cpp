@@ -0,0 +1,277 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Counters.h"
+#include "Clock.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+
+namespace lrt {
+
+struct Event {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+
+  // The counter to use if this one cannot be opened. This is NumCounters if
+  // there is no fallback.
+  Counter fallback;
+};
+
+// This must be in the same order as the Counter enum.
+static const Event events[NumCounters] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, TaskClock},
+    {"instructions",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_INSTRUCTIONS,
+     NumCounters},
+    {"cache-references",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_CACHE_REFERENCES,
+     NumCounters},
+    {"cache-misses",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_CACHE_MISSES,
+     NumCounters},
+    {"branches",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
+     NumCounters},
+    {"branch-misses",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_BRANCH_MISSES,
+     NumCounters},
+    {"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, NumCounters},
+    {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, NumCounters},
+    {"context-switches",
+     PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_CONTEXT_SWITCHES,
+     NumCounters},
+};
+
+// Used in Counters::used for a counter that has not been opened yet.
+static const int unopened = -1;
+
+static int openEvent(const Event& event) {
+  struct perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = event.type;
+  attr.config = event.config;
+
+  // Unprivileged processes can usually only count in user space. This also
+  // keeps the counts from including the kernel's own work on behalf of other
+  // processes.
+  if (event.type == PERF_TYPE_HARDWARE) {
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+  }
+
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+Counters::Counters() {
+  for (std::atomic<uint32_t>& mask : this->masks)
+    mask.store(0, std::memory_order_relaxed);
+  for (std::atomic<int>& u : this->used)
+    u.store(unopened, std::memory_order_relaxed);
+}
+
+void Counters::resolve(LoopTable& loops, uint32_t slot) {
+  std::string names
+      = LoopTable::getField(loops.getDescriptor(slot), LoopTable::Counters);
+  uint32_t mask = 0;
+  size_t beg = 0;
+  while (beg < names.size()) {
+    size_t end = names.find(',', beg);
+    if (end == std::string::npos)
+      end = names.size();
+    Counter counter = Counters::getCounter(names.substr(beg, end - beg));
+    if (counter != NumCounters)
+      mask |= 1U << counter;
+    beg = end + 1;
+  }
+  this->masks[slot].store(mask, std::memory_order_relaxed);
+}
+
+void Counters::start(LoopTable& loops) {
+  loops.onInsert([this, &loops](uint32_t slot) { this->resolve(loops, slot); });
+}
+
+int Counters::open(Counter counter) {
+  // Once a counter has been found to be unavailable, don't try again on every
+  // thread.
+  int used = this->used[counter].load(std::memory_order_relaxed);
+  if (used == NumCounters)
+    return -1;
+  if (used != unopened)
+    return openEvent(events[used]);
+
+  int fd = openEvent(events[counter]);
+  used = counter;
+  if (fd < 0 and events[counter].fallback != NumCounters) {
+    used = events[counter].fallback;
+    fd = openEvent(events[used]);
+  }
+  if (fd < 0)
+    used = NumCounters;
+
+  int expected = unopened;
+  this->used[counter].compare_exchange_strong(expected, used);
+  return fd;
+}
+
+const char* Counters::getUsedName(Counter counter) const {
+  int used = this->used[counter].load(std::memory_order_relaxed);
+  if (used == unopened or used == NumCounters)
+    return nullptr;
+  return events[used].name;
+}
+
+const char* Counters::getName(Counter counter) {
+  return events[counter].name;
+}
+
+Counter Counters::getCounter(const std::string& name) {
+  for (unsigned i = 0; i < NumCounters; i++)
+    if (name == events[i].name)
+      return static_cast<Counter>(i);
+  return NumCounters;
+}
+
+CounterSet::CounterSet(Counters& counters)
+    : counters(counters), values(nullptr) {
+  for (unsigned i = 0; i < NumCounters; i++) {
+    this->fds[i] = -1;
+    this->pages[i] = nullptr;
+    this->opened[i] = false;
+  }
+}
+
+void CounterSet::open(Counter counter) {
+  this->opened[counter] = true;
+  int fd = this->counters.open(counter);
+  if (fd < 0)
+    return;
+
+  // The first page of the mapping has the information needed to read the
+  // counter with rdpmc. If it cannot be mapped, the counter is read with
+  // read() instead, which is much slower.
+  this->fds[counter] = fd;
+  void* page
+      = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+  if (page != MAP_FAILED)
+    this->pages[counter] = static_cast<perf_event_mmap_page*>(page);
+}
+
+uint64_t CounterSet::read(Counter counter) {
+  if (not this->opened[counter])
+    this->open(counter);
+
+#ifdef LOOP_RUNTIME_HAVE_TSC
+  // See the description of perf_event_mmap_page in perf_event_open(2).
+  if (const perf_event_mmap_page* pc = this->pages[counter]) {
+    uint32_t seq, idx;
+    uint64_t count;
+    do {
+      seq = pc->lock;
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      idx = pc->index;
+      count = pc->offset;
+      if (pc->cap_user_rdpmc and idx) {
+        unsigned shift = 64 - pc->pmc_width;
+        uint64_t pmc = __rdpmc(idx - 1);
+        count += static_cast<int64_t>(pmc << shift) >> shift;
+      }
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    } while (pc->lock != seq);
+
+    // If the counter is not on the PMU right now (or never is, like the
+    // software counters), fall through and ask the kernel.
+    if (pc->cap_user_rdpmc and idx)
+      return count;
+  }
+#endif
+
+  uint64_t count = 0;
+  if (this->fds[counter] >= 0
+      and ::read(this->fds[counter], &count, sizeof(count)) != sizeof(count))
+    count = 0;
+  return count;
+}
+
+std::atomic<uint64_t>* CounterSet::getValues() {
+  std::atomic<uint64_t>* values = this->values.load(std::memory_order_relaxed);
+  if (not values) {
+    values = new std::atomic<uint64_t>[LoopTable::capacity * NumCounters];
+    for (unsigned i = 0; i < LoopTable::capacity * NumCounters; i++)
+      values[i].store(0, std::memory_order_relaxed);
+    this->starts.reset(new uint64_t[CounterSet::maxDepth * NumCounters]);
+    this->values.store(values, std::memory_order_release);
+  }
+  return values;
+}
+
+void CounterSet::start(uint32_t mask, unsigned depth) {
+  this->getValues();
+  uint64_t* starts = &this->starts[depth * NumCounters];
+  for (unsigned i = 0; i < NumCounters; i++)
+    if (mask & (1U << i))
+      starts[i] = this->read(static_cast<Counter>(i));
+}
+
+void CounterSet::stop(uint32_t slot, uint32_t mask, unsigned depth) {
+  const auto relaxed = std::memory_order_relaxed;
+  std::atomic<uint64_t>* values = &this->getValues()[slot * NumCounters];
+  const uint64_t* starts = &this->starts[depth * NumCounters];
+  for (unsigned i = 0; i < NumCounters; i++) {
+    if (mask & (1U << i)) {
+      uint64_t delta = this->read(static_cast<Counter>(i)) - starts[i];
+      values[i].store(values[i].load(relaxed) + delta, relaxed);
+    }
+  }
+}
+
+void CounterSet::reset() {
+  for (unsigned i = 0; i < NumCounters; i++) {
+    if (this->pages[i])
+      munmap(this->pages[i], sysconf(_SC_PAGESIZE));
+    if (this->fds[i] >= 0)
+      close(this->fds[i]);
+    this->fds[i] = -1;
+    this->pages[i] = nullptr;
+    this->opened[i] = false;
+  }
+
+  if (std::atomic<uint64_t>* values
+      = this->values.load(std::memory_order_relaxed))
+    for (unsigned i = 0; i < LoopTable::capacity * NumCounters; i++)
+      values[i].store(0, std::memory_order_relaxed);
+}
+
+uint64_t CounterSet::getValue(uint32_t slot, Counter counter) const {
+  const std::atomic<uint64_t>* values
+      = this->values.load(std::memory_order_acquire);
+  if (not values)
+    return 0;
+  return values[slot * NumCounters + counter].load(std::memory_order_relaxed);
+}
+
+} // namespace lrt
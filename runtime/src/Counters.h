@@ -0,0 +1,154 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_COUNTERS_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_COUNTERS_H
+
+#include <linux/perf_event.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "LoopTable.h"
+
+namespace lrt {
+
+// The performance counters that can be requested for a loop using the
+// counters() clause of the instrument plugin. The hardware counters are read
+// in user space using rdpmc where possible. If a hardware counter cannot be
+// opened, which is usually the case in a virtual machine, cycles falls back to
+// the task-clock software counter. The others are reported as unavailable.
+enum Counter {
+  Cycles,
+  Instructions,
+  CacheReferences,
+  CacheMisses,
+  Branches,
+  BranchMisses,
+  TaskClock,
+  PageFaults,
+  ContextSwitches,
+  NumCounters,
+};
+
+// The process-wide part of the counters. This keeps the set of counters
+// requested by each loop and which event is actually used for each counter.
+class Counters {
+private:
+  // Indexed by slot. Each is a bitmask of the counters requested by the loop.
+  // An entry is written before the slot is published. There is an extra entry
+  // for the scratch slot that ThreadState uses while calibrating.
+  std::atomic<uint32_t> masks[LoopTable::capacity + 1];
+
+  // The event that was opened for each counter. This is the counter itself,
+  // the fallback, or NumCounters if it could not be opened. It is decided by
+  // the first thread that opens the counter.
+  std::atomic<int> used[NumCounters];
+
+private:
+  void resolve(LoopTable& loops, uint32_t slot);
+
+public:
+  Counters();
+  Counters(const Counters&) = delete;
+  Counters(Counters&&) = delete;
+
+  // Parse the counters in the descriptor of every loop that is added to the
+  // table from now on.
+  void start(LoopTable& loops);
+
+  uint32_t getMask(uint32_t slot) const {
+    return this->masks[slot].load(std::memory_order_relaxed);
+  }
+
+  // Open the counter for the calling thread. Returns the file descriptor or
+  // -1 if it could not be opened.
+  int open(Counter counter);
+
+  // The name of the event that was used for the counter. Returns nullptr if
+  // the counter has never been opened or could not be opened.
+  const char* getUsedName(Counter counter) const;
+
+  static const char* getName(Counter counter);
+
+  // Returns NumCounters if the name is not that of a counter.
+  static Counter getCounter(const std::string& name);
+};
+
+// The counters of a single thread. The counters are only opened when a loop
+// that requests them is first entered on the thread.
+class CounterSet {
+public:
+  static const unsigned maxDepth = 256;
+
+private:
+  Counters& counters;
+
+  int fds[NumCounters];
+  perf_event_mmap_page* pages[NumCounters];
+  bool opened[NumCounters];
+
+  // The values of the counters when each active loop was entered. Indexed by
+  // the depth of the loop stack.
+  std::unique_ptr<uint64_t[]> starts;
+
+  // The accumulated value of each counter for each loop. This is only
+  // written by the owning thread. It is allocated the first time any loop
+  // with counters is entered and is never freed because it may be read by
+  // other threads at any time.
+  std::atomic<std::atomic<uint64_t>*> values;
+
+private:
+  void open(Counter counter);
+  uint64_t read(Counter counter);
+  std::atomic<uint64_t>* getValues();
+
+public:
+  explicit CounterSet(Counters& counters);
+  CounterSet(const CounterSet&) = delete;
+  CounterSet(CounterSet&&) = delete;
+
+  void enter(uint32_t slot, unsigned depth) {
+    uint32_t mask = this->counters.getMask(slot);
+    if (mask and depth < CounterSet::maxDepth)
+      this->start(mask, depth);
+  }
+
+  void exit(uint32_t slot, unsigned depth) {
+    uint32_t mask = this->counters.getMask(slot);
+    if (mask and depth < CounterSet::maxDepth)
+      this->stop(slot, mask, depth);
+  }
+
+  void start(uint32_t mask, unsigned depth);
+  void stop(uint32_t slot, uint32_t mask, unsigned depth);
+
+  // Close the counters and clear the accumulated values. This is called in
+  // the child after a fork because the counters that were inherited from the
+  // parent still count the parent's thread. They are opened again when they
+  // are next needed.
+  void reset();
+
+  // Get the accumulated value of the counter for the loop. This may be called
+  // from any thread.
+  uint64_t getValue(uint32_t slot, Counter counter) const;
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_COUNTERS_H
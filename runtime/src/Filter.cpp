@@ -0,0 +1,183 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Filter.h"
+
+#include <fnmatch.h>
+
+#include <cstdio>
+#include <fstream>
+
+namespace lrt {
+
+// Get the field of the descriptor that the rule is matched against.
+static std::string getField(const std::string& desc, Filter::Field field) {
+  switch (field) {
+  case Filter::File: {
+    // Strip the line and column from the location.
+    std::string file = LoopTable::getField(desc, LoopTable::Location);
+    for (unsigned i = 0; i < 2; i++) {
+      size_t colon = file.rfind(':');
+      if (colon != std::string::npos)
+        file.erase(colon);
+    }
+    return file;
+  }
+  case Filter::Function:
+    return LoopTable::getField(desc, LoopTable::Function);
+  case Filter::Name:
+    return LoopTable::getField(desc, LoopTable::Name);
+  }
+  return "";
+}
+
+Filter::Filter() : enableByDefault(true) {
+  for (std::atomic<uint64_t>& word : this->enabled)
+    word.store(0, std::memory_order_relaxed);
+  for (std::atomic<uint64_t>& word : this->suppressed)
+    word.store(0, std::memory_order_relaxed);
+}
+
+bool Filter::parseRule(const std::string& text) {
+  Rule rule;
+  size_t beg = 0;
+  rule.enable = true;
+  if (text[0] == '+' or text[0] == '-') {
+    rule.enable = text[0] == '+';
+    beg = 1;
+  }
+
+  size_t eq = text.find('=', beg);
+  if (eq == std::string::npos)
+    return false;
+
+  std::string field = text.substr(beg, eq - beg);
+  if (field == "file")
+    rule.field = Filter::File;
+  else if (field == "function")
+    rule.field = Filter::Function;
+  else if (field == "name")
+    rule.field = Filter::Name;
+  else
+    return false;
+
+  rule.pattern = text.substr(eq + 1);
+  if (rule.field == Filter::Name) {
+    try {
+      rule.re = std::regex(rule.pattern);
+    } catch (const std::regex_error&) {
+      return false;
+    }
+  }
+
+  if (this->rules.empty())
+    this->enableByDefault = not rule.enable;
+  this->rules.push_back(std::move(rule));
+
+  return true;
+}
+
+bool Filter::parse(const std::string& spec) {
+  bool ok = true;
+  size_t beg = 0;
+  while (beg < spec.size()) {
+    size_t end = spec.find_first_of(" \t\n;", beg);
+    if (end == std::string::npos)
+      end = spec.size();
+    if (end > beg) {
+      std::string text = spec.substr(beg, end - beg);
+      if (not this->parseRule(text)) {
+        std::fprintf(
+            stderr, "loop-runtime: Ignoring bad filter rule %s\n", text.c_str());
+        ok = false;
+      }
+    }
+    beg = end + 1;
+  }
+
+  return ok;
+}
+
+bool Filter::parseFile(const std::string& file) {
+  std::ifstream in(file);
+  if (not in) {
+    std::fprintf(
+        stderr, "loop-runtime: Could not open filter file %s\n", file.c_str());
+    return false;
+  }
+
+  bool ok = true;
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t beg = line.find_first_not_of(" \t");
+    if (beg == std::string::npos or line[beg] == '#')
+      continue;
+    size_t end = line.find_last_not_of(" \t\r");
+    std::string text = line.substr(beg, end - beg + 1);
+    if (not this->parseRule(text)) {
+      std::fprintf(
+          stderr, "loop-runtime: Ignoring bad filter rule %s\n", text.c_str());
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+bool Filter::matches(const Rule& rule, const std::string& desc) const {
+  std::string field = getField(desc, rule.field);
+  if (rule.field == Filter::Name)
+    return std::regex_search(field, rule.re);
+  return fnmatch(rule.pattern.c_str(), field.c_str(), 0) == 0;
+}
+
+void Filter::resolve(LoopTable& loops, uint32_t slot) {
+  const std::string& desc = loops.getDescriptor(slot);
+  bool enable = this->enableByDefault;
+  for (const Rule& rule : this->rules)
+    if (this->matches(rule, desc))
+      enable = rule.enable;
+
+  // The bit must be set before the slot is visible to other threads. The
+  // loop table publishes the slot with release semantics after this returns.
+  if (enable)
+    this->enabled[slot / Filter::bitsPerWord].fetch_or(
+        1ULL << (slot % Filter::bitsPerWord), std::memory_order_relaxed);
+}
+
+bool Filter::suppress(uint32_t slot) {
+  // The suppressed bit is set first so that a sentinel that finds the loop
+  // disabled will know to check whether it is still active.
+  uint64_t bit = 1ULL << (slot % Filter::bitsPerWord);
+  uint64_t old = this->suppressed[slot / Filter::bitsPerWord].fetch_or(
+      bit, std::memory_order_relaxed);
+  if (old & bit)
+    return false;
+
+  this->enabled[slot / Filter::bitsPerWord].fetch_and(
+      ~bit, std::memory_order_release);
+  return true;
+}
+
+void Filter::start(LoopTable& loops) {
+  loops.onInsert([this, &loops](uint32_t slot) { this->resolve(loops, slot); });
+}
+
+bool Filter::empty() const {
+  return this->rules.empty();
+}
+
+} // namespace lrt
@@ -0,0 +1,120 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_FILTER_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_FILTER_H
+
+#include <atomic>
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "LoopTable.h"
+
+namespace lrt {
+
+// Selects the loops that are instrumented. The filter is a sequence of rules,
+// each of which is of the form
+//
+//     [+|-]<field>=<pattern>
+//
+// where field is one of
+//
+//     file       A glob that is matched against the file containing the loop.
+//     function   A glob that is matched against the enclosing function.
+//     name       A regular expression that is searched for in the name of the
+//                loop or region (only loops from instrument have a name).
+//
+// A rule that starts with '-' disables the loops that it matches. Any other
+// rule enables them. The last rule that matches a loop wins. If the first rule
+// enables loops, then loops that do not match any rule are disabled,
+// otherwise they are enabled.
+//
+// The filter is evaluated once for each loop when it is first added to the
+// loop table and the result is kept in a bitset indexed by slot. The
+// sentinels only ever test a bit. The runtime may also clear the bit of a loop
+// later, if it turns out to be too fine-grained to be measured.
+class Filter {
+public:
+  enum Field {
+    File,
+    Function,
+    Name,
+  };
+
+private:
+  struct Rule {
+    bool enable;
+    Field field;
+    std::string pattern;
+    std::regex re;
+  };
+
+  std::vector<Rule> rules;
+  bool enableByDefault;
+
+  static const unsigned bitsPerWord = 64;
+  std::atomic<uint64_t> enabled[LoopTable::capacity / bitsPerWord];
+
+  // The loops that were enabled by the rules but have since been suppressed.
+  std::atomic<uint64_t> suppressed[LoopTable::capacity / bitsPerWord];
+
+private:
+  bool parseRule(const std::string& text);
+  bool matches(const Rule& rule, const std::string& desc) const;
+  void resolve(LoopTable& loops, uint32_t slot);
+
+public:
+  Filter();
+  Filter(const Filter&) = delete;
+  Filter(Filter&&) = delete;
+
+  // Add the rules in spec. The rules are separated by whitespace or
+  // semicolons. Returns false if any of the rules could not be parsed. Those
+  // rules will be ignored.
+  bool parse(const std::string& spec);
+
+  // Add the rules in the file, one per line. Blank lines and lines starting
+  // with '#' are ignored.
+  bool parseFile(const std::string& file);
+
+  // Resolve the filter for every loop that is added to the table from now on.
+  // This must be called before any loop is added.
+  void start(LoopTable& loops);
+
+  bool empty() const;
+
+  // Disable a loop that was enabled by the rules. Returns false if the loop
+  // had already been suppressed.
+  bool suppress(uint32_t slot);
+
+  bool isEnabled(uint32_t slot) const {
+    uint64_t word = this->enabled[slot / Filter::bitsPerWord].load(
+        std::memory_order_relaxed);
+    return word & (1ULL << (slot % Filter::bitsPerWord));
+  }
+
+  bool isSuppressed(uint32_t slot) const {
+    uint64_t word = this->suppressed[slot / Filter::bitsPerWord].load(
+        std::memory_order_relaxed);
+    return word & (1ULL << (slot % Filter::bitsPerWord));
+  }
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_FILTER_H
@@ -0,0 +1,118 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Imbalance.h"
+#include "LoopTable.h"
+
+#include <algorithm>
+
+namespace lrt {
+
+Imbalance::Imbalance() {
+  this->allocate();
+}
+
+void Imbalance::allocate() {
+  this->regions.reset(new Region[LoopTable::capacity]);
+  for (uint32_t slot = 0; slot < LoopTable::capacity; slot++) {
+    this->regions[slot].active = 0;
+    this->regions[slot].start = 0;
+    this->regions[slot].balance = {0, 0, 0, 0, 0, 0, 0};
+  }
+}
+
+Imbalance::Busy* Imbalance::findBusy(Region& region, unsigned tid) {
+  // There are rarely more than a few dozen threads in an epoch.
+  for (Busy& busy : region.threads)
+    if (busy.tid == tid)
+      return &busy;
+  return nullptr;
+}
+
+void Imbalance::enter(uint32_t slot, unsigned tid, uint64_t start) {
+  Region& region = this->regions[slot];
+  std::lock_guard<std::mutex> guard(region.lock);
+  if (not region.active) {
+    region.start = start;
+    region.threads.clear();
+  }
+  region.active++;
+
+  Busy* busy = Imbalance::findBusy(region, tid);
+  if (not busy) {
+    region.threads.push_back({tid, 0, 0, 0});
+    busy = &region.threads.back();
+  }
+  busy->active++;
+}
+
+void Imbalance::exit(uint32_t slot, unsigned tid, uint64_t end, uint64_t time) {
+  Region& region = this->regions[slot];
+  std::lock_guard<std::mutex> guard(region.lock);
+
+  // The loop may have been entered before the current epoch started, for
+  // instance in the parent of a forked process, or its entry may have been
+  // skipped.
+  Busy* busy = Imbalance::findBusy(region, tid);
+  if (not busy or not busy->active)
+    return;
+
+  busy->active--;
+  busy->time += time;
+  busy->lastExit = end;
+
+  region.active--;
+  if (not region.active)
+    this->close(region, end);
+}
+
+void Imbalance::close(Region& region, uint64_t end) {
+  // An epoch with a single thread is a serial execution of the loop.
+  size_t n = region.threads.size();
+  if (n < 2)
+    return;
+
+  uint64_t sum = 0, most = 0, least = UINT64_MAX, wait = 0;
+  for (const Busy& busy : region.threads) {
+    sum += busy.time;
+    most = std::max(most, busy.time);
+    least = std::min(least, busy.time);
+    wait += end - busy.lastExit;
+  }
+
+  Balance& balance = region.balance;
+  balance.epochs++;
+  balance.maxThreads = std::max<uint64_t>(balance.maxThreads, n);
+  balance.elapsed += end - region.start;
+  balance.critical += most;
+  balance.mean += sum / n;
+  balance.spread += most - least;
+  balance.wait += wait;
+}
+
+Balance Imbalance::getBalance(uint32_t slot) {
+  Region& region = this->regions[slot];
+  std::lock_guard<std::mutex> guard(region.lock);
+  return region.balance;
+}
+
+void Imbalance::forked() {
+  // The old regions cannot be destroyed because their locks may be held.
+  this->regions.release();
+  this->allocate();
+}
+
+} // namespace lrt
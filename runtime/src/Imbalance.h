@@ -0,0 +1,110 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_IMBALANCE_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_IMBALANCE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace lrt {
+
+// The load balance of a loop over all the epochs in which it ran on more than
+// one thread. The times are in clock ticks.
+//
+//     epochs       The number of epochs.
+//     maxThreads   The largest number of threads in any epoch.
+//     elapsed      The time from the first entry to the last exit of each
+//                  epoch.
+//     critical     The time of the busiest thread in each epoch. This is the
+//                  critical path through the epoch.
+//     mean         The mean time of the threads in each epoch.
+//     spread       The difference between the busiest and least busy thread
+//                  in each epoch.
+//     wait         The time from each thread's last exit to the end of the
+//                  epoch, i.e. the time that the threads would spend waiting
+//                  at a barrier at the end of the region.
+//
+// All but maxThreads are summed over the epochs.
+struct Balance {
+  uint64_t epochs;
+  uint64_t maxThreads;
+  uint64_t elapsed;
+  uint64_t critical;
+  uint64_t mean;
+  uint64_t spread;
+  uint64_t wait;
+};
+
+// Groups the instances of a loop that run concurrently on different threads
+// into epochs. An epoch starts when a thread enters the loop while no other
+// thread is in it and ends when the last thread leaves it. For a loop in an
+// OpenMP parallel region or one that is run by the workers of a thread pool,
+// each epoch is one execution of the region.
+//
+// This needs a lock for every entry and exit, so it is only meant for loops
+// that are entered once, or a few times, by each thread in a region.
+class Imbalance {
+private:
+  // The time that a thread spent in the loop in the current epoch.
+  struct Busy {
+    unsigned tid;
+    uint32_t active;
+    uint64_t time;
+    uint64_t lastExit;
+  };
+
+  struct Region {
+    std::mutex lock;
+
+    // The number of instances of the loop that are currently running.
+    uint32_t active;
+    uint64_t start;
+    std::vector<Busy> threads;
+
+    Balance balance;
+  };
+
+  std::unique_ptr<Region[]> regions;
+
+private:
+  void allocate();
+  static Busy* findBusy(Region& region, unsigned tid);
+  void close(Region& region, uint64_t end);
+
+public:
+  Imbalance();
+  Imbalance(const Imbalance&) = delete;
+  Imbalance(Imbalance&&) = delete;
+
+  void enter(uint32_t slot, unsigned tid, uint64_t start);
+
+  // The time is the corrected time of this instance of the loop. An exit by
+  // a thread that did not enter the loop in the current epoch is ignored.
+  void exit(uint32_t slot, unsigned tid, uint64_t end, uint64_t time);
+
+  Balance getBalance(uint32_t slot);
+
+  // Called in the child after a fork. The locks may have been held by
+  // threads that do not exist in the child, so everything is discarded.
+  void forked();
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_IMBALANCE_H
@@ -0,0 +1,41 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Lines.h"
+
+#include <string>
+
+namespace lrt {
+
+Lines::Lines() {
+  for (std::atomic<uint64_t>& word : this->timed)
+    word.store(0, std::memory_order_relaxed);
+}
+
+void Lines::resolve(uint32_t slot) {
+  std::string value;
+  if (not LoopTable::getOption(this->lines.getDescriptor(slot), "time", value))
+    return;
+
+  this->timed[slot / Lines::bitsPerWord].fetch_or(
+      1ULL << (slot % Lines::bitsPerWord), std::memory_order_relaxed);
+}
+
+void Lines::start() {
+  this->lines.onInsert([this](uint32_t slot) { this->resolve(slot); });
+}
+
+} // namespace lrt
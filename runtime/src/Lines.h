@@ -0,0 +1,97 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_LINES_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_LINES_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "LoopTable.h"
+
+namespace lrt {
+
+// The hits of a single line as seen by a single thread. Like LoopStats, these
+// are only written by the owning thread. first and last are the times, in
+// clock ticks, of the first and last hit. They are 0 unless the line asked for
+// the time to be recorded.
+struct LineStats {
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> first;
+  std::atomic<uint64_t> last;
+
+  void hit(uint64_t time) {
+    const auto relaxed = std::memory_order_relaxed;
+    uint64_t hits = this->hits.load(relaxed);
+    this->hits.store(hits + 1, relaxed);
+    if (time) {
+      if (not hits)
+        this->first.store(time, relaxed);
+      this->last.store(time, relaxed);
+    }
+  }
+
+  void reset() {
+    const auto relaxed = std::memory_order_relaxed;
+    this->hits.store(0, relaxed);
+    this->first.store(0, relaxed);
+    this->last.store(0, relaxed);
+  }
+};
+
+// Counts how often each statement annotated with the line directive of the
+// instrument plugin is reached. The descriptor of a line has the same form as
+// that of a loop, but the lines are kept in a table of their own so that
+// they do not take up slots that are meant for loops. A hit is a lookup of
+// the descriptor and an increment of a counter that belongs to the thread,
+// so lines are cheap enough to leave in production code. The clock is only
+// read for lines with the time option.
+class Lines {
+private:
+  static const unsigned bitsPerWord = 64;
+
+  LoopTable lines;
+  std::atomic<uint64_t> timed[LoopTable::capacity / bitsPerWord];
+
+private:
+  void resolve(uint32_t slot);
+
+public:
+  Lines();
+  Lines(const Lines&) = delete;
+  Lines(Lines&&) = delete;
+
+  // Check the options of every line that is added to the table from now on.
+  void start();
+
+  LoopTable& getTable() {
+    return this->lines;
+  }
+
+  const LoopTable& getTable() const {
+    return this->lines;
+  }
+
+  bool isTimed(uint32_t slot) const {
+    const auto relaxed = std::memory_order_relaxed;
+    uint64_t word = this->timed[slot / Lines::bitsPerWord].load(relaxed);
+    return word & (1ULL << (slot % Lines::bitsPerWord));
+  }
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_LINES_H
@@ -0,0 +1,166 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "LoopTable.h"
+
+#include <limits>
+
+namespace lrt {
+
+LoopTable::LoopTable() : numLoops(0) {
+  for (Bucket& bucket : this->table)
+    bucket.key.store(nullptr, std::memory_order_relaxed);
+}
+
+uint32_t LoopTable::hash(const char* desc) {
+  // The descriptors are string literals and are likely to be at least 8-byte
+  // aligned, so the low bits are not of much use.
+  uintptr_t p = reinterpret_cast<uintptr_t>(desc) >> 3;
+  return static_cast<uint32_t>((p * 0x9e3779b97f4a7c15ULL) >> 32)
+         % LoopTable::buckets;
+}
+
+uint32_t LoopTable::insert(const char* desc) {
+  std::lock_guard<std::mutex> guard(this->lock);
+
+  // Find the slot for the descriptor, creating one if it has not been seen
+  // before under any pointer.
+  uint32_t slot = LoopTable::invalid;
+  auto it = this->known.find(desc);
+  if (it != this->known.end()) {
+    slot = it->second;
+  } else {
+    slot = this->numLoops.load(std::memory_order_relaxed);
+    if (slot == LoopTable::capacity)
+      return LoopTable::invalid;
+    this->descs[slot] = desc;
+    this->ids[slot] = LoopTable::getId(this->descs[slot]);
+    this->known[desc] = slot;
+    for (const Callback& callback : this->callbacks)
+      callback(slot);
+    this->numLoops.store(slot + 1, std::memory_order_release);
+  }
+
+  // Another thread may have added this pointer while we were waiting for the
+  // lock.
+  uint32_t b = LoopTable::hash(desc);
+  for (uint32_t i = 0; i < LoopTable::buckets; i++) {
+    Bucket& bucket = this->table[b];
+    const char* key = bucket.key.load(std::memory_order_relaxed);
+    if (key == desc) {
+      return slot;
+    } else if (not key) {
+      bucket.slot = slot;
+      bucket.key.store(desc, std::memory_order_release);
+      return slot;
+    }
+    b = (b + 1) % LoopTable::buckets;
+  }
+
+  // There are twice as many buckets as slots, so this can only happen if the
+  // same loop has been passed using a very large number of distinct pointers.
+  // The slot is valid, but it will be looked up on the slow path every time.
+  return slot;
+}
+
+void LoopTable::onInsert(const Callback& callback) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  this->callbacks.push_back(callback);
+}
+
+void LoopTable::lockForFork() {
+  this->lock.lock();
+}
+
+void LoopTable::unlockAfterFork() {
+  this->lock.unlock();
+}
+
+uint32_t LoopTable::size() const {
+  return this->numLoops.load(std::memory_order_acquire);
+}
+
+const std::string& LoopTable::getDescriptor(uint32_t slot) const {
+  return this->descs[slot];
+}
+
+uint64_t LoopTable::getId(uint32_t slot) const {
+  return this->ids[slot];
+}
+
+uint64_t LoopTable::getId(const std::string& desc) {
+  // Only the fields that say where the loop is are hashed. The counters, the
+  // cost and most of the options change when the loop or its directive is
+  // edited, but it is still the same loop. The function and chunk options are
+  // kept because the chunks of an OpenMP loop have the same location as the
+  // loop itself.
+  std::string value;
+  std::string key = LoopTable::getField(desc, LoopTable::Location) + "|"
+                    + LoopTable::getField(desc, LoopTable::Function) + "|"
+                    + LoopTable::getField(desc, LoopTable::Name);
+  if (LoopTable::getOption(desc, "function", value))
+    key += "|function";
+  else if (LoopTable::getOption(desc, "chunk", value))
+    key += "|chunk";
+
+  // 64-bit FNV-1a.
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (char c : key) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+std::string LoopTable::getField(const std::string& desc, Field field) {
+  size_t beg = 0;
+  for (unsigned i = 0; i < field; i++) {
+    beg = desc.find('|', beg);
+    if (beg == std::string::npos)
+      return "";
+    beg++;
+  }
+
+  size_t end = desc.find('|', beg);
+  if (end == std::string::npos)
+    return desc.substr(beg);
+  return desc.substr(beg, end - beg);
+}
+
+bool LoopTable::getOption(const std::string& desc,
+                          const std::string& option,
+                          std::string& value) {
+  std::string options = LoopTable::getField(desc, LoopTable::Options);
+  size_t beg = 0;
+  while (beg < options.size()) {
+    size_t end = options.find(',', beg);
+    if (end == std::string::npos)
+      end = options.size();
+    std::string item = options.substr(beg, end - beg);
+    beg = end + 1;
+
+    size_t eq = item.find('=');
+    if (item.substr(0, eq) != option)
+      continue;
+    value = eq == std::string::npos ? "" : item.substr(eq + 1);
+    return true;
+  }
+  return false;
+}
+
+const uint32_t LoopTable::invalid = std::numeric_limits<uint32_t>::max();
+
+} // namespace lrt
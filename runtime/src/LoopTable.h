@@ -0,0 +1,166 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_LOOP_TABLE_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_LOOP_TABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace lrt {
+
+// The plugins pass a descriptor string to each sentinel. The descriptor is a
+// string literal of the form
+//
+//     <file>:<line>:<column>|<function>|<name>|<counters>|<cost>|<options>
+//
+// that uniquely identifies the loop in the program. Only the location is
+// required. The function and name are used to filter the loops. The counters
+// are a comma-separated list of the performance counters to read when the
+// loop is entered and exited. The cost is the static estimate of the work
+// done in each iteration of the loop (see Roofline.h). The options are a
+// comma-separated list of the other things that the runtime should do for
+// the loop. Each is either a name or of the form <name>=<value>. This class
+// maps each descriptor to a dense slot number that is used to index all the
+// per-loop data in the runtime.
+//
+// The same loop may be passed to the runtime using different pointers if, for
+// instance, the compiler did not merge identical string literals. In that
+// case, all the pointers will be mapped to the same slot.
+class LoopTable {
+public:
+  using Callback = std::function<void(uint32_t)>;
+
+  // The fields of a descriptor.
+  enum Field {
+    Location,
+    Function,
+    Name,
+    Counters,
+    Cost,
+    Options,
+  };
+
+  // The maximum number of distinct loops that can be tracked.
+  static const uint32_t capacity = 4096;
+
+  // Returned when the table is full and a new loop cannot be added.
+  static const uint32_t invalid;
+
+private:
+  // Open-addressed hash table from the descriptor pointer to the slot. This is
+  // searched without a lock. The slot is always written before the key is
+  // published, so a reader that sees the key will also see the slot. The slot
+  // is kept next to the key so that a lookup that hits in the first bucket
+  // only touches one cache line.
+  struct Bucket {
+    std::atomic<const char*> key;
+    uint32_t slot;
+  };
+
+  static const uint32_t buckets = 2 * capacity;
+  Bucket table[buckets];
+
+  // Everything below is only accessed on the slow path when a loop is seen
+  // for the first time.
+  std::mutex lock;
+  std::map<std::string, uint32_t> known;
+  std::atomic<uint32_t> numLoops;
+
+  // These are indexed by slot. An entry is written exactly once, before
+  // numLoops is incremented past it, so readers that have checked the slot
+  // against size() do not need the lock.
+  std::string descs[capacity];
+  uint64_t ids[capacity];
+
+  // Called whenever a new slot is created. This is called with the lock held,
+  // so it should not call back into the table.
+  std::vector<Callback> callbacks;
+
+private:
+  static uint32_t hash(const char* desc);
+  uint32_t insert(const char* desc);
+
+public:
+  LoopTable();
+  LoopTable(const LoopTable&) = delete;
+  LoopTable(LoopTable&&) = delete;
+
+  // Get the slot for the descriptor if it has been seen before under the
+  // same pointer. Returns LoopTable::invalid otherwise.
+  uint32_t find(const char* desc) const {
+    uint32_t b = LoopTable::hash(desc);
+    for (uint32_t i = 0; i < LoopTable::buckets; i++) {
+      const Bucket& bucket = this->table[b];
+      const char* key = bucket.key.load(std::memory_order_acquire);
+      if (key == desc)
+        return bucket.slot;
+      else if (not key)
+        break;
+      b = (b + 1) % LoopTable::buckets;
+    }
+    return LoopTable::invalid;
+  }
+
+  // Get the slot for the descriptor, adding it to the table if it has not
+  // been seen before. Returns LoopTable::invalid if the table is full.
+  uint32_t lookup(const char* desc) {
+    uint32_t slot = this->find(desc);
+    if (slot != LoopTable::invalid)
+      return slot;
+    return this->insert(desc);
+  }
+
+  // Register a function to be called each time a new loop is added to the
+  // table.
+  void onInsert(const Callback& callback);
+
+  // Hold the lock across a fork() so that the child does not inherit it
+  // while it is held by a thread that does not exist in the child.
+  void lockForFork();
+  void unlockAfterFork();
+
+  uint32_t size() const;
+  const std::string& getDescriptor(uint32_t slot) const;
+
+  // A stable identifier for the loop. This is derived from the location,
+  // function and name in the descriptor, not the slot, and so will be the
+  // same across runs of the same binary and across different binaries built
+  // from the same source, even if the cost or the clauses of the loop change.
+  uint64_t getId(uint32_t slot) const;
+
+  // Compute the stable identifier for a descriptor.
+  static uint64_t getId(const std::string& desc);
+
+  // Get a field of the descriptor. Returns the empty string if the field is
+  // not present.
+  static std::string getField(const std::string& desc, Field field);
+
+  // Check if the option is given in the descriptor. If it is, the value is
+  // set to whatever follows the = or to the empty string if there is none.
+  static bool getOption(const std::string& desc,
+                        const std::string& option,
+                        std::string& value);
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_LOOP_TABLE_H
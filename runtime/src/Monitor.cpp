@@ -0,0 +1,146 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Monitor.h"
+#include "Clock.h"
+#include "Runtime.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace lrt {
+
+Monitor::Monitor(Runtime& runtime, unsigned interval)
+    : runtime(runtime), interval(interval ? interval : 1),
+      name(shm::getName(getpid())), header(nullptr),
+      size(shm::getSize(LoopTable::capacity)), running(false) {
+  ;
+}
+
+Monitor::~Monitor() {
+  if (this->thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> guard(this->lock);
+      this->running = false;
+    }
+    this->cv.notify_one();
+    this->thread.join();
+  }
+
+  if (this->header) {
+    munmap(this->header, this->size);
+    shm_unlink(this->name.c_str());
+  }
+}
+
+bool Monitor::start() {
+  int fd = shm_open(this->name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::fprintf(stderr,
+                 "loop-runtime: Could not create shared memory segment %s\n",
+                 this->name.c_str());
+    return false;
+  }
+
+  if (ftruncate(fd, this->size) != 0) {
+    close(fd);
+    shm_unlink(this->name.c_str());
+    return false;
+  }
+
+  void* addr
+      = mmap(nullptr, this->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    shm_unlink(this->name.c_str());
+    return false;
+  }
+
+  // The segment is zero-filled by ftruncate, so only the header needs to be
+  // filled in. The magic number is written last so that a reader that attaches
+  // too early will not mistake a partially initialized header for a valid one.
+  this->header = static_cast<shm::Header*>(addr);
+  this->header->version = shm::version;
+  this->header->capacity = LoopTable::capacity;
+  this->header->pid = getpid();
+  this->header->interval = this->interval;
+  std::atomic_thread_fence(std::memory_order_release);
+  this->header->magic = shm::magic;
+
+  this->running = true;
+  this->thread = std::thread(&Monitor::run, this);
+
+  return true;
+}
+
+void Monitor::publish() {
+  const auto relaxed = std::memory_order_relaxed;
+  LoopTable& loops = this->runtime.getLoops();
+  shm::Slot* slots = shm::getSlots(this->header);
+
+  std::vector<LoopSummary> summaries = this->runtime.collect();
+  uint32_t published = this->header->numLoops.load(relaxed);
+
+  // The descriptors of any new loops must be visible before the number of
+  // loops is updated.
+  for (uint32_t slot = published; slot < summaries.size(); slot++) {
+    std::strncpy(slots[slot].desc,
+                 loops.getDescriptor(slot).c_str(),
+                 shm::descLen - 1);
+  }
+  this->header->numLoops.store(summaries.size(), std::memory_order_release);
+
+  for (uint32_t slot = 0; slot < summaries.size(); slot++) {
+    shm::Slot& dst = slots[slot];
+    const LoopSummary& src = summaries[slot];
+
+    // Nothing to do if the loop has not run since the last time.
+    if (dst.count.load(relaxed) == src.count)
+      continue;
+
+    uint32_t seq = dst.seq.load(relaxed);
+    dst.seq.store(seq + 1, relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    dst.count.store(src.count, relaxed);
+    dst.total.store(src.total, relaxed);
+    dst.self.store(src.self, relaxed);
+    dst.lastSeen.store(src.lastSeen, relaxed);
+    dst.seq.store(seq + 2, std::memory_order_release);
+  }
+
+  this->header->published.store(Clock::monotonic(),
+                                std::memory_order_release);
+}
+
+void Monitor::run() {
+  std::unique_lock<std::mutex> guard(this->lock);
+  while (this->running) {
+    guard.unlock();
+    this->publish();
+    guard.lock();
+    this->cv.wait_for(guard,
+                      std::chrono::milliseconds(this->interval),
+                      [this]() { return not this->running; });
+  }
+}
+
+} // namespace lrt
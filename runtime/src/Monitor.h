@@ -0,0 +1,66 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_MONITOR_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_MONITOR_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Shm.h"
+
+namespace lrt {
+
+class Runtime;
+
+// Publishes the per-loop aggregates to a POSIX shared memory segment at
+// regular intervals. This runs on its own thread, so the threads that execute
+// the loops never touch the shared memory segment. The segment is removed
+// when the monitor is destroyed.
+class Monitor {
+private:
+  Runtime& runtime;
+  unsigned interval;
+
+  std::string name;
+  shm::Header* header;
+  size_t size;
+
+  std::mutex lock;
+  std::condition_variable cv;
+  bool running;
+  std::thread thread;
+
+private:
+  void publish();
+  void run();
+
+public:
+  Monitor(Runtime& runtime, unsigned interval);
+  Monitor(const Monitor&) = delete;
+  Monitor(Monitor&&) = delete;
+  ~Monitor();
+
+  // Create the shared memory segment and start the publishing thread. Returns
+  // false if the segment could not be created.
+  bool start();
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_MONITOR_H
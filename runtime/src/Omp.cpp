@@ -0,0 +1,167 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+
+#include "Omp.h"
+#include "Runtime.h"
+
+#include <cstring>
+#include <vector>
+
+#if __has_include(<omp-tools.h>)
+#include <omp-tools.h>
+#define LOOP_RUNTIME_OMPT 1
+#endif
+
+extern "C" void __enterLoop(const char* loop);
+extern "C" void __exitLoop(const char* loop);
+
+namespace lrt {
+
+Omp::Omp() {
+  for (std::atomic<const char*>& desc : this->chunks)
+    desc.store(nullptr, std::memory_order_relaxed);
+}
+
+std::string Omp::getChunkDescriptor(const std::string& desc) {
+  std::vector<std::string> fields;
+  for (unsigned i = LoopTable::Location; i <= LoopTable::Options; i++)
+    fields.push_back(
+        LoopTable::getField(desc, static_cast<LoopTable::Field>(i)));
+
+  // The omp option is replaced so that the chunks are not themselves taken to
+  // be an OpenMP loop. The other options still apply.
+  std::string options = fields[LoopTable::Options];
+  std::string replaced;
+  size_t beg = 0;
+  while (beg < options.size()) {
+    size_t end = options.find(',', beg);
+    if (end == std::string::npos)
+      end = options.size();
+    std::string item = options.substr(beg, end - beg);
+    beg = end + 1;
+    if (item != "omp")
+      replaced += item + ",";
+  }
+  fields[LoopTable::Options] = replaced + "chunk";
+
+  std::string chunks;
+  for (unsigned i = 0; i < fields.size(); i++)
+    chunks += (i ? "|" : "") + fields[i];
+  return chunks;
+}
+
+void Omp::resolve(LoopTable& loops, uint32_t slot) {
+  const std::string& desc = loops.getDescriptor(slot);
+  std::string value;
+  if (not LoopTable::getOption(desc, "omp", value))
+    return;
+
+  this->chunks[slot].store(strdup(Omp::getChunkDescriptor(desc).c_str()),
+                           std::memory_order_release);
+}
+
+void Omp::start(LoopTable& loops) {
+  loops.onInsert([this, &loops](uint32_t slot) { this->resolve(loops, slot); });
+}
+
+#ifdef LOOP_RUNTIME_OMPT
+
+// Called on the thread that encounters a parallel region before the team
+// is started. For a combined directive such as parallel for, the innermost
+// loop on the encountering thread is the OpenMP loop itself, but the other
+// threads in the team never enter it. Its chunk descriptor, if any, is kept
+// with the region so that they can find it (see onWork()).
+static void onParallelBegin(ompt_data_t*,
+                            const ompt_frame_t*,
+                            ompt_data_t* parallel,
+                            unsigned,
+                            int,
+                            const void*) {
+  Allocs::Entered entered;
+  Runtime& runtime = getRuntime();
+  uint32_t slot = runtime.getThreadState().getInnermost();
+  const char* chunks = nullptr;
+  if (slot != LoopTable::invalid)
+    chunks = runtime.getOmp().getChunks(slot);
+  parallel->ptr = const_cast<char*>(chunks);
+}
+
+// Called on each thread at the start and end of its share of a worksharing
+// construct. When the worksharing directive is nested in a parallel region,
+// every thread in the team runs its sentinels, so it is the innermost loop on
+// the thread when its share starts. Otherwise, this is a combined directive
+// and the loop is the one that was recorded when the region started. The
+// chunk descriptor is kept with the implicit task so that the share is
+// exited with the same descriptor with which it was entered.
+static void onWork(ompt_work_t type,
+                   ompt_scope_endpoint_t endpoint,
+                   ompt_data_t* parallel,
+                   ompt_data_t* task,
+                   uint64_t,
+                   const void*) {
+  if (type != ompt_work_loop or not task)
+    return;
+
+  Allocs::Entered entered;
+
+  if (endpoint == ompt_scope_begin) {
+    Runtime& runtime = getRuntime();
+    uint32_t slot = runtime.getThreadState().getInnermost();
+    const char* chunks = nullptr;
+    if (slot != LoopTable::invalid)
+      chunks = runtime.getOmp().getChunks(slot);
+    if (not chunks and parallel)
+      chunks = static_cast<const char*>(parallel->ptr);
+    task->ptr = const_cast<char*>(chunks);
+    if (chunks)
+      __enterLoop(chunks);
+  } else if (endpoint == ompt_scope_end and task->ptr) {
+    __exitLoop(static_cast<const char*>(task->ptr));
+    task->ptr = nullptr;
+  }
+}
+
+static int initialize(ompt_function_lookup_t lookup, int, ompt_data_t*) {
+  auto set = reinterpret_cast<ompt_set_callback_t>(lookup("ompt_set_callback"));
+  if (not set)
+    return 0;
+
+  set(ompt_callback_parallel_begin,
+      reinterpret_cast<ompt_callback_t>(onParallelBegin));
+  set(ompt_callback_work, reinterpret_cast<ompt_callback_t>(onWork));
+  return 1;
+}
+
+static void finalize(ompt_data_t*) {
+  ;
+}
+
+#endif // LOOP_RUNTIME_OMPT
+
+} // namespace lrt
+
+#ifdef LOOP_RUNTIME_OMPT
+
+// This is looked up by the OpenMP runtime when it is initialized. Returning
+// a result activates the tool.
+extern "C" ompt_start_tool_result_t* ompt_start_tool(unsigned, const char*) {
+  static ompt_start_tool_result_t result
+      = {lrt::initialize, lrt::finalize, {0}};
+  return &result;
+}
+
+#endif // LOOP_RUNTIME_OMPT
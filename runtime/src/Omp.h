@@ -0,0 +1,77 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_OMP_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_OMP_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "LoopTable.h"
+
+namespace lrt {
+
+// Times the threads that execute an OpenMP worksharing loop. The plugins
+// demarcate the directive of such a loop rather than the loop itself, since
+// the loop is outlined into a function that is run by every thread in the
+// team. The descriptor of the directive has the omp option. For a combined
+// directive such as parallel for, its sentinels are only called on the thread
+// that encounters it, so its time is that of the whole parallel loop. A
+// worksharing directive that is nested in a parallel region is encountered by
+// every thread in the team, so its time is that of each thread, including
+// the wait at the barrier at its end.
+//
+// Each such loop also has a second descriptor for its chunks. This is the
+// same as that of the loop, but with the chunk option in place of omp. If the
+// OpenMP runtime supports the OpenMP tools interface (OMPT), the chunks that
+// each thread executes are reported by the OpenMP runtime at the start and
+// end of the worksharing construct on that thread. These are passed to the
+// sentinels using the chunk descriptor, so the chunks are aggregated for each
+// thread just like any other loop. The loop is the innermost one on the thread
+// when its share starts if that is an OpenMP loop. Otherwise, it is the one
+// that was innermost on the encountering thread when the parallel region
+// started, which is the case for a combined directive.
+class Omp {
+private:
+  // Indexed by slot. The descriptor of the chunks of the loop, or null if it
+  // is not an OpenMP loop. These are never freed.
+  std::atomic<const char*> chunks[LoopTable::capacity];
+
+private:
+  void resolve(LoopTable& loops, uint32_t slot);
+
+public:
+  Omp();
+  Omp(const Omp&) = delete;
+  Omp(Omp&&) = delete;
+
+  // Create the chunk descriptor for every OpenMP loop that is added to the
+  // table from now on.
+  void start(LoopTable& loops);
+
+  const char* getChunks(uint32_t slot) const {
+    return this->chunks[slot].load(std::memory_order_acquire);
+  }
+
+  // Get the chunk descriptor of an OpenMP loop from its descriptor.
+  static std::string getChunkDescriptor(const std::string& desc);
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_OMP_H
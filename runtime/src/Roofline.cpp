@@ -0,0 +1,98 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Roofline.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace lrt {
+
+Roofline::Roofline(uint64_t peakFlops, uint64_t peakBytes)
+    : peakFlops(peakFlops), peakBytes(peakBytes) {
+  // The peak rates are only useful together.
+  if (not this->peakFlops or not this->peakBytes)
+    this->peakFlops = this->peakBytes = 0;
+}
+
+void Roofline::resolve(LoopTable& loops, uint32_t slot) {
+  this->costs[slot] = Roofline::parse(
+      LoopTable::getField(loops.getDescriptor(slot), LoopTable::Cost));
+}
+
+void Roofline::start(LoopTable& loops) {
+  loops.onInsert([this, &loops](uint32_t slot) { this->resolve(loops, slot); });
+}
+
+const LoopCost& Roofline::getCost(uint32_t slot) const {
+  return this->costs[slot];
+}
+
+const char* Roofline::getBound(double intensity) const {
+  if (not this->peakFlops)
+    return "-";
+
+  double ridge = static_cast<double>(this->peakFlops) / this->peakBytes;
+  return intensity < ridge ? "memory" : "compute";
+}
+
+double Roofline::getAttainable(double intensity) const {
+  return std::min(static_cast<double>(this->peakFlops),
+                  intensity * this->peakBytes);
+}
+
+LoopCost Roofline::parse(const std::string& field) {
+  LoopCost cost = {false, 0, 0, 0, 0};
+  unsigned seen = 0;
+  const unsigned required = 0x7;
+  size_t beg = 0;
+  while (beg < field.size()) {
+    size_t end = field.find(',', beg);
+    if (end == std::string::npos)
+      end = field.size();
+    std::string item = field.substr(beg, end - beg);
+    beg = end + 1;
+
+    size_t eq = item.find('=');
+    if (eq == std::string::npos)
+      return cost;
+    std::string key = item.substr(0, eq);
+    std::string val = item.substr(eq + 1);
+    char* last = nullptr;
+    uint64_t value = std::strtoull(val.c_str(), &last, 10);
+    if (val.empty() or *last)
+      return cost;
+
+    if (key == "flops") {
+      cost.flops = value;
+      seen |= 0x1;
+    } else if (key == "loads") {
+      cost.loads = value;
+      seen |= 0x2;
+    } else if (key == "stores") {
+      cost.stores = value;
+      seen |= 0x4;
+    } else if (key == "trips") {
+      cost.trips = value;
+    }
+  }
+
+  // The trip count is optional, but everything else must be present.
+  cost.known = (seen & required) == required;
+  return cost;
+}
+
+} // namespace lrt
@@ -0,0 +1,88 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_ROOFLINE_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_ROOFLINE_H
+
+#include <cstdint>
+#include <string>
+
+#include "LoopTable.h"
+
+namespace lrt {
+
+// The static estimate of the work done in a single iteration of a loop. This
+// is computed by the plugin and passed in the cost field of the descriptor.
+// The loads and stores are in bytes. The trip count is 0 if it was not known
+// at compile time.
+struct LoopCost {
+  bool known;
+  uint64_t flops;
+  uint64_t loads;
+  uint64_t stores;
+  uint64_t trips;
+};
+
+// Places loops on a roofline using the static cost of each loop. The
+// arithmetic intensity of a loop, in floating point operations per byte, only
+// depends on the cost of an iteration. If the peak rates of the machine are
+// known, a loop whose intensity is below the ridge point, where the two
+// roofs meet, is bound by memory bandwidth and one above it is bound by
+// compute. If the trip count of the loop is known, the achieved rates can also
+// be computed from the number of times the loop was entered and the time
+// spent in it.
+class Roofline {
+private:
+  // Indexed by slot. An entry is written before the slot is published.
+  LoopCost costs[LoopTable::capacity];
+
+  // The peak rates in GFLOP/s and GB/s. These are 0 if they are not known.
+  uint64_t peakFlops;
+  uint64_t peakBytes;
+
+private:
+  void resolve(LoopTable& loops, uint32_t slot);
+
+public:
+  Roofline(uint64_t peakFlops, uint64_t peakBytes);
+  Roofline(const Roofline&) = delete;
+  Roofline(Roofline&&) = delete;
+
+  // Parse the cost in the descriptor of every loop that is added to the table
+  // from now on.
+  void start(LoopTable& loops);
+
+  const LoopCost& getCost(uint32_t slot) const;
+
+  // Get the bound of a loop with the given arithmetic intensity. This is one
+  // of "memory" or "compute", or "-" if the peak rates are not known.
+  const char* getBound(double intensity) const;
+
+  // Get the highest rate, in GFLOP/s, that a loop with the given intensity can
+  // achieve. Returns 0 if the peak rates are not known.
+  double getAttainable(double intensity) const;
+
+  // Parse the cost field of a descriptor. This is of the form
+  //
+  //     flops=<flops>,loads=<bytes>,stores=<bytes>[,trips=<trips>]
+  //
+  // The cost is not known if the field is empty or malformed.
+  static LoopCost parse(const std::string& field);
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_ROOFLINE_H
@@ -0,0 +1,658 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Runtime.h"
+#include "Clock.h"
+#include "Monitor.h"
+#include "Sampler.h"
+#include "Snapshot.h"
+#include "Trace.h"
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+
+namespace lrt {
+
+unsigned long getEnv(const char* var, unsigned long def) {
+  const char* val = std::getenv(var);
+  if (not val or not *val)
+    return def;
+
+  char* end = nullptr;
+  unsigned long ret = std::strtoul(val, &end, 10);
+  if (*end)
+    return def;
+  return ret;
+}
+
+// The sample standard deviation of the total time of each entry of a loop.
+// This is 0 if the loop was entered fewer than twice or was sampled.
+static double getStddev(const LoopSummary& summary) {
+  if (summary.count < 2 or not summary.squares)
+    return 0;
+
+  double n = summary.count;
+  double mean = summary.total / n;
+  double variance = (summary.squares - n * mean * mean) / (n - 1);
+  return variance > 0 ? std::sqrt(variance) : 0;
+}
+
+Runtime::Runtime() {
+  Clock::calibrate(std::getenv("LOOP_RUNTIME_CLOCK"),
+                   getEnv("LOOP_RUNTIME_CALIBRATE_MS", 10));
+  this->overheadIterations = getEnv("LOOP_RUNTIME_OVERHEAD_ITERATIONS", 1000);
+
+  this->suppressPercent = getEnv("LOOP_RUNTIME_SUPPRESS", 0);
+  this->warmup = 0;
+  if (this->suppressPercent)
+    this->warmup = std::max(getEnv("LOOP_RUNTIME_SUPPRESS_WARMUP", 1000), 1UL);
+  for (std::atomic<uint64_t>& overhead : this->overheads)
+    overhead.store(0, std::memory_order_relaxed);
+
+  if (getEnv("LOOP_RUNTIME_IMBALANCE", 0))
+    this->imbalance.reset(new Imbalance());
+
+  // Placement is only recorded when the loops are timed.
+  this->placing = getEnv("LOOP_RUNTIME_PLACEMENT", 0);
+
+  this->sampling = false;
+  if (getEnv("LOOP_RUNTIME_SAMPLE", 0)) {
+    unsigned period = getEnv("LOOP_RUNTIME_SAMPLE_PERIOD", 1000);
+    this->sampler.reset(new Sampler(period));
+    if (this->sampler->start()) {
+      this->sampling = true;
+      this->placing = false;
+      this->warmup = 0;
+      this->imbalance.reset();
+    } else
+      this->sampler.reset();
+  }
+
+  // The filter must be resolved before anything else sees a new loop so that
+  // the monitor and the trace never see a slot whose bit has not been set.
+  if (const char* spec = std::getenv("LOOP_RUNTIME_FILTER"))
+    this->filter.parse(spec);
+  if (const char* file = std::getenv("LOOP_RUNTIME_FILTER_FILE"))
+    this->filter.parseFile(file);
+  this->filter.start(this->loops);
+  this->counters.start(this->loops);
+  this->allocs.start(this->loops);
+  this->throttle.start(this->loops);
+  this->omp.start(this->loops);
+  this->roofline.reset(new Roofline(getEnv("LOOP_RUNTIME_PEAK_GFLOPS", 0),
+                                    getEnv("LOOP_RUNTIME_PEAK_GBS", 0)));
+  this->roofline->start(this->loops);
+  this->lines.start();
+
+  if (const char* profile = std::getenv("LOOP_RUNTIME_PROFILE"))
+    this->profile = profile;
+  else
+    this->profile = "loop-profile." + std::to_string(getpid());
+
+  if (const char* cct = std::getenv("LOOP_RUNTIME_CCT"))
+    this->cct = cct;
+  this->cctNodes = getEnv("LOOP_RUNTIME_CCT_NODES", 16384);
+
+  this->startMonitor();
+  this->startSnapshot();
+
+  if (const char* dir = std::getenv("LOOP_RUNTIME_TRACE")) {
+    unsigned size = getEnv("LOOP_RUNTIME_TRACE_SIZE", 65536);
+    this->trace.reset(new Trace(dir, size));
+    if (not this->trace->start(this->loops))
+      this->trace.reset();
+  }
+
+  if (const char* dir = std::getenv("LOOP_RUNTIME_ARGS")) {
+    uint64_t size = getEnv("LOOP_RUNTIME_ARGS_SIZE", 64);
+    this->args.reset(new ArgLog(dir, std::max<uint64_t>(size, 1) << 20));
+    if (not this->args->start())
+      this->args.reset();
+  }
+
+  std::atexit(Runtime::finish);
+  pthread_atfork(
+      Runtime::prepareFork, Runtime::parentAfterFork, Runtime::childAfterFork);
+}
+
+Runtime::~Runtime() = default;
+
+void Runtime::startMonitor() {
+  if (getEnv("LOOP_RUNTIME_MONITOR", 0)) {
+    unsigned interval = getEnv("LOOP_RUNTIME_MONITOR_INTERVAL", 250);
+    this->monitor.reset(new Monitor(*this, interval));
+    if (not this->monitor->start())
+      this->monitor.reset();
+  }
+}
+
+void Runtime::startSnapshot() {
+  if (const char* prefix = std::getenv("LOOP_RUNTIME_SNAPSHOT")) {
+    unsigned interval = getEnv("LOOP_RUNTIME_SNAPSHOT_INTERVAL", 0);
+    unsigned keep = getEnv("LOOP_RUNTIME_SNAPSHOT_KEEP", 8);
+    this->snapshot.reset(
+        new Snapshot(*this, prefix + this->suffix, interval, keep));
+    if (not this->snapshot->start())
+      this->snapshot.reset();
+  }
+}
+
+LoopTable& Runtime::getLoops() {
+  return this->loops;
+}
+
+ThreadState* Runtime::createThreadState() {
+  unsigned tid = syscall(SYS_gettid);
+  ThreadState* state = new ThreadState(tid, this->counters);
+
+  // This is set before calibrating so that the cost of finding the node in
+  // the tree is included in the overhead of the sentinels.
+  if (not this->cct.empty())
+    state->setCct(new Cct(this->cctNodes));
+  if (this->sampling) {
+    // Nothing is timed, so there is no need to calibrate. The trace and
+    // counters are not used either because they would make the sentinels as
+    // expensive as timing the loops.
+    this->sampler->startThread(*state);
+  } else {
+    state->calibrate(this->loops, this->overheadIterations, this->placing);
+    if (this->trace)
+      state->setTrace(this->trace->createBuffer(tid));
+    Allocs::startThread(*state);
+  }
+  if (this->args)
+    state->setArgs(this->args->createBuffer(tid));
+
+  std::lock_guard<std::mutex> guard(this->threadsLock);
+  this->threads.push_back(state);
+
+  return state;
+}
+
+void Runtime::measureOverhead(const ThreadState& state, uint32_t slot) {
+  // Each entry costs a pair of sentinels. The total has already been
+  // corrected for their overhead, so it is just the time in the loop.
+  const auto relaxed = std::memory_order_relaxed;
+  const LoopStats& stats = state.getStats(slot);
+  uint64_t overhead = state.getPairOverhead() * stats.count.load(relaxed);
+  uint64_t total = stats.total.load(relaxed);
+  if (not overhead)
+    return;
+
+  uint64_t percent = total ? overhead * 100 / total : UINT64_MAX;
+  if (percent > this->suppressPercent and this->filter.suppress(slot))
+    this->overheads[slot].store(percent, relaxed);
+}
+
+std::vector<LoopSummary> Runtime::collect() {
+  const auto relaxed = std::memory_order_relaxed;
+  std::vector<LoopSummary> summaries(this->loops.size(), LoopSummary());
+
+  std::lock_guard<std::mutex> guard(this->threadsLock);
+  for (const ThreadState* state : this->threads) {
+    for (uint32_t slot = 0; slot < summaries.size(); slot++) {
+      const LoopStats& stats = state->getStats(slot);
+      LoopSummary& summary = summaries[slot];
+      if (this->sampling) {
+        summary.count += stats.samples.load(relaxed);
+        summary.total += stats.samples.load(relaxed);
+        summary.self += stats.selfSamples.load(relaxed);
+        continue;
+      }
+      summary.count += stats.count.load(relaxed);
+      summary.total += stats.total.load(relaxed);
+      summary.self += stats.self.load(relaxed);
+      summary.squares += stats.squares.load(relaxed);
+      summary.lastSeen
+          = std::max(summary.lastSeen, stats.lastSeen.load(relaxed));
+      summary.migrations += stats.migrations.load(relaxed);
+      summary.nodeMigrations += stats.nodeMigrations.load(relaxed);
+      summary.remote += stats.remote.load(relaxed);
+      summary.allocations += stats.allocations.load(relaxed);
+      summary.allocated += stats.allocated.load(relaxed);
+      summary.skipped += stats.skipped.load(relaxed);
+    }
+  }
+
+  if (this->sampling) {
+    uint64_t period = this->sampler->getPeriodNs();
+    for (LoopSummary& summary : summaries) {
+      summary.total *= period;
+      summary.self *= period;
+    }
+    return summaries;
+  }
+
+  // Everything above is in ticks.
+  for (LoopSummary& summary : summaries) {
+    summary.total = Clock::toNs(summary.total);
+    summary.self = Clock::toNs(summary.self);
+    summary.squares *= Clock::getNsPerTick() * Clock::getNsPerTick();
+    summary.remote = Clock::toNs(summary.remote);
+    if (summary.lastSeen)
+      summary.lastSeen = Clock::toMonotonic(summary.lastSeen);
+  }
+
+  return summaries;
+}
+
+void Runtime::writeProfile() {
+  if (this->profile.empty())
+    return;
+
+  std::string name = this->profile + this->suffix;
+  FILE* fp = std::fopen(name.c_str(), "w");
+  if (not fp) {
+    std::fprintf(stderr, "loop-runtime: Could not open %s\n", name.c_str());
+    return;
+  }
+
+  std::vector<LoopSummary> summaries = this->collect();
+  std::fprintf(fp, "# loop-runtime profile 3\n");
+  std::fprintf(fp,
+               "# clock %s %.6f ns/tick\n",
+               Clock::isTsc() ? "tsc" : "monotonic",
+               Clock::getNsPerTick());
+  if (this->sampling)
+    std::fprintf(fp,
+                 "# sampled %" PRIu64 " ns/sample\n",
+                 this->sampler->getPeriodNs());
+  std::fprintf(fp, "# id\tcount\ttotal-ns\tself-ns\tstddev-ns\tloop\n");
+  for (uint32_t slot = 0; slot < summaries.size(); slot++) {
+    if (not this->isReported(slot))
+      continue;
+    std::fprintf(fp,
+                 "%016" PRIx64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
+                 "\t%.0f\t%s\n",
+                 this->loops.getId(slot),
+                 summaries[slot].count,
+                 summaries[slot].total,
+                 summaries[slot].self,
+                 getStddev(summaries[slot]),
+                 this->loops.getDescriptor(slot).c_str());
+  }
+  this->writeCounters(fp);
+  if (this->placing)
+    this->writePlacement(fp, summaries);
+  if (this->imbalance)
+    this->writeImbalance(fp);
+  if (not this->sampling) {
+    this->writeAllocations(fp, summaries);
+    this->writeThrottle(fp, summaries);
+  }
+  this->writeRoofline(fp, summaries);
+  this->writeLines(fp);
+  this->writeSuppressed(fp);
+
+  std::fclose(fp);
+}
+
+void Runtime::writeCounters(FILE* fp) {
+  std::lock_guard<std::mutex> guard(this->threadsLock);
+  for (uint32_t slot = 0; slot < this->loops.size(); slot++) {
+    uint32_t mask = this->counters.getMask(slot);
+    if (not mask or not this->isReported(slot))
+      continue;
+
+    for (unsigned i = 0; i < NumCounters; i++) {
+      Counter counter = static_cast<Counter>(i);
+      if (not(mask & (1U << i)))
+        continue;
+
+      // The counter may have been replaced by a software counter or may not
+      // be available at all.
+      const char* event = this->counters.getUsedName(counter);
+      uint64_t value = 0;
+      for (const ThreadState* state : this->threads)
+        value += state->getCounters().getValue(slot, counter);
+      std::fprintf(fp,
+                   "# counter\t%016" PRIx64 "\t%s\t%s\t%" PRIu64 "\n",
+                   this->loops.getId(slot),
+                   Counters::getName(counter),
+                   event ? event : "-",
+                   value);
+    }
+  }
+}
+
+void Runtime::writePlacement(FILE* fp,
+                             const std::vector<LoopSummary>& summaries) {
+  for (uint32_t slot = 0; slot < summaries.size(); slot++) {
+    if (not summaries[slot].count or not this->isReported(slot))
+      continue;
+    std::fprintf(fp,
+                 "# placement\t%016" PRIx64 "\t%" PRIu64 "\t%" PRIu64
+                 "\t%" PRIu64 "\n",
+                 this->loops.getId(slot),
+                 summaries[slot].migrations,
+                 summaries[slot].nodeMigrations,
+                 summaries[slot].remote);
+  }
+}
+
+void Runtime::writeImbalance(FILE* fp) {
+  for (uint32_t slot = 0; slot < this->loops.size(); slot++) {
+    Balance balance = this->imbalance->getBalance(slot);
+    if (not balance.epochs or not this->isReported(slot))
+      continue;
+    double percent = 0;
+    if (balance.critical)
+      percent = 100.0 * (balance.critical - balance.mean) / balance.critical;
+    std::fprintf(fp,
+                 "# imbalance\t%016" PRIx64 "\t%" PRIu64 "\t%" PRIu64
+                 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
+                 "\t%" PRIu64 "\t%.1f\n",
+                 this->loops.getId(slot),
+                 balance.epochs,
+                 balance.maxThreads,
+                 Clock::toNs(balance.elapsed),
+                 Clock::toNs(balance.critical),
+                 Clock::toNs(balance.mean),
+                 Clock::toNs(balance.spread),
+                 Clock::toNs(balance.wait),
+                 percent);
+  }
+}
+
+void Runtime::writeThrottle(FILE* fp,
+                            const std::vector<LoopSummary>& summaries) {
+  for (uint32_t slot = 0; slot < summaries.size(); slot++) {
+    const LoopSummary& summary = summaries[slot];
+    if (not this->isThrottled(slot) or not this->isReported(slot))
+      continue;
+    double scale = summary.count
+                       ? static_cast<double>(summary.count + summary.skipped)
+                             / summary.count
+                       : 0;
+    std::fprintf(fp,
+                 "# throttle\t%016" PRIx64 "\t%" PRIu64 "\t%.0f\n",
+                 this->loops.getId(slot),
+                 summary.skipped,
+                 summary.total * scale);
+  }
+}
+
+void Runtime::writeAllocations(FILE* fp,
+                               const std::vector<LoopSummary>& summaries) {
+  for (uint32_t slot = 0; slot < summaries.size(); slot++) {
+    const LoopSummary& summary = summaries[slot];
+    if (not this->allocs.isTracked(slot) or not summary.count
+        or not this->isReported(slot))
+      continue;
+    std::fprintf(fp,
+                 "# alloc\t%016" PRIx64 "\t%" PRIu64 "\t%" PRIu64
+                 "\t%.2f\t%s\n",
+                 this->loops.getId(slot),
+                 summary.allocations,
+                 summary.allocated,
+                 static_cast<double>(summary.allocations) / summary.count,
+                 summary.allocations >= summary.count ? "every-entry" : "-");
+  }
+}
+
+void Runtime::writeRoofline(FILE* fp,
+                            const std::vector<LoopSummary>& summaries) {
+  for (uint32_t slot = 0; slot < summaries.size(); slot++) {
+    const LoopCost& cost = this->roofline->getCost(slot);
+    uint64_t bytes = cost.loads + cost.stores;
+    if (not cost.known or not bytes or not summaries[slot].count
+        or not this->isReported(slot))
+      continue;
+
+    double intensity = static_cast<double>(cost.flops) / bytes;
+    std::fprintf(fp,
+                 "# roofline\t%016" PRIx64 "\t%" PRIu64 "\t%" PRIu64 "\t%.3f",
+                 this->loops.getId(slot),
+                 cost.flops,
+                 bytes,
+                 intensity);
+
+    // When sampled, the count is the number of samples, not the number of
+    // times the loop was entered, so the amount of work is not known.
+    if (cost.trips and summaries[slot].total and not this->sampling) {
+      double iterations
+          = static_cast<double>(summaries[slot].count) * cost.trips;
+      double ns = summaries[slot].total;
+      double gflops = iterations * cost.flops / ns;
+      double gbs = iterations * bytes / ns;
+      double attainable = this->roofline->getAttainable(intensity);
+      std::fprintf(
+          fp, "\t%" PRIu64 "\t%.3f\t%.3f", cost.trips, gflops, gbs);
+      if (attainable > 0 and cost.flops)
+        std::fprintf(fp, "\t%.1f", 100.0 * gflops / attainable);
+      else
+        std::fprintf(fp, "\t-");
+    } else {
+      std::fprintf(fp, "\t-\t-\t-\t-");
+    }
+    std::fprintf(fp, "\t%s\n", this->roofline->getBound(intensity));
+  }
+}
+
+void Runtime::writeLines(FILE* fp) {
+  const auto relaxed = std::memory_order_relaxed;
+  const LoopTable& table = this->lines.getTable();
+
+  std::lock_guard<std::mutex> guard(this->threadsLock);
+  for (uint32_t slot = 0; slot < table.size(); slot++) {
+    uint64_t hits = 0;
+    uint64_t first = UINT64_MAX;
+    uint64_t last = 0;
+    for (const ThreadState* state : this->threads) {
+      const LineStats& stats = state->getLineStats(slot);
+      hits += stats.hits.load(relaxed);
+      if (uint64_t time = stats.first.load(relaxed))
+        first = std::min(first, time);
+      last = std::max(last, stats.last.load(relaxed));
+    }
+    if (not hits)
+      continue;
+
+    std::fprintf(
+        fp, "# line\t%016" PRIx64 "\t%" PRIu64, table.getId(slot), hits);
+    if (last)
+      std::fprintf(fp,
+                   "\t%" PRIu64 "\t%" PRIu64,
+                   Clock::toMonotonic(first),
+                   Clock::toMonotonic(last));
+    else
+      std::fprintf(fp, "\t-\t-");
+    std::fprintf(fp, "\t%s\n", table.getDescriptor(slot).c_str());
+  }
+}
+
+void Runtime::writeSuppressed(FILE* fp) {
+  for (uint32_t slot = 0; slot < this->loops.size(); slot++)
+    if (this->isSuppressed(slot))
+      std::fprintf(fp,
+                   "# suppressed\t%016" PRIx64 "\t%" PRIu64
+                   "\ttoo fine-grained\n",
+                   this->loops.getId(slot),
+                   this->overheads[slot].load(std::memory_order_relaxed));
+}
+
+void Runtime::writeCct() {
+  if (this->cct.empty())
+    return;
+
+  std::string name = this->cct + this->suffix;
+  FILE* fp = std::fopen(name.c_str(), "w");
+  if (not fp) {
+    std::fprintf(stderr, "loop-runtime: Could not open %s\n", name.c_str());
+    return;
+  }
+
+  const auto relaxed = std::memory_order_relaxed;
+  std::vector<std::string> labels;
+  auto getLabel = [this, &labels](uint32_t slot) -> const std::string& {
+    // Loops may still be added to the table by other threads.
+    while (labels.size() <= slot) {
+      const std::string& desc = this->loops.getDescriptor(labels.size());
+      std::string name = LoopTable::getField(desc, LoopTable::Name);
+      std::string loc = LoopTable::getField(desc, LoopTable::Location);
+      labels.push_back(name.empty() ? loc : name + "@" + loc);
+    }
+    return labels[slot];
+  };
+
+  // The trees of different threads are merged by their paths. A node is
+  // always created after its parent, so the path of the parent is known by
+  // the time the node is seen.
+  std::map<std::string, uint64_t> stacks;
+  std::lock_guard<std::mutex> guard(this->threadsLock);
+  for (const ThreadState* state : this->threads) {
+    const Cct* tree = state->getCct();
+    if (not tree)
+      continue;
+
+    std::vector<std::string> paths(tree->size());
+    for (uint32_t i = Cct::truncated; i < paths.size(); i++) {
+      const CctNode& node = tree->getNode(i);
+      if (i == Cct::truncated)
+        paths[i] = "[truncated]";
+      else if (node.parent == Cct::root)
+        paths[i] = getLabel(node.slot);
+      else
+        paths[i] = paths[node.parent] + ";" + getLabel(node.slot);
+
+      if (this->sampling)
+        stacks[paths[i]] += node.samples.load(relaxed);
+      else
+        stacks[paths[i]] += node.self.load(relaxed);
+    }
+  }
+
+  for (const auto& it : stacks) {
+    if (not it.second)
+      continue;
+    uint64_t value = this->sampling ? it.second * this->sampler->getPeriodNs()
+                                    : Clock::toNs(it.second);
+    std::fprintf(fp, "%s %" PRIu64 "\n", it.first.c_str(), value);
+  }
+
+  std::fclose(fp);
+}
+
+void Runtime::finish() {
+  Runtime& runtime = getRuntime();
+
+  // Stop the monitor first so that the shared memory segment is removed even
+  // if the profile cannot be written.
+  runtime.monitor.reset();
+  runtime.snapshot.reset();
+  runtime.writeProfile();
+  runtime.writeCct();
+}
+
+void Runtime::prepareFork() {
+  Runtime& runtime = getRuntime();
+
+  // The locks are released by the other two handlers. Taking them here means
+  // that only one thread can fork at a time and that the child never starts
+  // with a lock that is held by a thread that it does not have.
+  runtime.loops.lockForFork();
+  runtime.lines.getTable().lockForFork();
+  if (runtime.args)
+    runtime.args->getFunctions().lockForFork();
+  runtime.threadsLock.lock();
+  runtime.forkTid = syscall(SYS_gettid);
+}
+
+void Runtime::parentAfterFork() {
+  Runtime& runtime = getRuntime();
+  runtime.threadsLock.unlock();
+  if (runtime.args)
+    runtime.args->getFunctions().unlockAfterFork();
+  runtime.lines.getTable().unlockAfterFork();
+  runtime.loops.unlockAfterFork();
+}
+
+void Runtime::childAfterFork() {
+  Runtime& runtime = getRuntime();
+  unsigned tid = syscall(SYS_gettid);
+
+  // Only the thread that called fork() exists in the child. The states of
+  // the other threads hold the parent's aggregates, so they are dropped.
+  ThreadState* state = nullptr;
+  for (ThreadState* s : runtime.threads)
+    if (s->getTid() == runtime.forkTid)
+      state = s;
+  runtime.threads.clear();
+  if (state)
+    runtime.threads.push_back(state);
+
+  runtime.suffix += "." + std::to_string(getpid());
+
+  // The monitor and snapshot threads are not copied into the child.
+  // Destroying the objects would wait for threads that do not exist and
+  // remove the parent's shared memory segment, so they are leaked instead and
+  // new ones are started for the child. Strictly, only async-signal-safe
+  // functions should be called here, but glibc makes malloc and thread
+  // creation safe in the child of a fork.
+  if (runtime.monitor) {
+    runtime.monitor.release();
+    runtime.startMonitor();
+  }
+  if (runtime.snapshot) {
+    Snapshot::detach();
+    runtime.snapshot.release();
+    runtime.startSnapshot();
+  }
+
+  if (runtime.imbalance)
+    runtime.imbalance->forked();
+
+  // The clock is not calibrated again. The child keeps the parent's
+  // calibration, so the times that the two report are on the same base.
+  if (runtime.trace)
+    runtime.trace->restart(runtime.loops);
+  if (runtime.args)
+    runtime.args->restart();
+  if (state) {
+    if (runtime.trace and not runtime.sampling)
+      state->setTrace(runtime.trace->createBuffer(tid));
+    if (runtime.args)
+      state->setArgs(runtime.args->createBuffer(tid));
+    state->forked(tid, runtime.sampling);
+
+    // Timers are not inherited across a fork.
+    if (runtime.sampling)
+      runtime.sampler->startThread(*state);
+  }
+
+  runtime.threadsLock.unlock();
+  if (runtime.args)
+    runtime.args->getFunctions().unlockAfterFork();
+  runtime.lines.getTable().unlockAfterFork();
+  runtime.loops.unlockAfterFork();
+}
+
+Runtime& getRuntime() {
+  // This is never freed because the sentinels may still be called by other
+  // threads while the process is exiting.
+  static Runtime* runtime = new Runtime();
+  return *runtime;
+}
+
+} // namespace lrt
@@ -0,0 +1,439 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_RUNTIME_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_RUNTIME_H
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Alloc.h"
+#include "ArgLog.h"
+#include "Counters.h"
+#include "Filter.h"
+#include "Imbalance.h"
+#include "Lines.h"
+#include "LoopTable.h"
+#include "Omp.h"
+#include "Roofline.h"
+#include "ThreadState.h"
+#include "Throttle.h"
+
+namespace lrt {
+
+class Monitor;
+class Sampler;
+class Snapshot;
+class Trace;
+
+// The aggregates for a single loop summed over all threads. The times are in
+// nanoseconds and lastSeen is a time on the monotonic clock. When the loops
+// are sampled, count is the number of samples, the times are estimated from
+// the number of samples and lastSeen is always 0. squares is the sum of the
+// squares of the total time of each entry in nanoseconds squared, which is 0
+// when the loops are sampled. The migrations and remote time are only counted
+// when the placement of the loops is recorded and the allocations only when
+// they are tracked.
+struct LoopSummary {
+  uint64_t count;
+  uint64_t total;
+  uint64_t self;
+  double squares;
+  uint64_t lastSeen;
+  uint64_t migrations;
+  uint64_t nodeMigrations;
+  uint64_t remote;
+  uint64_t allocations;
+  uint64_t allocated;
+  uint64_t skipped;
+};
+
+// The runtime that is called from the sentinels. There is exactly one of
+// these in a process and it is obtained using getRuntime(). It is configured
+// using environment variables when it is first created.
+//
+//     LOOP_RUNTIME_PROFILE            The file to which the per-loop
+//                                     aggregates are written at exit. If this
+//                                     is set but empty, nothing is written.
+//                                     The default is loop-profile.<pid>.
+//
+//     LOOP_RUNTIME_MONITOR            If set to a non-zero value, publish the
+//                                     per-loop aggregates to shared memory so
+//                                     that they can be read by loop-top.
+//
+//     LOOP_RUNTIME_MONITOR_INTERVAL   How often, in milliseconds, the
+//                                     aggregates are published. The default
+//                                     is 250.
+//
+//     LOOP_RUNTIME_TRACE              If set, the directory in which to keep
+//                                     the file-backed trace buffers that
+//                                     survive a crash.
+//
+//     LOOP_RUNTIME_TRACE_SIZE         The number of events in each thread's
+//                                     trace buffer. The default is 65536.
+//
+//     LOOP_RUNTIME_ARGS               If set, the directory in which to keep
+//                                     the file-backed logs of the arguments
+//                                     of the functions that are demarcated
+//                                     with the args clause. See ArgLog.h.
+//
+//     LOOP_RUNTIME_ARGS_SIZE          The size, in MiB, of each thread's
+//                                     argument log. The default is 64.
+//
+//     LOOP_RUNTIME_SNAPSHOT           If set, the prefix of the files to which
+//                                     snapshots of the aggregates are written.
+//                                     A snapshot is written whenever the
+//                                     process receives SIGUSR1.
+//
+//     LOOP_RUNTIME_SNAPSHOT_INTERVAL  How often, in milliseconds, to write a
+//                                     snapshot. If 0, snapshots are only
+//                                     written on SIGUSR1. The default is 0.
+//
+//     LOOP_RUNTIME_SNAPSHOT_KEEP      The number of snapshots to keep. Older
+//                                     ones are deleted. The default is 8.
+//
+//     LOOP_RUNTIME_SAMPLE             If set to a non-zero value, the loops are
+//                                     sampled instead of timed. See Sampler.h.
+//
+//     LOOP_RUNTIME_SAMPLE_PERIOD      The sampling period in microseconds of
+//                                     CPU time. The default is 1000.
+//
+//     LOOP_RUNTIME_CCT                If set, the file to which the calling-
+//                                     context tree is written at exit as
+//                                     folded stacks.
+//
+//     LOOP_RUNTIME_CCT_NODES          The maximum number of nodes in each
+//                                     thread's calling-context tree. The
+//                                     default is 16384.
+//
+//     LOOP_RUNTIME_PLACEMENT          If set to a non-zero value, record the
+//                                     CPU and NUMA node on which each loop is
+//                                     entered and exited.
+//
+//     LOOP_RUNTIME_CLOCK              Either "tsc" or "monotonic". By default,
+//                                     the TSC is used if it is invariant.
+//
+//     LOOP_RUNTIME_CALIBRATE_MS       How long, in milliseconds, to spend
+//                                     measuring the frequency of the TSC at
+//                                     startup. The default is 10.
+//
+//     LOOP_RUNTIME_OVERHEAD_ITERATIONS
+//                                     The number of empty loops that each
+//                                     thread runs to measure the overhead of
+//                                     the sentinels. If 0, the overhead is
+//                                     not subtracted. The default is 1000.
+//
+//     LOOP_RUNTIME_FILTER             Rules that select the loops that are
+//                                     instrumented. See Filter.h.
+//
+//     LOOP_RUNTIME_FILTER_FILE        A file containing filter rules, one per
+//                                     line. These are applied after those in
+//                                     LOOP_RUNTIME_FILTER.
+//
+//     LOOP_RUNTIME_IMBALANCE          If set to a non-zero value, group the
+//                                     instances of each loop that run
+//                                     concurrently on different threads into
+//                                     epochs and measure the load balance.
+//                                     See Imbalance.h.
+//
+//     LOOP_RUNTIME_SUPPRESS           If set to a non-zero value, a loop whose
+//                                     sentinels cost more than this percentage
+//                                     of the time spent in the loop is no
+//                                     longer instrumented.
+//
+//     LOOP_RUNTIME_SUPPRESS_WARMUP    The number of times a thread must enter
+//                                     a loop before deciding whether to
+//                                     suppress it. The default is 1000.
+//
+//     LOOP_RUNTIME_PEAK_GFLOPS        The peak floating point rate of the
+//                                     machine in GFLOP/s.
+//
+//     LOOP_RUNTIME_PEAK_GBS           The peak memory bandwidth of the machine
+//                                     in GB/s. If both this and
+//                                     LOOP_RUNTIME_PEAK_GFLOPS are set, each
+//                                     loop with a static cost is classified as
+//                                     memory- or compute-bound. See
+//                                     Roofline.h.
+//
+// If the process forks, the child starts with empty aggregates and writes its
+// own output. The names of the profile, calling-context tree and snapshot
+// files in the child have .<pid> appended to them, and the child has its own
+// trace files, argument logs and shared memory segment.
+//
+class Runtime {
+private:
+  LoopTable loops;
+  Lines lines;
+  Filter filter;
+  Counters counters;
+  Allocs allocs;
+  Throttle throttle;
+  Omp omp;
+  std::unique_ptr<Roofline> roofline;
+
+  // All the threads that have ever entered a loop. The ThreadState objects
+  // are never freed.
+  std::mutex threadsLock;
+  std::vector<ThreadState*> threads;
+
+  std::string profile;
+  std::string cct;
+
+  // Loops are suppressed once their overhead, in percent, exceeds
+  // suppressPercent after warmup entries on any thread. warmup is 0 if loops
+  // are never suppressed. The overhead of each suppressed loop at the time is
+  // kept for the profile.
+  unsigned suppressPercent;
+  uint64_t warmup;
+  std::atomic<uint64_t> overheads[LoopTable::capacity];
+
+  // Appended to the names of the output files. This is empty in the original
+  // process and gets .<pid> added to it in each forked child.
+  std::string suffix;
+
+  // The thread that is calling fork(). This is only valid between the
+  // prepare and child fork handlers.
+  unsigned forkTid;
+
+  unsigned cctNodes;
+  unsigned overheadIterations;
+  std::unique_ptr<Monitor> monitor;
+  std::unique_ptr<Sampler> sampler;
+  bool sampling;
+  bool placing;
+  std::unique_ptr<Snapshot> snapshot;
+  std::unique_ptr<Imbalance> imbalance;
+  std::unique_ptr<Trace> trace;
+  std::unique_ptr<ArgLog> args;
+
+private:
+  Runtime();
+
+  void startMonitor();
+  void startSnapshot();
+  ThreadState* createThreadState();
+  void measureOverhead(const ThreadState& state, uint32_t slot);
+  void writeProfile();
+
+  // Write the values of the performance counters of each loop that requested
+  // them. Each is written on a line of its own of the form
+  //
+  //     # counter <id> <counter> <event> <value>
+  //
+  // where event is the event that was actually counted, or - if the counter
+  // was not available. These start with # so that tools that only want the
+  // aggregates can ignore them.
+  void writeCounters(FILE* fp);
+
+  // Write where each loop ran. Each loop is written on a line of its own of
+  // the form
+  //
+  //     # placement <id> <migrations> <node-migrations> <remote-ns>
+  //
+  void writePlacement(FILE* fp, const std::vector<LoopSummary>& summaries);
+
+  // Write the load balance of each loop that ran on more than one thread at
+  // a time. Each loop is written on a line of its own of the form
+  //
+  //     # imbalance <id> <epochs> <max-threads> <elapsed-ns> <critical-ns>
+  //                 <mean-ns> <spread-ns> <wait-ns> <imbalance-percent>
+  //
+  // See Imbalance.h for what each of these is. The imbalance is the
+  // percentage of the critical path that would be saved if the work were
+  // perfectly balanced.
+  void writeImbalance(FILE* fp);
+
+  // Write the heap allocations of each loop whose allocations are tracked.
+  // Each loop is written on a line of its own of the form
+  //
+  //     # alloc <id> <allocations> <bytes> <allocations-per-entry> <every>
+  //
+  // where every is every-entry if the loop made at least as many allocations
+  // as it was entered, and - otherwise.
+  void writeAllocations(FILE* fp, const std::vector<LoopSummary>& summaries);
+
+  // Write the entries that were skipped for each throttled loop. Each loop is
+  // written on a line of its own of the form
+  //
+  //     # throttle <id> <skipped> <estimated-total-ns>
+  //
+  // where the estimate is the total time of the timed entries scaled up to
+  // all of the entries.
+  void writeThrottle(FILE* fp, const std::vector<LoopSummary>& summaries);
+
+  // Write where each loop with a static cost lies on the roofline. Each loop
+  // is written on a line of its own of the form
+  //
+  //     # roofline <id> <flops> <bytes> <flops-per-byte> <trips> <gflops>
+  //                <gbs> <roof-percent> <bound>
+  //
+  // where flops and bytes are per iteration. The trips, achieved rates and
+  // the percentage of the attainable rate are - if the trip count is not
+  // known or the loops were sampled. The bound is - if the peak rates of the
+  // machine were not given.
+  void writeRoofline(FILE* fp, const std::vector<LoopSummary>& summaries);
+
+  // Write the number of times each line was hit. Each line is written on a
+  // line of its own of the form
+  //
+  //     # line <id> <hits> <first-ns> <last-ns> <line>
+  //
+  // where first and last are the times on the monotonic clock of the first
+  // and last hit on any thread, or - if the times were not recorded, and the
+  // last field is the descriptor of the line.
+  void writeLines(FILE* fp);
+
+  // Write the loops that were suppressed. Each loop is written on a line of
+  // its own of the form
+  //
+  //     # suppressed <id> <overhead-percent> too fine-grained
+  //
+  void writeSuppressed(FILE* fp);
+
+  // Merge the calling-context trees of all the threads and write them as
+  // folded stacks, one context per line, that can be read by flamegraph.pl
+  // and similar tools. Each line is of the form
+  //
+  //     <outermost>;...;<innermost> <self-ns>
+  //
+  // where each loop is its location, prefixed with the name and an @ if it
+  // has one.
+  void writeCct();
+
+  static void finish();
+
+  // The fork handlers. See pthread_atfork(3).
+  static void prepareFork();
+  static void parentAfterFork();
+  static void childAfterFork();
+
+public:
+  Runtime(const Runtime&) = delete;
+  Runtime(Runtime&&) = delete;
+  ~Runtime();
+
+  LoopTable& getLoops();
+
+  Lines& getLines() {
+    return this->lines;
+  }
+
+  // This will be null unless the arguments of functions are being logged.
+  ArgLog* getArgLog() {
+    return this->args.get();
+  }
+
+  // True if the loops are being sampled instead of timed.
+  bool isSampling() const {
+    return this->sampling;
+  }
+
+  // True if the CPU and NUMA node are recorded on every loop event.
+  bool isPlacing() const {
+    return this->placing;
+  }
+
+  // Check if the loop in the slot was selected by the filter. Loops that are
+  // not selected are ignored by the sentinels.
+  bool isEnabled(uint32_t slot) const {
+    return this->filter.isEnabled(slot);
+  }
+
+  // True if the loop was selected by the filter, but has been disabled
+  // because its sentinels cost too much relative to the loop itself.
+  bool isSuppressed(uint32_t slot) const {
+    return this->filter.isSuppressed(slot);
+  }
+
+  // True if the loop should appear in the output.
+  bool isReported(uint32_t slot) const {
+    return this->isEnabled(slot) or this->isSuppressed(slot);
+  }
+
+  // True if only some of the entries of the loop are timed.
+  bool isThrottled(uint32_t slot) const {
+    return this->throttle.isThrottled(slot);
+  }
+
+  const Omp& getOmp() const {
+    return this->omp;
+  }
+
+  // Called by the sentinels when a throttled loop is entered. Returns true if
+  // the entry should be timed.
+  bool admit(ThreadState& state, uint32_t slot) {
+    return state.admit(slot, this->throttle.getPeriod(slot));
+  }
+
+  // Called by the sentinels when a loop is entered or exited and is being
+  // timed.
+  void enter(ThreadState& state, uint32_t slot, uint64_t start, uint32_t cpu) {
+    state.enter(slot, start, cpu);
+    if (this->allocs.isTracked(slot))
+      state.startAllocating(slot);
+    if (this->imbalance)
+      this->imbalance->enter(slot, state.getTid(), start);
+  }
+
+  void exit(ThreadState& state, uint32_t slot, uint64_t end, uint32_t cpu) {
+    if (this->allocs.isTracked(slot))
+      state.stopAllocating(slot);
+    uint64_t time = state.exit(slot, end, cpu);
+    if (this->imbalance)
+      this->imbalance->exit(slot, state.getTid(), end, time);
+    if (this->throttle.isThrottled(slot))
+      this->throttle.charge(
+          state.getThrottled(slot), slot, state.getPairOverhead(), end);
+
+    // Decide whether to suppress the loop once the thread has entered it
+    // often enough.
+    if (this->warmup
+        and state.getStats(slot).count.load(std::memory_order_relaxed)
+                == this->warmup)
+      this->measureOverhead(state, slot);
+  }
+
+  // Get the state for the calling thread, creating it if necessary.
+  ThreadState& getThreadState() {
+    thread_local ThreadState* state = nullptr;
+    if (not state)
+      state = this->createThreadState();
+    return *state;
+  }
+
+  // Sum the aggregates of all the threads. The result is indexed by slot and
+  // has one entry for each loop in the loop table. Since the threads are not
+  // stopped while this happens, the result is not an atomic snapshot, but
+  // each individual value is always one that was actually seen.
+  std::vector<LoopSummary> collect();
+
+  friend Runtime& getRuntime();
+};
+
+// Get the runtime, creating it if it does not already exist.
+Runtime& getRuntime();
+
+// Read an environment variable, returning the default if it is not set or
+// cannot be parsed.
+unsigned long getEnv(const char* var, unsigned long def);
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_RUNTIME_H
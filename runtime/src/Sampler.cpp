@@ -0,0 +1,102 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Sampler.h"
+#include "ThreadState.h"
+
+#include <signal.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+
+// Older versions of glibc do not expose the name of this field.
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace lrt {
+
+// The state of the thread that is being sampled. This is set before the
+// thread's timer is started, so it will have been allocated by the time the
+// signal handler reads it.
+static thread_local ThreadState* sampled = nullptr;
+
+Sampler::Sampler(unsigned period) : period(period ? period : 1) {
+  ;
+}
+
+void Sampler::handler(int, siginfo_t* info, void*) {
+  // The timer can only expire on a scheduler tick, so if the period is
+  // shorter than a tick, several periods will have elapsed by the time the
+  // signal is raised. The ones that were missed are counted as overruns.
+  int saved = errno;
+  if (ThreadState* state = sampled)
+    state->sample(1 + std::max(info->si_overrun, 0));
+  errno = saved;
+}
+
+bool Sampler::start() {
+  struct sigaction old;
+  sigaction(SIGPROF, nullptr, &old);
+  if ((old.sa_flags & SA_SIGINFO)
+      or (old.sa_handler != SIG_DFL and old.sa_handler != SIG_IGN)) {
+    std::fprintf(stderr,
+                 "loop-runtime: SIGPROF is already handled. Loops will be "
+                 "timed instead of sampled\n");
+    return false;
+  }
+
+  struct sigaction act = {};
+  act.sa_sigaction = Sampler::handler;
+  act.sa_flags = SA_RESTART | SA_SIGINFO;
+  sigemptyset(&act.sa_mask);
+  return sigaction(SIGPROF, &act, nullptr) == 0;
+}
+
+bool Sampler::startThread(ThreadState& state) {
+  sampled = &state;
+
+  // The timer measures the CPU time of this thread alone and the signal is
+  // sent to this thread, so a sample is always charged to the loops of the
+  // thread that was actually running.
+  struct sigevent sev = {};
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = SIGPROF;
+  sev.sigev_notify_thread_id = state.getTid();
+
+  timer_t timer;
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &timer) != 0) {
+    std::fprintf(stderr,
+                 "loop-runtime: Could not create sampling timer for thread "
+                 "%u\n",
+                 state.getTid());
+    return false;
+  }
+
+  struct itimerspec spec = {};
+  spec.it_interval.tv_sec = this->period / 1000000;
+  spec.it_interval.tv_nsec = (this->period % 1000000) * 1000;
+  spec.it_value = spec.it_interval;
+  return timer_settime(timer, 0, &spec, nullptr) == 0;
+}
+
+uint64_t Sampler::getPeriodNs() const {
+  return static_cast<uint64_t>(this->period) * 1000;
+}
+
+} // namespace lrt
@@ -0,0 +1,63 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_SAMPLER_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_SAMPLER_H
+
+#include <signal.h>
+
+#include <cstdint>
+
+namespace lrt {
+
+class ThreadState;
+
+// Attributes CPU time to loops statistically. In this mode, the sentinels
+// only push and pop the loop on the thread's loop stack. Each thread has a
+// timer that measures the CPU time used by the thread and raises SIGPROF
+// every period. The signal handler charges a sample to every loop on the
+// stack and a self sample to the innermost one.
+//
+// The overhead of the sentinels is then a handful of instructions, and the
+// overhead of sampling depends only on the period, not on how often the loops
+// are entered.
+class Sampler {
+private:
+  // The sampling period in microseconds of CPU time.
+  unsigned period;
+
+private:
+  static void handler(int, siginfo_t* info, void*);
+
+public:
+  explicit Sampler(unsigned period);
+  Sampler(const Sampler&) = delete;
+  Sampler(Sampler&&) = delete;
+
+  // Install the signal handler. Returns false if the program already handles
+  // SIGPROF, in which case sampling cannot be used.
+  bool start();
+
+  // Start sampling the calling thread. Returns false if the timer could not be
+  // created.
+  bool startThread(ThreadState& state);
+
+  uint64_t getPeriodNs() const;
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_SAMPLER_H
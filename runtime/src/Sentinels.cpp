@@ -0,0 +1,172 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+// The out-of-line definitions of the scope guards are always exported, so the
+// inline definitions in the header must not be seen here.
+#define LOOP_RUNTIME_NO_INLINE
+#include "LoopRuntime.h"
+
+#include "Clock.h"
+#include "Runtime.h"
+
+#include <cstdarg>
+#include <cstring>
+
+using namespace lrt;
+
+// These are the functions whose calls are inserted by the plugins around each
+// demarcated loop. They are declared in LoopRuntime.h, which the plugins
+// include in every file that they instrument, so the signatures here must
+// match those in the header. The argument is a string literal that describes
+// the loop. See LoopTable.h for the format. __logArgs() is inserted at the
+// start of a function whose arguments should be logged (see ArgLog.h) and
+// __hitLine() before a statement whose hits should be counted (see Lines.h).
+// __enterFunction() and __exitFunction() are used to time functions, which
+// are treated like loops. __enterLoopScope() and __exitLoopScope() are the
+// same as __enterLoop() and __exitLoop(), but are used by the plugins so that
+// the loop is exited however control leaves it. The header defines these
+// inline, so the definitions here are only called by code that was compiled
+// with LOOP_RUNTIME_NO_INLINE.
+//
+// These are on the hot path. Anything that is not needed on every call should
+// be done when the loop is first seen.
+
+extern "C" void __enterLoop(const char* loop) {
+  Allocs::Entered entered;
+  Runtime& runtime = getRuntime();
+  uint32_t slot = runtime.getLoops().lookup(loop);
+  if (slot == LoopTable::invalid or not runtime.isEnabled(slot))
+    return;
+
+  if (runtime.isSampling()) {
+    runtime.getThreadState().push(slot);
+    return;
+  }
+
+  // The entries of a throttled loop that are skipped never read the clock.
+  ThreadState& state = runtime.getThreadState();
+  if (runtime.isThrottled(slot) and not runtime.admit(state, slot))
+    return;
+
+  if (runtime.isPlacing()) {
+    uint32_t cpu;
+    uint64_t start = now(cpu);
+    runtime.enter(state, slot, start, cpu);
+  } else {
+    runtime.enter(state, slot, now(), Clock::noCpu);
+  }
+}
+
+extern "C" void __exitLoop(const char* loop) {
+  Allocs::Entered entered;
+  Runtime& runtime = getRuntime();
+  if (runtime.isSampling()) {
+    uint32_t slot = runtime.getLoops().lookup(loop);
+    if (slot != LoopTable::invalid and runtime.isEnabled(slot))
+      runtime.getThreadState().pop();
+    return;
+  }
+
+  // The loop is looked up before the clock is read so that the exits of the
+  // entries of a throttled loop that were skipped do not read it either.
+  uint32_t slot = runtime.getLoops().lookup(loop);
+  if (slot == LoopTable::invalid)
+    return;
+  ThreadState& state = runtime.getThreadState();
+  if (runtime.isThrottled(slot) and state.release(slot))
+    return;
+
+  uint32_t cpu = Clock::noCpu;
+  uint64_t end = runtime.isPlacing() ? now(cpu) : now();
+
+  // A loop that was suppressed while it was active must still be exited or
+  // the loop stack would never be balanced again.
+  if (not runtime.isEnabled(slot)) {
+    if (runtime.isSuppressed(slot) and state.isInnermost(slot))
+      runtime.exit(state, slot, end, cpu);
+    return;
+  }
+
+  runtime.exit(state, slot, end, cpu);
+}
+
+// The result initializes a variable whose cleanup function is
+// __exitFunction(), which is passed the address of the variable. The cleanup
+// is run however control leaves the function.
+extern "C" const char* __enterFunction(const char* function) {
+  __enterLoop(function);
+  return function;
+}
+
+extern "C" void __exitFunction(const char** function) {
+  __exitLoop(*function);
+}
+
+// The result initializes a variable whose cleanup function is
+// __exitLoopScope(). The variable is null if the loop was not entered, which
+// is the case when the condition of an if clause is false.
+extern "C" const char* __enterLoopScope(const char* loop) {
+  __enterLoop(loop);
+  return loop;
+}
+
+extern "C" void __exitLoopScope(const char** loop) {
+  if (*loop)
+    __exitLoop(*loop);
+}
+
+extern "C" void __hitLine(const char* line) {
+  Allocs::Entered entered;
+  Runtime& runtime = getRuntime();
+  Lines& lines = runtime.getLines();
+  uint32_t slot = lines.getTable().lookup(line);
+  if (slot == LoopTable::invalid)
+    return;
+
+  uint64_t time = lines.isTimed(slot) ? now() : 0;
+  runtime.getThreadState().hit(slot, time);
+}
+
+// Each of the variadic arguments is a pointer to an argument of the function.
+// The sizes of the arguments are in the descriptor.
+extern "C" void __logArgs(const char* function, ...) {
+  Allocs::Entered entered;
+  Runtime& runtime = getRuntime();
+  ArgLog* log = runtime.getArgLog();
+  if (not log)
+    return;
+
+  uint32_t slot = log->getFunctions().lookup(function);
+  if (slot == LoopTable::invalid)
+    return;
+  const ArgLayout& layout = log->getLayout(slot);
+  ArgBuffer* buffer = runtime.getThreadState().getArgs();
+  if (not layout.valid or not buffer)
+    return;
+
+  char* out = buffer->append(slot, now(), layout.size);
+  if (not out)
+    return;
+
+  va_list ap;
+  va_start(ap, function);
+  for (uint32_t size : layout.sizes) {
+    std::memcpy(out, va_arg(ap, const void*), size);
+    out += size;
+  }
+  va_end(ap);
+  buffer->commit(layout.size);
+}
@@ -0,0 +1,90 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_SHM_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_SHM_H
+
+// The layout of the shared memory segment that the runtime publishes the
+// per-loop aggregates to. This is shared between the runtime and the loop-top
+// tool, so it should not include anything from the rest of the runtime.
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+
+namespace lrt {
+namespace shm {
+
+const uint64_t magic = 0x4e4f4d2d54524c00ULL; // "LRT-MON"
+const uint32_t version = 2;
+
+// The maximum length of the loop descriptor, including the terminating null.
+// Longer descriptors will be truncated.
+const unsigned descLen = 160;
+
+struct Header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t capacity;
+  uint32_t pid;
+  uint32_t interval;
+
+  // The number of slots that have been published. A slot's descriptor is
+  // written before this is incremented past it and never changes after.
+  std::atomic<uint32_t> numLoops;
+
+  // The time at which the aggregates were last published.
+  std::atomic<uint64_t> published;
+};
+
+// A single loop. The times are in nanoseconds and lastSeen is a time on the
+// monotonic clock. The aggregates are protected by a sequence lock. There is
+// only one writer, the monitor thread in the instrumented process, which
+// makes the sequence number odd while it is updating the slot. A reader must
+// retry if the sequence number is odd or has changed by the time it has
+// finished reading.
+struct Slot {
+  std::atomic<uint32_t> seq;
+  uint32_t reserved;
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> total;
+  std::atomic<uint64_t> self;
+  std::atomic<uint64_t> lastSeen;
+  char desc[descLen];
+};
+
+inline std::string getName(pid_t pid) {
+  return "/loop-runtime." + std::to_string(pid);
+}
+
+inline size_t getSize(uint32_t capacity) {
+  return sizeof(Header) + capacity * sizeof(Slot);
+}
+
+inline Slot* getSlots(Header* header) {
+  return reinterpret_cast<Slot*>(header + 1);
+}
+
+inline const Slot* getSlots(const Header* header) {
+  return reinterpret_cast<const Slot*>(header + 1);
+}
+
+} // namespace shm
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_SHM_H
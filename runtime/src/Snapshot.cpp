@@ -0,0 +1,214 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Snapshot.h"
+#include "Clock.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+
+namespace lrt {
+
+// The write end of the pipe of the one Snapshot object in the process. This
+// is all that the signal handler needs.
+static std::atomic<int> wakeFd(-1);
+
+Snapshot::Snapshot(Runtime& runtime,
+                   const std::string& prefix,
+                   unsigned interval,
+                   unsigned keep)
+    : runtime(runtime), prefix(prefix), interval(interval),
+      keep(keep ? keep : 1), pipe{-1, -1}, running(false), sequence(0),
+      lastTime(0) {
+  ;
+}
+
+Snapshot::~Snapshot() {
+  if (this->thread.joinable()) {
+    wakeFd.store(-1);
+    this->running = false;
+    char c = 0;
+    while (::write(this->pipe[1], &c, 1) < 0 and errno == EINTR)
+      ;
+    this->thread.join();
+  }
+
+  for (int fd : this->pipe)
+    if (fd >= 0)
+      close(fd);
+}
+
+void Snapshot::handler(int) {
+  // Only async-signal-safe functions can be called here, so just wake the
+  // thread up. If the pipe is full, a snapshot is already pending.
+  int saved = errno;
+  int fd = wakeFd.load();
+  if (fd >= 0) {
+    char c = 1;
+    ssize_t ret = ::write(fd, &c, 1);
+    (void)ret;
+  }
+  errno = saved;
+}
+
+bool Snapshot::start() {
+  if (::pipe2(this->pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+    std::fprintf(stderr, "loop-runtime: Could not create snapshot pipe\n");
+    return false;
+  }
+
+  this->lastTime = Clock::monotonic();
+  this->running = true;
+  this->thread = std::thread(&Snapshot::run, this);
+  wakeFd.store(this->pipe[1]);
+
+  struct sigaction old;
+  sigaction(SIGUSR1, nullptr, &old);
+  if (old.sa_handler != SIG_DFL and old.sa_handler != SIG_IGN
+      and old.sa_handler != Snapshot::handler) {
+    std::fprintf(stderr,
+                 "loop-runtime: SIGUSR1 is already handled. Snapshots will "
+                 "not be written on demand\n");
+  } else {
+    struct sigaction act = {};
+    act.sa_handler = Snapshot::handler;
+    act.sa_flags = SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    sigaction(SIGUSR1, &act, nullptr);
+  }
+
+  return true;
+}
+
+void Snapshot::detach() {
+  wakeFd.store(-1);
+}
+
+void Snapshot::write() {
+  LoopTable& loops = this->runtime.getLoops();
+  std::vector<LoopSummary> summaries = this->runtime.collect();
+  uint64_t time = Clock::monotonic();
+
+  std::string name = this->prefix + "." + std::to_string(this->sequence);
+  std::string tmp = name + ".tmp";
+  FILE* fp = std::fopen(tmp.c_str(), "w");
+  if (not fp) {
+    std::fprintf(stderr, "loop-runtime: Could not open %s\n", tmp.c_str());
+    return;
+  }
+
+  std::fprintf(fp, "# loop-runtime snapshot 1\n");
+  std::fprintf(fp, "# sequence %" PRIu64 "\n", this->sequence);
+  std::fprintf(fp,
+               "# time %" PRIu64 " window-ns %" PRIu64 "\n",
+               time,
+               time - this->lastTime);
+  std::fprintf(fp,
+               "# clock %s %.6f ns/tick\n",
+               Clock::isTsc() ? "tsc" : "monotonic",
+               Clock::getNsPerTick());
+  std::fprintf(fp,
+               "# id\tcount\ttotal-ns\tself-ns"
+               "\twindow-count\twindow-total-ns\twindow-self-ns\tloop\n");
+  for (uint32_t slot = 0; slot < summaries.size(); slot++) {
+    if (not this->runtime.isReported(slot))
+      continue;
+
+    // The loops that have been added since the last snapshot were not in it.
+    const LoopSummary& cur = summaries[slot];
+    LoopSummary prev = LoopSummary();
+    if (slot < this->previous.size())
+      prev = this->previous[slot];
+    std::fprintf(fp,
+                 "%016" PRIx64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
+                 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%s\n",
+                 loops.getId(slot),
+                 cur.count,
+                 cur.total,
+                 cur.self,
+                 cur.count - prev.count,
+                 cur.total - prev.total,
+                 cur.self - prev.self,
+                 loops.getDescriptor(slot).c_str());
+  }
+
+  bool ok = std::fflush(fp) == 0 and fsync(fileno(fp)) == 0;
+  ok = std::fclose(fp) == 0 and ok;
+  if (not ok or std::rename(tmp.c_str(), name.c_str()) != 0) {
+    std::fprintf(stderr, "loop-runtime: Could not write %s\n", name.c_str());
+    std::remove(tmp.c_str());
+    return;
+  }
+
+  if (this->sequence >= this->keep) {
+    uint64_t old = this->sequence - this->keep;
+    std::remove((this->prefix + "." + std::to_string(old)).c_str());
+  }
+
+  this->sequence++;
+  this->lastTime = time;
+  this->previous = std::move(summaries);
+}
+
+void Snapshot::run() {
+  // The periodic snapshots are due at fixed times from the start, so they
+  // are not pushed back by the snapshots that are requested with a signal,
+  // or by poll() being interrupted.
+  const uint64_t period = static_cast<uint64_t>(this->interval) * 1000000;
+  uint64_t deadline = Clock::monotonic() + period;
+  struct pollfd pfd = {this->pipe[0], POLLIN, 0};
+  while (this->running) {
+    int timeout = -1;
+    if (period) {
+      uint64_t time = Clock::monotonic();
+      timeout = deadline > time ? (deadline - time + 999999) / 1000000 : 0;
+    }
+    int ret = poll(&pfd, 1, timeout);
+    if (ret < 0 and errno != EINTR)
+      break;
+
+    // Drain the pipe so that several signals that arrive close together only
+    // result in a single snapshot.
+    bool requested = false;
+    if (ret > 0) {
+      char buf[64];
+      while (read(this->pipe[0], buf, sizeof(buf)) > 0)
+        requested = true;
+    }
+
+    // If writing a snapshot took longer than the interval, the snapshots
+    // that were missed are skipped rather than written back to back.
+    bool due = false;
+    if (period) {
+      uint64_t time = Clock::monotonic();
+      while (deadline <= time) {
+        deadline += period;
+        due = true;
+      }
+    }
+
+    if (this->running and (requested or due))
+      this->write();
+  }
+}
+
+} // namespace lrt
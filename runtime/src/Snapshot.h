@@ -0,0 +1,89 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_SNAPSHOT_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_SNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Runtime.h"
+
+namespace lrt {
+
+// Writes the per-loop aggregates to a file at regular intervals and whenever
+// the process receives SIGUSR1. This is meant for processes that never exit
+// and so never write a profile.
+//
+// Each snapshot is written to <prefix>.<sequence> and contains both the
+// cumulative aggregates and the change since the previous snapshot. The file
+// is written under a temporary name and renamed once it is complete, so a
+// reader never sees a partial snapshot. Only the most recent snapshots are
+// kept.
+//
+// The snapshots are written on a separate thread. The threads that run the
+// loops are never stopped. Just as with the monitor, each value in a snapshot
+// is one that was actually seen, but the snapshot as a whole is not atomic.
+class Snapshot {
+private:
+  Runtime& runtime;
+  std::string prefix;
+  unsigned interval;
+  unsigned keep;
+
+  // The signal handler writes to one end of this pipe to wake the thread up.
+  // So does the destructor, after clearing running.
+  int pipe[2];
+  std::atomic<bool> running;
+  std::thread thread;
+
+  uint64_t sequence;
+  uint64_t lastTime;
+  std::vector<LoopSummary> previous;
+
+private:
+  void write();
+  void run();
+
+  static void handler(int);
+
+public:
+  // If interval is 0, snapshots are only written when a signal is received.
+  Snapshot(Runtime& runtime,
+           const std::string& prefix,
+           unsigned interval,
+           unsigned keep);
+  Snapshot(const Snapshot&) = delete;
+  Snapshot(Snapshot&&) = delete;
+  ~Snapshot();
+
+  // Install the signal handler and start the thread. Returns false if the
+  // thread could not be started. If the program has its own handler for
+  // SIGUSR1, it is left alone and only periodic snapshots are written.
+  bool start();
+
+  // Called in the child after a fork. The snapshot thread does not exist in
+  // the child, so the signal handler must stop waking it up, or it would wake
+  // up the parent's thread instead.
+  static void detach();
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_SNAPSHOT_H
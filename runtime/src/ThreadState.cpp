@@ -0,0 +1,190 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "ThreadState.h"
+#include "Clock.h"
+
+namespace lrt {
+
+ThreadState::ThreadState(unsigned tid, Counters& counters)
+    : tid(tid), depth(0), stats(new LoopStats[LoopTable::capacity + 1]),
+      lines(new LineStats[LoopTable::capacity]), counters(counters),
+      selfOverhead(0), pairOverhead(0), allocating(LoopTable::invalid),
+      home(ThreadState::noHome) {
+  for (uint32_t slot = 0; slot <= LoopTable::capacity; slot++)
+    this->stats[slot].reset();
+  for (uint32_t slot = 0; slot < LoopTable::capacity; slot++)
+    this->lines[slot].reset();
+}
+
+unsigned ThreadState::getTid() const {
+  return this->tid;
+}
+
+const LoopStats& ThreadState::getStats(uint32_t slot) const {
+  return this->stats[slot];
+}
+
+const LineStats& ThreadState::getLineStats(uint32_t slot) const {
+  return this->lines[slot];
+}
+
+const CounterSet& ThreadState::getCounters() const {
+  return this->counters;
+}
+
+void ThreadState::setTrace(TraceBuffer* trace) {
+  this->trace.reset(trace);
+}
+
+ArgBuffer* ThreadState::getArgs() {
+  return this->args.get();
+}
+
+void ThreadState::setArgs(ArgBuffer* args) {
+  this->args.reset(args);
+}
+
+const Cct* ThreadState::getCct() const {
+  return this->cct.get();
+}
+
+void ThreadState::setCct(Cct* cct) {
+  this->cct.reset(cct);
+}
+
+uint64_t ThreadState::getSelfOverhead() const {
+  return this->selfOverhead;
+}
+
+uint64_t ThreadState::getPairOverhead() const {
+  return this->pairOverhead;
+}
+
+void ThreadState::place(const Frame& frame, uint32_t cpu, uint64_t total) {
+  unsigned entered = Clock::getNode(frame.cpu);
+  unsigned exited = Clock::getNode(cpu);
+  if (this->home == ThreadState::noHome)
+    this->home = entered;
+
+  // Only the nodes at the ends are known. If the loop moved from one to the
+  // other, assume that it spent half its time on each.
+  unsigned remoteEnds = (entered != this->home) + (exited != this->home);
+  this->stats[frame.slot].addPlacement(
+      frame.cpu != cpu, entered != exited, total * remoteEnds / 2);
+}
+
+void ThreadState::sample(uint64_t samples) {
+  const auto relaxed = std::memory_order_relaxed;
+  unsigned depth = std::min(this->depth, ThreadState::maxDepth);
+  if (not depth)
+    return;
+
+  LoopStats& top = this->stats[this->stack[depth - 1].slot];
+  top.selfSamples.store(top.selfSamples.load(relaxed) + samples, relaxed);
+  if (this->cct)
+    this->cct->addSamples(this->stack[depth - 1].node, samples);
+
+  // A loop may be on the stack more than once if the function containing it
+  // is recursive. It should only be charged once.
+  for (unsigned i = 0; i < depth; i++) {
+    uint32_t slot = this->stack[i].slot;
+    bool seen = false;
+    for (unsigned j = 0; j < i and not seen; j++)
+      seen = this->stack[j].slot == slot;
+    if (not seen) {
+      LoopStats& stats = this->stats[slot];
+      stats.samples.store(stats.samples.load(relaxed) + samples, relaxed);
+    }
+  }
+}
+
+void ThreadState::forked(unsigned tid, bool sampling) {
+  this->tid = tid;
+  for (uint32_t slot = 0; slot <= LoopTable::capacity; slot++)
+    this->stats[slot].reset();
+  for (uint32_t slot = 0; slot < LoopTable::capacity; slot++)
+    this->lines[slot].reset();
+  this->counters.reset();
+  if (this->cct)
+    this->cct->clear();
+
+  // When sampling, the stack only has the slots and nodes, and those are
+  // still correct.
+  if (sampling)
+    return;
+
+  uint64_t start = now();
+  unsigned depth = std::min(this->depth, ThreadState::maxDepth);
+  for (unsigned i = 0; i < depth; i++) {
+    Frame& frame = this->stack[i];
+    frame.start = start;
+    frame.descendants = 0;
+    frame.children = 0;
+    if (this->trace)
+      this->trace->enter(frame.slot, start, i, frame.cpu);
+    this->counters.enter(frame.slot, i);
+  }
+}
+
+void ThreadState::calibrate(LoopTable& loops,
+                            unsigned iterations,
+                            bool placement) {
+  if (not iterations)
+    return;
+
+  // The calibration loop should not end up in the trace.
+  std::unique_ptr<TraceBuffer> trace = std::move(this->trace);
+
+  // This is a pointer that is not in the loop table. Looking it up costs
+  // about as much as looking up a loop that is.
+  static const char marker = 0;
+
+  // Take the smallest of several runs. Anything larger than that is due to
+  // interference (interrupts, frequency changes, etc.), not the sentinels.
+  const unsigned runs = 5;
+  LoopStats& stats = this->stats[ThreadState::scratch];
+  uint64_t self = UINT64_MAX;
+  uint64_t pair = UINT64_MAX;
+  for (unsigned run = 0; run < runs; run++) {
+    stats.reset();
+    uint64_t start = now();
+    for (unsigned i = 0; i < iterations; i++) {
+      uint32_t cpu = Clock::noCpu;
+      loops.find(&marker);
+      uint64_t begin = placement ? now(cpu) : now();
+      this->enter(ThreadState::scratch, begin, cpu);
+      loops.find(&marker);
+      uint64_t end = placement ? now(cpu) : now();
+      this->exit(ThreadState::scratch, end, cpu);
+    }
+    uint64_t elapsed = now() - start;
+
+    self = std::min(self, stats.total.load() / iterations);
+    pair = std::min(pair, elapsed / iterations);
+  }
+  stats.reset();
+  if (this->cct)
+    this->cct->reset();
+
+  this->selfOverhead = self;
+  this->pairOverhead = pair;
+  this->trace = std::move(trace);
+}
+
+const unsigned ThreadState::maxDepth;
+
+} // namespace lrt
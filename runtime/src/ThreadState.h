@@ -0,0 +1,411 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_THREAD_STATE_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_THREAD_STATE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "ArgLog.h"
+#include "Cct.h"
+#include "Clock.h"
+#include "Counters.h"
+#include "Lines.h"
+#include "LoopTable.h"
+#include "Throttle.h"
+#include "Trace.h"
+
+namespace lrt {
+
+// The aggregates for a single loop as seen by a single thread. Only the
+// owning thread ever writes to these, so updates do not need read-modify-write
+// operations. They are atomic only so that they can be read by other threads
+// (the monitor, for instance) without a data race.
+//
+// The times are in clock ticks and have already been corrected for the
+// overhead of the sentinels. The total is the inclusive time. The self time
+// excludes the time spent in nested loops. squares is the sum of the squares
+// of the total time of each entry, in ticks squared, from which the variance
+// of the time per entry can be computed.
+//
+// When the loops are sampled instead of timed, only the samples are
+// recorded. samples is the number of samples in which the loop was on the
+// stack and selfSamples the number in which it was the innermost loop.
+//
+// When the placement of the loops is recorded, migrations is the number of
+// times the loop was exited on a different CPU than the one on which it was
+// entered, and nodeMigrations the number of times it was on a different NUMA
+// node. remote is the part of the total time that was spent away from the
+// thread's home node.
+//
+// When the allocations of the loop are tracked, allocations is the number of
+// calls to the allocator made while it was the innermost tracked loop and
+// allocated is the number of bytes requested in those calls.
+//
+// When the loop is throttled, skipped is the number of entries that were not
+// timed. None of the other aggregates include those.
+struct LoopStats {
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> total;
+  std::atomic<uint64_t> self;
+  std::atomic<double> squares;
+  std::atomic<uint64_t> lastSeen;
+  std::atomic<uint64_t> samples;
+  std::atomic<uint64_t> selfSamples;
+  std::atomic<uint64_t> migrations;
+  std::atomic<uint64_t> nodeMigrations;
+  std::atomic<uint64_t> remote;
+  std::atomic<uint64_t> allocations;
+  std::atomic<uint64_t> allocated;
+  std::atomic<uint64_t> skipped;
+
+  void add(uint64_t total, uint64_t self, uint64_t when) {
+    const auto relaxed = std::memory_order_relaxed;
+    this->count.store(this->count.load(relaxed) + 1, relaxed);
+    this->total.store(this->total.load(relaxed) + total, relaxed);
+    this->self.store(this->self.load(relaxed) + self, relaxed);
+    this->squares.store(this->squares.load(relaxed)
+                            + static_cast<double>(total) * total,
+                        relaxed);
+    this->lastSeen.store(when, relaxed);
+  }
+
+  void addPlacement(bool migrated, bool nodeMigrated, uint64_t remote) {
+    const auto relaxed = std::memory_order_relaxed;
+    if (migrated)
+      this->migrations.store(this->migrations.load(relaxed) + 1, relaxed);
+    if (nodeMigrated)
+      this->nodeMigrations.store(this->nodeMigrations.load(relaxed) + 1,
+                                 relaxed);
+    if (remote)
+      this->remote.store(this->remote.load(relaxed) + remote, relaxed);
+  }
+
+  void addAllocation(uint64_t size) {
+    const auto relaxed = std::memory_order_relaxed;
+    this->allocations.store(this->allocations.load(relaxed) + 1, relaxed);
+    this->allocated.store(this->allocated.load(relaxed) + size, relaxed);
+  }
+
+  void reset() {
+    const auto relaxed = std::memory_order_relaxed;
+    this->count.store(0, relaxed);
+    this->total.store(0, relaxed);
+    this->self.store(0, relaxed);
+    this->squares.store(0, relaxed);
+    this->lastSeen.store(0, relaxed);
+    this->samples.store(0, relaxed);
+    this->selfSamples.store(0, relaxed);
+    this->migrations.store(0, relaxed);
+    this->nodeMigrations.store(0, relaxed);
+    this->remote.store(0, relaxed);
+    this->allocations.store(0, relaxed);
+    this->allocated.store(0, relaxed);
+    this->skipped.store(0, relaxed);
+  }
+};
+
+// An active loop on a thread.
+struct Frame {
+  uint32_t slot;
+
+  // The loop to which allocations were charged when this one was entered.
+  uint32_t outerAlloc;
+
+  uint64_t start;
+
+  // The number of loops that were entered and exited while this one was
+  // active, including those that were nested more than one level deep.
+  uint64_t descendants;
+
+  // The corrected inclusive time of the loops immediately nested in this one.
+  uint64_t children;
+
+  // The node for this loop in the calling-context tree.
+  uint32_t node;
+
+  // The CPU on which the loop was entered, if placement is being recorded.
+  uint32_t cpu;
+};
+
+// All the state that the runtime keeps for a single thread. An object of this
+// class is created the first time a thread enters a loop and is never freed
+// because the aggregates must outlive the thread.
+class ThreadState {
+public:
+  // The maximum nesting depth that is recorded. Loops that are nested more
+  // deeply than this are counted, but not timed.
+  static const unsigned maxDepth = 256;
+
+  // The slot in the stats array that is used while calibrating. This is past
+  // the end of the loop table, so it is never reported.
+  static const uint32_t scratch = LoopTable::capacity;
+
+private:
+  unsigned tid;
+  Frame stack[maxDepth];
+
+  // This may be greater than maxDepth if the loops are nested very deeply.
+  unsigned depth;
+
+  std::unique_ptr<LoopStats[]> stats;
+
+  // Indexed by the slot of the line in the table of lines.
+  std::unique_ptr<LineStats[]> lines;
+
+  // This will be null unless tracing has been enabled.
+  std::unique_ptr<TraceBuffer> trace;
+
+  // This will be null unless the arguments of functions are being logged.
+  std::unique_ptr<ArgBuffer> args;
+
+  CounterSet counters;
+
+  // This will be null unless the calling contexts are being recorded.
+  std::unique_ptr<Cct> cct;
+
+  // Indexed by slot. This is allocated the first time the thread enters a
+  // throttled loop.
+  std::unique_ptr<Throttled[]> throttled;
+
+  // The overhead, in ticks, of the sentinels. self is what is included in the
+  // measured time of the loop itself, i.e. the part of __enterLoop() after the
+  // clock is read and the part of __exitLoop() before it is read. pair is the
+  // cost of an entire __enterLoop()/__exitLoop() pair and is what a nested
+  // loop adds to the measured time of the loops that enclose it.
+  uint64_t selfOverhead;
+  uint64_t pairOverhead;
+
+  // The innermost active loop whose allocations are tracked, or
+  // LoopTable::invalid if there is none.
+  uint32_t allocating;
+
+  // The NUMA node on which the thread first exited a loop. Since memory is
+  // usually placed on the node of the thread that first touches it, time
+  // spent on any other node is counted as remote.
+  static const unsigned noHome = UINT32_MAX;
+  unsigned home;
+
+private:
+  // Get the frame to which the overhead of the loop that was just exited
+  // should be charged.
+  Frame* getParentFrame() {
+    if (not this->depth)
+      return nullptr;
+    return &this->stack[std::min(this->depth, ThreadState::maxDepth) - 1];
+  }
+
+  // Get the node in the calling-context tree for the loop in the slot when
+  // it is entered at the current depth. Loops that are nested too deeply to
+  // be on the stack are not recorded.
+  uint32_t getNode(uint32_t slot) {
+    if (not this->cct or this->depth >= ThreadState::maxDepth)
+      return Cct::root;
+    uint32_t parent = this->depth ? this->stack[this->depth - 1].node
+                                  : Cct::root;
+    return this->cct->getChild(parent, slot);
+  }
+
+public:
+  ThreadState(unsigned tid, Counters& counters);
+  ThreadState(const ThreadState&) = delete;
+  ThreadState(ThreadState&&) = delete;
+
+  unsigned getTid() const;
+  const LoopStats& getStats(uint32_t slot) const;
+  const LineStats& getLineStats(uint32_t slot) const;
+  const CounterSet& getCounters() const;
+  void setTrace(TraceBuffer* trace);
+  ArgBuffer* getArgs();
+  void setArgs(ArgBuffer* args);
+  const Cct* getCct() const;
+  void setCct(Cct* cct);
+  uint64_t getSelfOverhead() const;
+  uint64_t getPairOverhead() const;
+
+  // Measure the overhead of the sentinels on this thread. This runs the same
+  // code as the sentinels on an empty loop several times and must be called
+  // before the thread enters any loops.
+  void calibrate(LoopTable& loops, unsigned iterations, bool placement);
+
+  // Called in the child after a fork with the tid of the thread in the
+  // child. This clears everything that was inherited from the parent. The
+  // loops that were active when the process forked are still active in the
+  // child, but only the time that they spend in the child is counted. The
+  // trace buffer must already have been replaced.
+  void forked(unsigned tid, bool sampling);
+
+  // The CPU is Clock::noCpu unless the placement of the loops is recorded.
+  void enter(uint32_t slot, uint64_t start, uint32_t cpu) {
+    if (this->trace)
+      this->trace->enter(slot, start, this->depth, cpu);
+    if (this->depth < ThreadState::maxDepth)
+      this->stack[this->depth]
+          = {slot, this->allocating, start, 0, 0, this->getNode(slot), cpu};
+    this->counters.enter(slot, this->depth);
+    this->depth++;
+  }
+
+  // These are used instead of enter() and exit() when the loops are sampled.
+  // The signal handler that takes the samples runs on this thread, so it
+  // will only ever see the stack before or after an update, but the compiler
+  // must not move the update of the depth before that of the stack.
+  void push(uint32_t slot) {
+    if (this->depth < ThreadState::maxDepth) {
+      this->stack[this->depth].node = this->getNode(slot);
+      this->stack[this->depth].slot = slot;
+    }
+    std::atomic_signal_fence(std::memory_order_release);
+    this->depth++;
+  }
+
+  void pop() {
+    if (this->depth)
+      this->depth--;
+  }
+
+  // Check if the loop is the innermost active loop. This is used for loops
+  // that have been suppressed, which may or may not have been entered before
+  // that happened.
+  bool isInnermost(uint32_t slot) const {
+    return this->depth and this->depth <= ThreadState::maxDepth
+           and this->stack[this->depth - 1].slot == slot;
+  }
+
+  // Get the innermost active loop. Returns LoopTable::invalid if there is
+  // none or it is nested too deeply to be on the stack.
+  uint32_t getInnermost() const {
+    if (not this->depth or this->depth > ThreadState::maxDepth)
+      return LoopTable::invalid;
+    return this->stack[this->depth - 1].slot;
+  }
+
+  // Called after the loop has been entered if its allocations are tracked.
+  // Loops that are nested too deeply to be on the stack are not tracked.
+  void startAllocating(uint32_t slot) {
+    if (this->depth <= ThreadState::maxDepth)
+      this->allocating = slot;
+  }
+
+  // Called before the loop is exited if its allocations are tracked.
+  void stopAllocating(uint32_t slot) {
+    if (this->isInnermost(slot))
+      this->allocating = this->stack[this->depth - 1].outerAlloc;
+  }
+
+  // Charge an allocation of the given size to the innermost tracked loop.
+  // This is called from the allocator.
+  void allocate(uint64_t size) {
+    if (this->allocating != LoopTable::invalid)
+      this->stats[this->allocating].addAllocation(size);
+  }
+
+  // Count a hit of the line in the slot. The time is 0 unless it is recorded.
+  void hit(uint32_t slot, uint64_t time) {
+    this->lines[slot].hit(time);
+  }
+
+  // Get the throttling state of the loop in the slot on this thread.
+  Throttled& getThrottled(uint32_t slot) {
+    if (not this->throttled)
+      this->throttled.reset(new Throttled[LoopTable::capacity]());
+    return this->throttled[slot];
+  }
+
+  // Called instead of enter() when the loop is throttled. Returns true if
+  // this entry should be timed. The period is the one that the loop asked
+  // for and is only used the first time the thread enters the loop.
+  bool admit(uint32_t slot, uint32_t period) {
+    Throttled& throttled = this->getThrottled(slot);
+    if (not throttled.period)
+      throttled.period = period;
+    if (not throttled.skipping) {
+      if (not throttled.countdown) {
+        throttled.countdown = throttled.period - 1;
+        return true;
+      }
+      throttled.countdown--;
+    }
+    throttled.skipping++;
+
+    const auto relaxed = std::memory_order_relaxed;
+    LoopStats& stats = this->stats[slot];
+    stats.skipped.store(stats.skipped.load(relaxed) + 1, relaxed);
+    return false;
+  }
+
+  // Called before exit() when the loop is throttled. Returns true if the
+  // entry that is being exited was skipped, in which case there is nothing
+  // else to do.
+  bool release(uint32_t slot) {
+    if (not this->throttled or not this->throttled[slot].skipping)
+      return false;
+    this->throttled[slot].skipping--;
+    return true;
+  }
+
+  // Record where the loop in the frame ran. The loop was exited on the given
+  // CPU and took the given corrected time.
+  void place(const Frame& frame, uint32_t cpu, uint64_t total);
+
+  // Charge the given number of samples to the loops on the stack. This is
+  // called from a signal handler.
+  void sample(uint64_t samples);
+
+  // Returns the corrected time of the loop, or 0 if it was not timed.
+  uint64_t exit(uint32_t slot, uint64_t end, uint32_t cpu) {
+    // Unbalanced exits can happen if control leaves a loop in a way that
+    // skips the entry sentinel. There is nothing to be done about those.
+    if (not this->depth)
+      return 0;
+
+    this->depth--;
+    this->counters.exit(slot, this->depth);
+    if (this->trace)
+      this->trace->exit(slot, end, this->depth, cpu);
+    if (this->depth >= ThreadState::maxDepth) {
+      // The loop was not timed, but its sentinels still cost something.
+      this->stack[ThreadState::maxDepth - 1].descendants++;
+      return 0;
+    }
+
+    const Frame& frame = this->stack[this->depth];
+    uint64_t elapsed = end - frame.start;
+    uint64_t overhead
+        = this->selfOverhead + frame.descendants * this->pairOverhead;
+    uint64_t total = elapsed > overhead ? elapsed - overhead : 0;
+    uint64_t self = total > frame.children ? total - frame.children : 0;
+    this->stats[frame.slot].add(total, self, end);
+    if (this->cct)
+      this->cct->add(frame.node, total, self);
+    if (frame.cpu != Clock::noCpu and cpu != Clock::noCpu)
+      this->place(frame, cpu, total);
+
+    if (Frame* parent = this->getParentFrame()) {
+      parent->descendants += frame.descendants + 1;
+      parent->children += total;
+    }
+
+    return total;
+  }
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_THREAD_STATE_H
@@ -0,0 +1,87 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+
+#include "Throttle.h"
+#include "Clock.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace lrt {
+
+Throttle::Throttle() : second(0) {
+  for (uint32_t slot = 0; slot < LoopTable::capacity; slot++) {
+    this->periods[slot].store(0, std::memory_order_relaxed);
+    this->budgets[slot].store(0, std::memory_order_relaxed);
+  }
+}
+
+void Throttle::resolve(LoopTable& loops, uint32_t slot) {
+  const std::string& desc = loops.getDescriptor(slot);
+  std::string value;
+  uint32_t period = 0;
+  uint64_t budget = 0;
+  if (LoopTable::getOption(desc, "sample", value))
+    period = std::min<unsigned long>(std::strtoul(value.c_str(), nullptr, 10),
+                                     Throttle::maxPeriod);
+  if (LoopTable::getOption(desc, "budget", value))
+    budget = std::strtoull(value.c_str(), nullptr, 10)
+             / Clock::getNsPerTick();
+  if (not period and not budget)
+    return;
+
+  // The budget is written first so that a thread that sees the period will
+  // also see the budget.
+  this->budgets[slot].store(budget, std::memory_order_relaxed);
+  this->periods[slot].store(std::max<uint32_t>(period, 1),
+                            std::memory_order_release);
+}
+
+void Throttle::start(LoopTable& loops) {
+  this->second = 1000000000 / Clock::getNsPerTick();
+  loops.onInsert([this, &loops](uint32_t slot) { this->resolve(loops, slot); });
+}
+
+void Throttle::charge(Throttled& throttled,
+                      uint32_t slot,
+                      uint64_t overhead,
+                      uint64_t end) const {
+  uint64_t budget = this->getBudget(slot);
+  if (not budget)
+    return;
+
+  if (not throttled.window)
+    throttled.window = end;
+  throttled.spent += overhead;
+  if (throttled.spent > budget) {
+    throttled.period = std::min(throttled.period * 2, Throttle::maxPeriod);
+  } else if (end - throttled.window >= this->second) {
+    if (throttled.spent < budget / 2)
+      throttled.period
+          = std::max(throttled.period / 2, this->getPeriod(slot));
+  } else {
+    return;
+  }
+
+  throttled.window = end;
+  throttled.spent = 0;
+  throttled.countdown = std::min(throttled.countdown, throttled.period - 1);
+}
+
+const uint32_t Throttle::maxPeriod;
+
+} // namespace lrt
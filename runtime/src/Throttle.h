@@ -0,0 +1,115 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_THROTTLE_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_THROTTLE_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "LoopTable.h"
+
+namespace lrt {
+
+// The state of a throttled loop on a single thread. This is only ever
+// accessed by the owning thread.
+//
+// period is the current sampling period, i.e. one in every period entries is
+// timed. It is 0 until the thread first enters the loop. countdown is the
+// number of entries to skip before the next one that is timed. skipping is
+// the number of instances of the loop that were skipped and are still
+// active. Once an instance is skipped, the instances nested in it, if the
+// function containing it is recursive, are skipped as well, so the innermost
+// instance is the one that was skipped as long as this is not 0.
+//
+// spent is the overhead, in ticks, of the sentinels of the timed entries
+// since window, the time at which the current budget window started.
+struct Throttled {
+  uint32_t period;
+  uint32_t countdown;
+  uint32_t skipping;
+  uint64_t window;
+  uint64_t spent;
+};
+
+// Times only some of the entries of the loops that ask for it with the sample
+// and budget options (the sample and budget clauses of the instrument
+// plugin). The entries that are skipped cost a lookup of the descriptor and
+// a few instructions in each sentinel. The clock is not read, and the stack,
+// counters and trace are not touched.
+//
+// With sample=<n>, one in every n entries is timed on each thread. With
+// budget=<ns>, the period is adjusted on each thread so that the sentinels of
+// the timed entries cost no more than ns nanoseconds in each second. The
+// period is doubled whenever the budget is exceeded and halved when less than
+// half of it was used in a second, but it never drops below the one given
+// with sample.
+//
+// The aggregates of a throttled loop are those of the entries that were
+// timed. The number of entries that were skipped is kept as well, so the
+// totals can be scaled up.
+class Throttle {
+public:
+  // The period is never raised past this.
+  static const uint32_t maxPeriod = 1U << 20;
+
+private:
+  // Indexed by slot. The period is 0 if the loop is not throttled. The budget
+  // is in ticks per second and is 0 if the loop has no budget.
+  std::atomic<uint32_t> periods[LoopTable::capacity];
+  std::atomic<uint64_t> budgets[LoopTable::capacity];
+
+  // One second in ticks.
+  uint64_t second;
+
+private:
+  void resolve(LoopTable& loops, uint32_t slot);
+
+public:
+  Throttle();
+  Throttle(const Throttle&) = delete;
+  Throttle(Throttle&&) = delete;
+
+  // Check the options of every loop that is added to the table from now on.
+  // The clock must have been calibrated before this is called.
+  void start(LoopTable& loops);
+
+  bool isThrottled(uint32_t slot) const {
+    if (slot >= LoopTable::capacity)
+      return false;
+    return this->periods[slot].load(std::memory_order_relaxed);
+  }
+
+  uint32_t getPeriod(uint32_t slot) const {
+    return this->periods[slot].load(std::memory_order_relaxed);
+  }
+
+  uint64_t getBudget(uint32_t slot) const {
+    return this->budgets[slot].load(std::memory_order_relaxed);
+  }
+
+  // Charge the overhead of a timed entry that was exited at the given time
+  // to the budget of the loop and adjust the period if necessary.
+  void charge(Throttled& throttled,
+              uint32_t slot,
+              uint64_t overhead,
+              uint64_t end) const;
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_THROTTLE_H
@@ -0,0 +1,140 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Trace.h"
+#include "Clock.h"
+#include "ThreadState.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstdio>
+
+namespace lrt {
+
+static_assert(trace::maxDepth == ThreadState::maxDepth,
+              "The trace must be able to hold the entire loop stack");
+
+TraceBuffer::TraceBuffer(trace::Header* header, size_t size)
+    : header(header), records(trace::getRecords(header)), size(size) {
+  ;
+}
+
+TraceBuffer::~TraceBuffer() {
+  munmap(this->header, this->size);
+}
+
+Trace::Trace(const std::string& dir, uint32_t capacity)
+    : dir(dir), capacity(capacity ? capacity : 1), loopsFd(-1) {
+  ;
+}
+
+Trace::~Trace() {
+  if (this->loopsFd >= 0)
+    close(this->loopsFd);
+}
+
+static int openLoops(const std::string& dir) {
+  std::string name = trace::getLoopsName(dir, getpid());
+  int fd = open(name.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_APPEND, 0644);
+  if (fd < 0)
+    std::fprintf(stderr, "loop-runtime: Could not create %s\n", name.c_str());
+  return fd;
+}
+
+bool Trace::start(LoopTable& loops) {
+  this->loopsFd = openLoops(this->dir);
+  if (this->loopsFd < 0)
+    return false;
+
+  loops.onInsert([this, &loops](uint32_t slot) { this->addLoop(loops, slot); });
+
+  return true;
+}
+
+bool Trace::restart(LoopTable& loops) {
+  // The descriptor is shared with the parent, which is still appending to it.
+  if (this->loopsFd >= 0)
+    close(this->loopsFd);
+
+  this->loopsFd = openLoops(this->dir);
+  if (this->loopsFd < 0)
+    return false;
+
+  for (uint32_t slot = 0; slot < loops.size(); slot++)
+    this->addLoop(loops, slot);
+
+  return true;
+}
+
+void Trace::addLoop(LoopTable& loops, uint32_t slot) {
+  if (this->loopsFd < 0)
+    return;
+
+  // A single write() to a file opened with O_APPEND goes straight to the page
+  // cache, so it survives the process being killed just like the buffers.
+  char prefix[64];
+  std::snprintf(
+      prefix, sizeof(prefix), "%u %016" PRIx64 " ", slot, loops.getId(slot));
+  std::string line = prefix;
+  line.append(loops.getDescriptor(slot));
+  line.append("\n");
+  if (write(this->loopsFd, line.c_str(), line.size()) != (ssize_t)line.size())
+    std::fprintf(stderr, "loop-runtime: Could not record loop %u\n", slot);
+}
+
+TraceBuffer* Trace::createBuffer(unsigned tid) {
+  // The events cannot be interpreted without the descriptors.
+  if (this->loopsFd < 0)
+    return nullptr;
+
+  std::string name = trace::getName(this->dir, getpid(), tid);
+  int fd = open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::fprintf(stderr, "loop-runtime: Could not create %s\n", name.c_str());
+    return nullptr;
+  }
+
+  size_t size = trace::getSize(this->capacity);
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return nullptr;
+
+  // The file is zero-filled by ftruncate, so only the header needs to be
+  // filled in.
+  trace::Header* header = static_cast<trace::Header*>(addr);
+  header->version = trace::version;
+  header->pid = getpid();
+  header->tid = tid;
+  header->ppid = getppid();
+  header->capacity = this->capacity;
+  header->nsPerTick = Clock::getNsPerTick();
+  header->baseTicks = now();
+  header->baseNs = Clock::toMonotonic(header->baseTicks);
+  header->magic = trace::magic;
+
+  return new TraceBuffer(header, size);
+}
+
+} // namespace lrt
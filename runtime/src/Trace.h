@@ -0,0 +1,109 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_TRACE_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_TRACE_H
+
+#include <string>
+
+#include "Clock.h"
+#include "LoopTable.h"
+#include "TraceFile.h"
+
+namespace lrt {
+
+// A per-thread ring buffer of loop entry and exit events that lives in a
+// memory-mapped file. See TraceFile.h for the layout.
+class TraceBuffer {
+private:
+  trace::Header* header;
+  trace::Record* records;
+  size_t size;
+
+public:
+  TraceBuffer(trace::Header* header, size_t size);
+  TraceBuffer(const TraceBuffer&) = delete;
+  TraceBuffer(TraceBuffer&&) = delete;
+  ~TraceBuffer();
+
+  // The depth is that of the thread's loop stack before the loop was entered.
+  void enter(uint32_t slot, uint64_t time, unsigned depth, uint32_t cpu) {
+    this->record(slot, time, trace::Enter, cpu);
+    if (depth < trace::maxDepth) {
+      this->header->stack[depth] = slot;
+      this->header->started[depth] = time;
+    }
+    this->header->depth.store(depth + 1, std::memory_order_release);
+  }
+
+  // The depth is that of the thread's loop stack after the loop was exited.
+  void exit(uint32_t slot, uint64_t time, unsigned depth, uint32_t cpu) {
+    this->record(slot, time, trace::Exit, cpu);
+    this->header->depth.store(depth, std::memory_order_release);
+  }
+
+  void record(uint32_t slot, uint64_t time, trace::Kind kind, uint32_t cpu) {
+    uint64_t head = this->header->head.load(std::memory_order_relaxed);
+    trace::Record& rec = this->records[head % this->header->capacity];
+    rec.time = time;
+    rec.slot = slot;
+    rec.kind = kind;
+    if (cpu == Clock::noCpu) {
+      rec.node = trace::noNode;
+      rec.cpu = trace::noCpu;
+    } else {
+      rec.node = Clock::getNode(cpu);
+      rec.cpu = Clock::getCpu(cpu);
+    }
+    this->header->head.store(head + 1, std::memory_order_release);
+  }
+};
+
+// The process-wide part of the trace. This keeps the descriptor file up to
+// date and creates the buffers for each thread.
+class Trace {
+private:
+  std::string dir;
+  uint32_t capacity;
+  int loopsFd;
+
+private:
+  void addLoop(LoopTable& loops, uint32_t slot);
+
+public:
+  Trace(const std::string& dir, uint32_t capacity);
+  Trace(const Trace&) = delete;
+  Trace(Trace&&) = delete;
+  ~Trace();
+
+  // Create the descriptor file. This must be called before any loops are
+  // added to the table. Returns false if the file could not be created.
+  bool start(LoopTable& loops);
+
+  // Called in the child after a fork. This creates the descriptor file for
+  // the child and copies every loop that is already in the table to it.
+  // Returns false if the file could not be created, in which case no buffers
+  // will be created in the child.
+  bool restart(LoopTable& loops);
+
+  // Create a buffer for the thread with the given tid. Returns nullptr if the
+  // file could not be created, in which case the thread is not traced.
+  TraceBuffer* createBuffer(unsigned tid);
+};
+
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_TRACE_H
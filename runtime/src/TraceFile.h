@@ -0,0 +1,146 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef CLANG_PLUGIN_EXAMPLES_RUNTIME_TRACE_FILE_H
+#define CLANG_PLUGIN_EXAMPLES_RUNTIME_TRACE_FILE_H
+
+// The layout of the trace files. These are written by the runtime and read by
+// the loop-recover tool, so this should not include anything from the rest of
+// the runtime.
+//
+// Each thread has its own file, loop-trace.<pid>.<tid>, that is mapped into
+// memory. Since the mapping is shared, anything written to it is in the page
+// cache and will be written back by the kernel even if the process is killed.
+// The descriptors of the loops are in a separate file, loop-trace.<pid>.loops,
+// that is appended to whenever a new loop is seen. Each line of that file is
+// of the form
+//
+//     <slot> <id> <descriptor>
+//
+// A process that is forked from a traced process gets its own files. The
+// child inherits the parent's loop table, so the slots in the child's
+// descriptor file are the same as those in the parent's.
+//
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+
+namespace lrt {
+namespace trace {
+
+const uint64_t magic = 0x4352542d54524c00ULL; // "LRT-TRC"
+const uint32_t version = 4;
+
+// The depth of the loop stack that is kept in the file. This should be the
+// same as ThreadState::maxDepth.
+const unsigned maxDepth = 256;
+
+// Used in a record when the CPU and node were not recorded.
+const uint16_t noCpu = 0xffff;
+const uint8_t noNode = 0xff;
+
+enum Kind : uint8_t {
+  Enter,
+  Exit,
+};
+
+// The time is in clock ticks. Use the nsPerTick field of the header to convert
+// it to nanoseconds. The CPU and NUMA node on which the event happened are
+// only recorded if LOOP_RUNTIME_PLACEMENT was set.
+struct Record {
+  uint64_t time;
+  uint32_t slot;
+  uint8_t kind;
+  uint8_t node;
+  uint16_t cpu;
+};
+
+struct Header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t pid;
+  uint32_t tid;
+
+  // The parent of the process when the buffer was created. This is used to
+  // find the processes in a process tree.
+  uint32_t ppid;
+
+  // The number of records in the ring buffer that follows the header.
+  uint32_t capacity;
+  uint32_t reserved0;
+
+  double nsPerTick;
+
+  // A time in ticks and the same time on the monotonic clock. These are used
+  // to put the events of different processes on the same timeline.
+  uint64_t baseTicks;
+  uint64_t baseNs;
+
+  // The total number of records that have been written. The record at
+  // head % capacity is the next one to be written. A record is always
+  // completely written before this is incremented, so a record that was
+  // being written when the process died will not be visible.
+  std::atomic<uint64_t> head;
+
+  // A copy of the loop stack of the thread. This is what makes it possible
+  // to know which loops were active when the process died even if their entry
+  // events have been overwritten in the ring buffer. Only the first
+  // min(depth, maxDepth) entries are valid.
+  std::atomic<uint32_t> depth;
+  uint32_t reserved1;
+  uint32_t stack[maxDepth];
+  uint64_t started[maxDepth];
+};
+
+inline std::string getName(const std::string& dir, pid_t pid, pid_t tid) {
+  return dir + "/loop-trace." + std::to_string(pid) + "."
+         + std::to_string(tid);
+}
+
+inline std::string getLoopsName(const std::string& dir, pid_t pid) {
+  return dir + "/loop-trace." + std::to_string(pid) + ".loops";
+}
+
+inline size_t getSize(uint32_t capacity) {
+  return sizeof(Header) + capacity * sizeof(Record);
+}
+
+// Convert a time in ticks from the trace to a time on the monotonic clock.
+inline uint64_t toMonotonic(const Header* header, uint64_t ticks) {
+  if (ticks < header->baseTicks)
+    return header->baseNs
+           - static_cast<uint64_t>((header->baseTicks - ticks)
+                                   * header->nsPerTick);
+  return header->baseNs
+         + static_cast<uint64_t>((ticks - header->baseTicks)
+                                 * header->nsPerTick);
+}
+
+inline Record* getRecords(Header* header) {
+  return reinterpret_cast<Record*>(header + 1);
+}
+
+inline const Record* getRecords(const Header* header) {
+  return reinterpret_cast<const Record*>(header + 1);
+}
+
+} // namespace trace
+} // namespace lrt
+
+#endif // CLANG_PLUGIN_EXAMPLES_RUNTIME_TRACE_FILE_H
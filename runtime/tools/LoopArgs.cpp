@@ -0,0 +1,360 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+// Reads the argument logs left behind by a process that was run with
+// LOOP_RUNTIME_ARGS and prints each call that was logged on each thread with
+// its arguments formatted according to their types.
+//
+//     loop-args [-n <calls>] <dir> <pid>
+//
+// By default, every call is printed. Otherwise, only the last <calls> calls
+// of each thread are printed. The times are relative to the earliest log of
+// the process.
+
+#include "ArgLogFile.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace lrt;
+
+// The type of an argument as described in the args option of the descriptor.
+struct Arg {
+  std::string name;
+  char tag;
+  uint32_t size;
+};
+
+struct Function {
+  std::string name;
+  std::vector<Arg> args;
+};
+
+struct Log {
+  pid_t tid;
+  const args::Header* header;
+  size_t size;
+};
+
+static void usage(const char* prog) {
+  std::fprintf(stderr, "Usage: %s [-n <calls>] <dir> <pid>\n", prog);
+  std::exit(1);
+}
+
+static std::vector<std::string> split(const std::string& s, char sep) {
+  std::vector<std::string> fields;
+  std::istringstream ss(s);
+  std::string field;
+  while (std::getline(ss, field, sep))
+    fields.push_back(field);
+  return fields;
+}
+
+// The function is named by the function field of the descriptor if there is
+// one and its location otherwise.
+static Function parseFunction(const std::string& desc) {
+  Function function;
+  std::vector<std::string> fields = split(desc, '|');
+  if (fields.size() > 1 and not fields[1].empty())
+    function.name = fields[1];
+  else if (not fields.empty())
+    function.name = fields[0];
+
+  if (fields.size() <= 5)
+    return function;
+  for (const std::string& option : split(fields[5], ',')) {
+    if (option.compare(0, 5, "args=") != 0)
+      continue;
+    for (const std::string& arg : split(option.substr(5), ';')) {
+      size_t colon = arg.rfind(':');
+      if (colon == std::string::npos or colon + 2 >= arg.size())
+        continue;
+      function.args.push_back({arg.substr(0, colon),
+                               arg[colon + 1],
+                               static_cast<uint32_t>(
+                                   std::atoi(arg.c_str() + colon + 2))});
+    }
+  }
+  return function;
+}
+
+static std::map<uint32_t, Function> readFunctions(const std::string& dir,
+                                                  pid_t pid) {
+  std::map<uint32_t, Function> functions;
+  std::ifstream in(args::getFunctionsName(dir, pid));
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream ss(line);
+    uint32_t slot;
+    std::string id, desc;
+    if (ss >> slot >> id) {
+      std::getline(ss >> std::ws, desc);
+      functions[slot] = parseFunction(desc);
+    }
+  }
+  return functions;
+}
+
+// Find the tids of all the threads of the process that have argument logs.
+static std::vector<pid_t> findThreads(const std::string& dir, pid_t pid) {
+  std::vector<pid_t> tids;
+  std::string prefix = "loop-args." + std::to_string(pid) + ".";
+  if (DIR* d = opendir(dir.c_str())) {
+    while (struct dirent* ent = readdir(d)) {
+      std::string name = ent->d_name;
+      if (name.compare(0, prefix.size(), prefix) != 0)
+        continue;
+      std::string suffix = name.substr(prefix.size());
+      if (not suffix.empty()
+          and suffix.find_first_not_of("0123456789") == std::string::npos)
+        tids.push_back(std::atoi(suffix.c_str()));
+    }
+    closedir(d);
+  }
+  std::sort(tids.begin(), tids.end());
+  return tids;
+}
+
+static const args::Header* mapLog(const std::string& name, size_t& size) {
+  int fd = open(name.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 or st.st_size < (off_t)sizeof(args::Header)) {
+    close(fd);
+    return nullptr;
+  }
+
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return nullptr;
+
+  const args::Header* header = static_cast<const args::Header*>(addr);
+  if (header->magic != args::magic or header->version != args::version
+      or (size_t)st.st_size < args::getSize(header->capacity)
+      or header->end.load() > header->capacity) {
+    std::fprintf(stderr, "%s is not a loop-runtime argument log\n",
+                 name.c_str());
+    munmap(addr, st.st_size);
+    return nullptr;
+  }
+
+  size = st.st_size;
+  return header;
+}
+
+template <typename T>
+static T get(const char* bytes) {
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+static std::string format(const Arg& arg, const char* bytes) {
+  char buf[64];
+  switch (arg.tag) {
+  case 'b':
+    if (arg.size == 1)
+      return bytes[0] ? "true" : "false";
+    break;
+  case 'c':
+    if (arg.size == 1) {
+      unsigned char c = bytes[0];
+      if (c >= 0x20 and c < 0x7f and c != '\'' and c != '\\')
+        std::snprintf(buf, sizeof(buf), "'%c'", c);
+      else
+        std::snprintf(buf, sizeof(buf), "'\\x%02x'", c);
+      return buf;
+    } else if (arg.size == 2) {
+      std::snprintf(buf, sizeof(buf), "U+%04x", get<uint16_t>(bytes));
+      return buf;
+    } else if (arg.size == 4) {
+      std::snprintf(buf, sizeof(buf), "U+%04x", get<uint32_t>(bytes));
+      return buf;
+    }
+    break;
+  case 'i':
+    if (arg.size == 1)
+      return std::to_string(get<int8_t>(bytes));
+    else if (arg.size == 2)
+      return std::to_string(get<int16_t>(bytes));
+    else if (arg.size == 4)
+      return std::to_string(get<int32_t>(bytes));
+    else if (arg.size == 8)
+      return std::to_string(get<int64_t>(bytes));
+    break;
+  case 'u':
+    if (arg.size == 1)
+      return std::to_string(get<uint8_t>(bytes));
+    else if (arg.size == 2)
+      return std::to_string(get<uint16_t>(bytes));
+    else if (arg.size == 4)
+      return std::to_string(get<uint32_t>(bytes));
+    else if (arg.size == 8)
+      return std::to_string(get<uint64_t>(bytes));
+    break;
+  case 'f':
+    // The size of a long double is not the same everywhere, so it can only
+    // be formatted if it is the same as the one here.
+    if (arg.size == sizeof(float)) {
+      std::snprintf(buf, sizeof(buf), "%g", get<float>(bytes));
+      return buf;
+    } else if (arg.size == sizeof(double)) {
+      std::snprintf(buf, sizeof(buf), "%g", get<double>(bytes));
+      return buf;
+    } else if (arg.size == sizeof(long double)) {
+      std::snprintf(buf, sizeof(buf), "%Lg", get<long double>(bytes));
+      return buf;
+    }
+    break;
+  case 'p':
+    if (arg.size == 4) {
+      std::snprintf(buf, sizeof(buf), "0x%" PRIx32, get<uint32_t>(bytes));
+      return buf;
+    } else if (arg.size == 8) {
+      std::snprintf(buf, sizeof(buf), "0x%" PRIx64, get<uint64_t>(bytes));
+      return buf;
+    }
+    break;
+  }
+
+  // Anything else is printed as the bytes in memory order.
+  std::string s = "{";
+  for (uint32_t i = 0; i < arg.size; i++) {
+    std::snprintf(buf, sizeof(buf), "%s%02x", i ? " " : "", (uint8_t)bytes[i]);
+    s += buf;
+  }
+  return s + "}";
+}
+
+static void print(const Log& log,
+                  const std::map<uint32_t, Function>& functions,
+                  uint64_t base,
+                  uint64_t numCalls) {
+  const args::Header* header = log.header;
+  const char* data = args::getData(header);
+  uint64_t end = header->end.load();
+
+  // The records have different sizes, so they must all be walked to find the
+  // last few.
+  std::vector<uint64_t> offsets;
+  for (uint64_t off = 0; off < end;) {
+    const args::Record* rec = reinterpret_cast<const args::Record*>(data + off);
+    if (args::getRecordSize(rec->size) > end - off)
+      break;
+    offsets.push_back(off);
+    off += args::getRecordSize(rec->size);
+  }
+
+  std::printf("thread %u: %zu calls", log.tid, offsets.size());
+  if (uint64_t dropped = header->dropped.load())
+    std::printf(", %" PRIu64 " dropped because the log was full", dropped);
+  std::printf("\n");
+
+  size_t from = 0;
+  if (numCalls and offsets.size() > numCalls)
+    from = offsets.size() - numCalls;
+  for (size_t i = from; i < offsets.size(); i++) {
+    const args::Record* rec
+        = reinterpret_cast<const args::Record*>(data + offsets[i]);
+    const char* bytes = reinterpret_cast<const char*>(rec + 1);
+    double ms = (args::toMonotonic(header, rec->time) - base) / 1e6;
+
+    auto it = functions.find(rec->slot);
+    if (it == functions.end()) {
+      std::printf("  %12.3f ms  <unknown function %u>\n", ms, rec->slot);
+      continue;
+    }
+
+    // The arguments are only formatted if the record has exactly as many
+    // bytes as the descriptor says it should.
+    const Function& function = it->second;
+    uint32_t size = 0;
+    for (const Arg& arg : function.args)
+      size += arg.size;
+    std::string call = function.name + "(";
+    if (size == rec->size) {
+      for (size_t j = 0; j < function.args.size(); j++) {
+        const Arg& arg = function.args[j];
+        call += (j ? ", " : "") + arg.name + "=" + format(arg, bytes);
+        bytes += arg.size;
+      }
+    } else {
+      call += "...";
+    }
+    std::printf("  %12.3f ms  %s)\n", ms, call.c_str());
+  }
+  std::printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+  uint64_t numCalls = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      numCalls = std::strtoull(optarg, nullptr, 10);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 2)
+    usage(argv[0]);
+
+  std::string dir = argv[optind];
+  pid_t pid = std::atoi(argv[optind + 1]);
+
+  std::map<uint32_t, Function> functions = readFunctions(dir, pid);
+  std::vector<Log> logs;
+  for (pid_t tid : findThreads(dir, pid)) {
+    size_t size;
+    if (const args::Header* header = mapLog(args::getName(dir, pid, tid), size))
+      logs.push_back({tid, header, size});
+  }
+  if (logs.empty()) {
+    std::fprintf(
+        stderr, "No argument logs for process %d in %s\n", pid, dir.c_str());
+    return 1;
+  }
+
+  uint64_t base = UINT64_MAX;
+  for (const Log& log : logs)
+    base = std::min(base, log.header->baseNs);
+  for (const Log& log : logs) {
+    print(log, functions, base, numCalls);
+    munmap(const_cast<args::Header*>(log.header), log.size);
+  }
+
+  return 0;
+}
@@ -0,0 +1,361 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+// Compares two profiles written by the runtime, for instance from runs before
+// and after a change, and reports the loops that got significantly slower.
+//
+//     loop-diff [-c <confidence>] [-t <percent>] <before> <after>
+//
+// The loops are matched by their file, function, name and position within the
+// function, i.e. the first loop in a function in one profile is matched with
+// the first loop in the same function in the other. The line, the cost and
+// the clauses are not compared, so a loop that was moved or whose body was
+// changed is still matched. For each loop that is in both profiles, the change in the mean time per entry is printed along with
+// a confidence interval for it. The profile has the mean and standard
+// deviation of the time of each entry, so the interval is computed using
+// Welch's test with a normal approximation, which is reasonable since loops
+// are usually entered many times. If the loops were sampled, the total time
+// is compared instead and the number of samples is assumed to be Poisson
+// distributed.
+//
+// A loop is reported as slower if the whole confidence interval is above 0
+// and the change is at least the threshold. The confidence is 95% and the
+// threshold 1% by default. The exit status is 0 if no loop got slower, 1 if
+// at least one did and 2 if the profiles could not be compared.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Loop {
+  std::string id;
+  uint64_t count;
+  uint64_t total;
+  double stddev;
+  std::string desc;
+};
+
+struct Profile {
+  unsigned version;
+
+  // The sampling period in nanoseconds, or 0 if the loops were timed.
+  uint64_t period;
+
+  // Keyed by the key that is used to match the loops (see getKeys()).
+  std::map<std::string, Loop> loops;
+};
+
+struct Change {
+  const Loop* before;
+  const Loop* after;
+  double meanBefore;
+  double meanAfter;
+
+  // These are percentages of the mean before the change.
+  double change;
+  double low;
+  double high;
+  bool bounded;
+  const char* verdict;
+};
+
+static void usage(const char* prog) {
+  std::fprintf(stderr,
+               "Usage: %s [-c <confidence>] [-t <percent>] <before> <after>\n",
+               prog);
+  std::exit(2);
+}
+
+static std::vector<std::string> split(const std::string& line) {
+  std::vector<std::string> fields;
+  std::string field;
+  std::istringstream ss(line);
+  while (std::getline(ss, field, '\t'))
+    fields.push_back(field);
+  return fields;
+}
+
+static std::string getField(const std::string& desc, unsigned field) {
+  size_t beg = 0;
+  for (unsigned i = 0; i < field; i++) {
+    beg = desc.find('|', beg);
+    if (beg == std::string::npos)
+      return "";
+    beg++;
+  }
+
+  size_t end = desc.find('|', beg);
+  if (end == std::string::npos)
+    return desc.substr(beg);
+  return desc.substr(beg, end - beg);
+}
+
+// The loops are matched on <file>|<function>|<name>|<kind>#<n> where n is
+// the position of the loop among those with the same file, function, name
+// and kind, in the order in which they appear in the source. The kind
+// distinguishes functions and the chunks of OpenMP loops from loops.
+static void getKeys(std::vector<Loop>& loops, Profile& profile) {
+  struct Pos {
+    std::string base;
+    unsigned line;
+    unsigned column;
+    const Loop* loop;
+  };
+
+  std::vector<Pos> positions;
+  for (const Loop& loop : loops) {
+    // The file name may itself contain colons.
+    std::string loc = getField(loop.desc, 0);
+    size_t colon = loc.rfind(':');
+    size_t prev = colon ? loc.rfind(':', colon - 1) : std::string::npos;
+    Pos pos = {"", 0, 0, &loop};
+    std::string file = loc;
+    if (colon != std::string::npos and prev != std::string::npos) {
+      file = loc.substr(0, prev);
+      pos.line = std::strtoul(loc.c_str() + prev + 1, nullptr, 10);
+      pos.column = std::strtoul(loc.c_str() + colon + 1, nullptr, 10);
+    }
+
+    std::string kind = "loop";
+    std::string options = "," + getField(loop.desc, 5) + ",";
+    if (options.find(",function,") != std::string::npos)
+      kind = "function";
+    else if (options.find(",chunk,") != std::string::npos)
+      kind = "chunk";
+    pos.base = file + "|" + getField(loop.desc, 1) + "|"
+               + getField(loop.desc, 2) + "|" + kind;
+    positions.push_back(pos);
+  }
+
+  std::stable_sort(
+      positions.begin(), positions.end(), [](const Pos& l, const Pos& r) {
+        if (l.base != r.base)
+          return l.base < r.base;
+        if (l.line != r.line)
+          return l.line < r.line;
+        if (l.column != r.column)
+          return l.column < r.column;
+        return l.loop->desc < r.loop->desc;
+      });
+
+  unsigned n = 0;
+  for (size_t i = 0; i < positions.size(); i++) {
+    n = (i and positions[i].base == positions[i - 1].base) ? n + 1 : 0;
+    profile.loops[positions[i].base + "#" + std::to_string(n)]
+        = *positions[i].loop;
+  }
+}
+
+static bool readProfile(const char* name, Profile& profile) {
+  std::ifstream in(name);
+  if (not in) {
+    std::fprintf(stderr, "Could not open %s\n", name);
+    return false;
+  }
+
+  profile.version = 0;
+  profile.period = 0;
+  std::vector<Loop> loops;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty())
+      continue;
+    if (line[0] == '#') {
+      std::sscanf(line.c_str(), "# loop-runtime profile %u", &profile.version);
+      std::sscanf(line.c_str(), "# sampled %" SCNu64, &profile.period);
+      continue;
+    }
+
+    // Older profiles do not have the standard deviation.
+    std::vector<std::string> fields = split(line);
+    bool hasStddev = profile.version >= 3;
+    if (fields.size() < (hasStddev ? 6 : 5))
+      continue;
+    Loop loop;
+    loop.id = fields[0];
+    loop.count = std::strtoull(fields[1].c_str(), nullptr, 10);
+    loop.total = std::strtoull(fields[2].c_str(), nullptr, 10);
+    loop.stddev = hasStddev ? std::strtod(fields[4].c_str(), nullptr) : -1;
+    loop.desc = fields[hasStddev ? 5 : 4];
+    loops.push_back(loop);
+  }
+  getKeys(loops, profile);
+
+  if (not profile.version) {
+    std::fprintf(stderr, "%s is not a loop profile\n", name);
+    return false;
+  }
+  return true;
+}
+
+// Get the z such that a standard normal variable lies in [-z, z] with the
+// given probability.
+static double getZ(double confidence) {
+  double alpha = 1 - confidence;
+  double lo = 0;
+  double hi = 40;
+  for (unsigned i = 0; i < 100; i++) {
+    double mid = (lo + hi) / 2;
+    if (std::erfc(mid / std::sqrt(2.0)) > alpha)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return (lo + hi) / 2;
+}
+
+static Change compare(const Loop& before,
+                      const Loop& after,
+                      const Profile& from,
+                      const Profile& to,
+                      double z,
+                      double threshold) {
+  Change c = {&before, &after, 0, 0, 0, 0, 0, false, "-"};
+
+  // The variance of the mean. This is negative if it is not known.
+  double varBefore = -1;
+  double varAfter = -1;
+  if (from.period) {
+    c.meanBefore = before.total;
+    c.meanAfter = after.total;
+    varBefore = static_cast<double>(before.count) * from.period * from.period;
+    varAfter = static_cast<double>(after.count) * to.period * to.period;
+  } else if (before.count and after.count) {
+    c.meanBefore = static_cast<double>(before.total) / before.count;
+    c.meanAfter = static_cast<double>(after.total) / after.count;
+    if (before.count > 1 and before.stddev >= 0)
+      varBefore = before.stddev * before.stddev / before.count;
+    if (after.count > 1 and after.stddev >= 0)
+      varAfter = after.stddev * after.stddev / after.count;
+  }
+  if (not c.meanBefore)
+    return c;
+
+  double delta = c.meanAfter - c.meanBefore;
+  c.change = 100 * delta / c.meanBefore;
+  if (varBefore < 0 or varAfter < 0)
+    return c;
+
+  double margin = z * std::sqrt(varBefore + varAfter);
+  c.low = 100 * (delta - margin) / c.meanBefore;
+  c.high = 100 * (delta + margin) / c.meanBefore;
+  c.bounded = true;
+  if (c.low > 0 and c.change >= threshold)
+    c.verdict = "slower";
+  else if (c.high < 0 and -c.change >= threshold)
+    c.verdict = "faster";
+  else
+    c.verdict = "~";
+
+  return c;
+}
+
+int main(int argc, char* argv[]) {
+  double confidence = 95;
+  double threshold = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "c:t:h")) != -1) {
+    switch (opt) {
+    case 'c':
+      confidence = std::atof(optarg);
+      break;
+    case 't':
+      threshold = std::atof(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 2 or confidence <= 0 or confidence >= 100)
+    usage(argv[0]);
+
+  Profile from, to;
+  if (not readProfile(argv[optind], from)
+      or not readProfile(argv[optind + 1], to))
+    return 2;
+  if ((from.period != 0) != (to.period != 0)) {
+    std::fprintf(stderr,
+                 "Cannot compare a sampled profile with a timed one\n");
+    return 2;
+  }
+
+  double z = getZ(confidence / 100);
+  std::vector<Change> changes;
+  for (const auto& it : from.loops) {
+    auto found = to.loops.find(it.first);
+    if (found != to.loops.end())
+      changes.push_back(
+          compare(it.second, found->second, from, to, z, threshold));
+  }
+
+  // The biggest slowdowns first.
+  std::stable_sort(
+      changes.begin(), changes.end(), [](const Change& l, const Change& r) {
+        return l.change > r.change;
+      });
+
+  unsigned slower = 0;
+  std::printf("# confidence %.1f%% threshold %.1f%%\n", confidence, threshold);
+  std::printf("# id\tcount-before\tcount-after\tmean-before-ns\tmean-after-ns"
+              "\tchange-%%\tlow-%%\thigh-%%\tverdict\tloop\n");
+  for (const Change& c : changes) {
+    std::printf("%s\t%" PRIu64 "\t%" PRIu64 "\t%.1f\t%.1f\t%+.2f",
+                c.after->id.c_str(),
+                c.before->count,
+                c.after->count,
+                c.meanBefore,
+                c.meanAfter,
+                c.change);
+    if (c.bounded)
+      std::printf("\t%+.2f\t%+.2f", c.low, c.high);
+    else
+      std::printf("\t-\t-");
+    std::printf("\t%s\t%s\n", c.verdict, c.after->desc.c_str());
+    if (std::strcmp(c.verdict, "slower") == 0)
+      slower++;
+  }
+
+  // Loops that are only in one of the profiles cannot be compared, but a new
+  // loop may well be the cause of a regression, so they are listed anyway.
+  for (const auto& it : to.loops)
+    if (not from.loops.count(it.first))
+      std::printf("# added\t%s\t%" PRIu64 "\t%" PRIu64 "\t%s\n",
+                  it.second.id.c_str(),
+                  it.second.count,
+                  it.second.total,
+                  it.second.desc.c_str());
+  for (const auto& it : from.loops)
+    if (not to.loops.count(it.first))
+      std::printf("# removed\t%s\t%" PRIu64 "\t%" PRIu64 "\t%s\n",
+                  it.second.id.c_str(),
+                  it.second.count,
+                  it.second.total,
+                  it.second.desc.c_str());
+
+  std::printf("# slower %u\n", slower);
+  return slower ? 1 : 0;
+}
@@ -0,0 +1,491 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+// Merges the trace files of several processes that were run with
+// LOOP_RUNTIME_TRACE into a single timeline and a single set of per-loop
+// aggregates. This is meant for process trees, such as a pre-fork server and
+// its workers, where each process has its own trace files.
+//
+//     loop-merge [-t] [-i] [-p <pid>] <dir>
+//
+// By default, the traces of every process in the directory are merged. With
+// -p, only those of the given process and its descendants are. The aggregates
+// are always printed. With -t, every event is printed in order of time before
+// them. With -i, the load balance of the loops that ran on several threads of
+// a process at once is printed after them. This groups the instances of a
+// loop into epochs in the same way as the runtime does when
+// LOOP_RUNTIME_IMBALANCE is set.
+//
+// The aggregates are computed from the events in the trace buffers, so if a
+// buffer wrapped around, only the loops that were entered after the oldest
+// event that is still in it are counted.
+//
+// If the processes were run with LOOP_RUNTIME_PLACEMENT, the aggregates also
+// include the number of times each loop migrated to another CPU and the time
+// it spent away from the NUMA node on which its thread first ran.
+
+#include "TraceFile.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace lrt;
+
+struct Loop {
+  std::string id;
+  std::string desc;
+};
+
+struct Event {
+  uint64_t time;
+  pid_t pid;
+  pid_t tid;
+  trace::Kind kind;
+  const Loop* loop;
+  unsigned depth;
+  uint16_t cpu;
+  uint8_t node;
+
+  // Only set for exits that were matched to an entry. This is the time since
+  // the matching entry.
+  bool matched;
+  uint64_t elapsed;
+};
+
+struct Aggregate {
+  uint64_t count;
+  uint64_t total;
+  uint64_t migrations;
+  uint64_t remote;
+  std::set<pid_t> pids;
+  const Loop* loop;
+};
+
+// The load balance of a loop over the epochs in which it ran on several
+// threads. See Imbalance.h in the runtime.
+struct Balance {
+  uint64_t epochs;
+  uint64_t maxThreads;
+  uint64_t elapsed;
+  uint64_t critical;
+  uint64_t mean;
+  uint64_t spread;
+  uint64_t wait;
+  const Loop* loop;
+};
+
+// The current epoch of a loop in a process.
+struct Epoch {
+  uint32_t active;
+  uint64_t start;
+
+  // For each thread, the number of active instances, the time spent in the
+  // loop and the time of the last exit.
+  std::map<pid_t, std::pair<uint32_t, std::pair<uint64_t, uint64_t>>> threads;
+};
+
+// A loop that has been entered, but not yet exited, on a thread.
+struct Active {
+  uint32_t slot;
+  uint64_t time;
+  uint16_t cpu;
+  uint8_t node;
+};
+
+// A trace file of a single thread.
+struct Thread {
+  pid_t pid;
+  pid_t tid;
+  std::string name;
+};
+
+static void usage(const char* prog) {
+  std::fprintf(stderr, "Usage: %s [-t] [-i] [-p <pid>] <dir>\n", prog);
+  std::exit(1);
+}
+
+static std::map<uint32_t, Loop> readLoops(const std::string& dir, pid_t pid) {
+  std::map<uint32_t, Loop> loops;
+  std::ifstream in(trace::getLoopsName(dir, pid));
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream ss(line);
+    uint32_t slot;
+    Loop loop;
+    if (ss >> slot >> loop.id) {
+      std::getline(ss >> std::ws, loop.desc);
+      loops[slot] = loop;
+    }
+  }
+  return loops;
+}
+
+// Find all the trace files in the directory. The names are of the form
+// loop-trace.<pid>.<tid>.
+static std::vector<Thread> findThreads(const std::string& dir) {
+  std::vector<Thread> threads;
+  const std::string prefix = "loop-trace.";
+  if (DIR* d = opendir(dir.c_str())) {
+    while (struct dirent* ent = readdir(d)) {
+      std::string name = ent->d_name;
+      if (name.compare(0, prefix.size(), prefix) != 0)
+        continue;
+      std::string rest = name.substr(prefix.size());
+      size_t dot = rest.find('.');
+      if (dot == std::string::npos or dot == 0 or dot == rest.size() - 1
+          or rest.find_first_not_of("0123456789.") != std::string::npos
+          or rest.find('.', dot + 1) != std::string::npos)
+        continue;
+      Thread thread;
+      thread.pid = std::atoi(rest.substr(0, dot).c_str());
+      thread.tid = std::atoi(rest.substr(dot + 1).c_str());
+      thread.name = dir + "/" + name;
+      threads.push_back(thread);
+    }
+    closedir(d);
+  }
+  return threads;
+}
+
+// Map the trace file of a thread. Returns nullptr if it is not a valid trace.
+static const trace::Header* mapTrace(const std::string& name, size_t& size) {
+  int fd = open(name.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 or st.st_size < (off_t)sizeof(trace::Header)) {
+    close(fd);
+    return nullptr;
+  }
+
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return nullptr;
+
+  const trace::Header* header = static_cast<const trace::Header*>(addr);
+  if (header->magic != trace::magic or header->version != trace::version
+      or (size_t)st.st_size < trace::getSize(header->capacity)) {
+    std::fprintf(stderr, "%s is not a loop-runtime trace\n", name.c_str());
+    munmap(addr, st.st_size);
+    return nullptr;
+  }
+
+  size = st.st_size;
+  return header;
+}
+
+// Check if the process is the root or one of its descendants.
+static bool isInTree(pid_t pid,
+                     pid_t root,
+                     const std::map<pid_t, pid_t>& ppids) {
+  std::set<pid_t> seen;
+  while (pid != root) {
+    auto it = ppids.find(pid);
+    if (it == ppids.end() or not seen.insert(pid).second)
+      return false;
+    pid = it->second;
+  }
+  return true;
+}
+
+// Read the events of a single thread and add the loops that were both
+// entered and exited to the aggregates.
+static void readEvents(const trace::Header* header,
+                       const std::map<uint32_t, Loop>& loops,
+                       std::vector<Event>& events,
+                       std::map<std::string, Aggregate>& aggregates) {
+  static const Loop unknown = {"-", "<unknown loop>"};
+
+  const trace::Record* records = trace::getRecords(header);
+  uint64_t head = header->head.load();
+  uint64_t first = head > header->capacity ? head - header->capacity : 0;
+  if (first)
+    std::fprintf(stderr,
+                 "thread %u of process %u lost its %" PRIu64
+                 " oldest events\n",
+                 header->tid,
+                 header->pid,
+                 first);
+
+  // The node on which the thread first ran, as far as the trace shows.
+  uint8_t home = trace::noNode;
+
+  std::vector<Active> stack;
+  for (uint64_t i = first; i < head; i++) {
+    const trace::Record& rec = records[i % header->capacity];
+    auto it = loops.find(rec.slot);
+    const Loop* loop = it != loops.end() ? &it->second : &unknown;
+    uint64_t time = trace::toMonotonic(header, rec.time);
+    if (home == trace::noNode)
+      home = rec.node;
+
+    if (rec.kind == trace::Enter) {
+      events.push_back({time,
+                        (pid_t)header->pid,
+                        (pid_t)header->tid,
+                        trace::Enter,
+                        loop,
+                        (unsigned)stack.size(),
+                        rec.cpu,
+                        rec.node,
+                        false,
+                        0});
+      stack.push_back({rec.slot, time, rec.cpu, rec.node});
+      continue;
+    }
+
+    // The entry of the loop may have been overwritten, in which case its
+    // exit cannot be matched and is only shown in the timeline.
+    auto match = std::find_if(
+        stack.rbegin(), stack.rend(), [&rec](const Active& active) {
+          return active.slot == rec.slot;
+        });
+    unsigned depth = 0;
+    uint64_t elapsed = 0;
+    if (match != stack.rend()) {
+      depth = stack.rend() - match - 1;
+      elapsed = time - match->time;
+      Aggregate& agg = aggregates[loop->id];
+      agg.loop = loop;
+      agg.count++;
+      agg.total += elapsed;
+      agg.pids.insert(header->pid);
+
+      // This is the same estimate that the runtime makes. If the loop moved
+      // to another node, it is assumed to have spent half its time on each.
+      if (match->node != trace::noNode and rec.node != trace::noNode) {
+        unsigned remoteEnds = (match->node != home) + (rec.node != home);
+        agg.migrations += match->cpu != rec.cpu;
+        agg.remote += elapsed * remoteEnds / 2;
+      }
+      stack.resize(depth);
+    }
+    events.push_back({time,
+                      (pid_t)header->pid,
+                      (pid_t)header->tid,
+                      trace::Exit,
+                      loop,
+                      depth,
+                      rec.cpu,
+                      rec.node,
+                      match != stack.rend(),
+                      elapsed});
+  }
+}
+
+// Group the instances of each loop in each process into epochs. The events
+// must be sorted by time.
+static std::map<std::string, Balance>
+findImbalance(const std::vector<Event>& events) {
+  std::map<std::string, Balance> balances;
+  std::map<std::pair<pid_t, const Loop*>, Epoch> epochs;
+  for (const Event& e : events) {
+    Epoch& epoch = epochs[std::make_pair(e.pid, e.loop)];
+    if (e.kind == trace::Enter) {
+      if (not epoch.active) {
+        epoch.start = e.time;
+        epoch.threads.clear();
+      }
+      epoch.active++;
+      epoch.threads[e.tid].first++;
+      continue;
+    }
+
+    auto it = epoch.threads.find(e.tid);
+    if (not e.matched or it == epoch.threads.end() or not it->second.first)
+      continue;
+    it->second.first--;
+    it->second.second.first += e.elapsed;
+    it->second.second.second = e.time;
+    if (--epoch.active or epoch.threads.size() < 2)
+      continue;
+
+    uint64_t sum = 0, most = 0, least = UINT64_MAX, wait = 0;
+    for (const auto& thread : epoch.threads) {
+      uint64_t busy = thread.second.second.first;
+      sum += busy;
+      most = std::max(most, busy);
+      least = std::min(least, busy);
+      wait += e.time - thread.second.second.second;
+    }
+
+    Balance& balance = balances[e.loop->id];
+    balance.loop = e.loop;
+    balance.epochs++;
+    balance.maxThreads
+        = std::max<uint64_t>(balance.maxThreads, epoch.threads.size());
+    balance.elapsed += e.time - epoch.start;
+    balance.critical += most;
+    balance.mean += sum / epoch.threads.size();
+    balance.spread += most - least;
+    balance.wait += wait;
+  }
+  return balances;
+}
+
+int main(int argc, char* argv[]) {
+  bool timeline = false;
+  bool imbalance = false;
+  pid_t root = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "tip:h")) != -1) {
+    switch (opt) {
+    case 't':
+      timeline = true;
+      break;
+    case 'i':
+      imbalance = true;
+      break;
+    case 'p':
+      root = std::atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1)
+    usage(argv[0]);
+
+  std::string dir = argv[optind];
+  std::vector<Thread> threads = findThreads(dir);
+
+  // The headers have to be read first to find the parents of the processes.
+  std::vector<std::pair<const trace::Header*, size_t>> traces;
+  std::map<pid_t, pid_t> ppids;
+  for (const Thread& thread : threads) {
+    size_t size = 0;
+    if (const trace::Header* header = mapTrace(thread.name, size)) {
+      traces.emplace_back(header, size);
+      ppids[header->pid] = header->ppid;
+    }
+  }
+
+  // The descriptors must outlive the events that point to them.
+  std::map<pid_t, std::map<uint32_t, Loop>> loops;
+  std::vector<Event> events;
+  std::map<std::string, Aggregate> aggregates;
+  std::set<pid_t> pids;
+  for (const auto& trace : traces) {
+    const trace::Header* header = trace.first;
+    if (root and not isInTree(header->pid, root, ppids))
+      continue;
+    if (not loops.count(header->pid))
+      loops[header->pid] = readLoops(dir, header->pid);
+    pids.insert(header->pid);
+    readEvents(header, loops[header->pid], events, aggregates);
+  }
+
+  if (pids.empty()) {
+    std::fprintf(stderr, "No traces found in %s\n", dir.c_str());
+    return 1;
+  }
+
+  std::stable_sort(
+      events.begin(), events.end(), [](const Event& l, const Event& r) {
+        return l.time < r.time;
+      });
+
+  if (timeline and not events.empty()) {
+    uint64_t start = events.front().time;
+    std::printf("# time-ms\tpid\ttid\tcpu\tnode\tevent\tloop\n");
+    for (const Event& e : events) {
+      std::string cpu = "-", node = "-";
+      if (e.node != trace::noNode) {
+        cpu = std::to_string(e.cpu);
+        node = std::to_string(e.node);
+      }
+      std::printf("%.6f\t%d\t%d\t%s\t%s\t%s\t%*s%s\n",
+                  (e.time - start) / 1e6,
+                  e.pid,
+                  e.tid,
+                  cpu.c_str(),
+                  node.c_str(),
+                  e.kind == trace::Enter ? "enter" : "exit",
+                  2 * e.depth,
+                  "",
+                  e.loop->desc.c_str());
+    }
+    std::printf("\n");
+  }
+
+  std::vector<const Aggregate*> sorted;
+  for (const auto& it : aggregates)
+    sorted.push_back(&it.second);
+  std::stable_sort(sorted.begin(),
+                   sorted.end(),
+                   [](const Aggregate* l, const Aggregate* r) {
+                     return l->total > r->total;
+                   });
+
+  std::printf("# processes %zu\n", pids.size());
+  std::printf(
+      "# id\tcount\ttotal-ns\tprocesses\tmigrations\tremote-ns\tloop\n");
+  for (const Aggregate* agg : sorted)
+    std::printf("%s\t%" PRIu64 "\t%" PRIu64 "\t%zu\t%" PRIu64 "\t%" PRIu64
+                "\t%s\n",
+                agg->loop->id.c_str(),
+                agg->count,
+                agg->total,
+                agg->pids.size(),
+                agg->migrations,
+                agg->remote,
+                agg->loop->desc.c_str());
+
+  if (imbalance) {
+    std::printf("\n# id\tepochs\tmax-threads\telapsed-ns\tcritical-ns\tmean-ns"
+                "\tspread-ns\twait-ns\timbalance\tloop\n");
+    for (const auto& it : findImbalance(events)) {
+      const Balance& balance = it.second;
+      double percent = 0;
+      if (balance.critical)
+        percent = 100.0 * (balance.critical - balance.mean) / balance.critical;
+      std::printf("%s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
+                  "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%.1f\t%s\n",
+                  it.first.c_str(),
+                  balance.epochs,
+                  balance.maxThreads,
+                  balance.elapsed,
+                  balance.critical,
+                  balance.mean,
+                  balance.spread,
+                  balance.wait,
+                  percent,
+                  balance.loop->desc.c_str());
+    }
+  }
+
+  for (const auto& trace : traces)
+    munmap(const_cast<trace::Header*>(trace.first), trace.second);
+
+  return 0;
+}
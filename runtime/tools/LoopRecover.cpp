@@ -0,0 +1,194 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+// Reads the trace files left behind by a process that was run with
+// LOOP_RUNTIME_TRACE and prints the loops that each thread was in when the
+// process died, along with the most recent events on each thread.
+//
+//     loop-recover [-e <events>] <dir> <pid>
+//
+// By default, the 10 most recent events of each thread are printed.
+
+#include "TraceFile.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace lrt;
+
+static void usage(const char* prog) {
+  std::fprintf(stderr, "Usage: %s [-e <events>] <dir> <pid>\n", prog);
+  std::exit(1);
+}
+
+static std::map<uint32_t, std::string> readLoops(const std::string& dir,
+                                                 pid_t pid) {
+  std::map<uint32_t, std::string> loops;
+  std::ifstream in(trace::getLoopsName(dir, pid));
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream ss(line);
+    uint32_t slot;
+    std::string id, desc;
+    if (ss >> slot >> id) {
+      std::getline(ss >> std::ws, desc);
+      loops[slot] = desc;
+    }
+  }
+  return loops;
+}
+
+static std::string getLoop(const std::map<uint32_t, std::string>& loops,
+                           uint32_t slot) {
+  auto it = loops.find(slot);
+  if (it != loops.end())
+    return it->second;
+  return "<unknown loop " + std::to_string(slot) + ">";
+}
+
+// Find the tids of all the threads of the process that have trace files.
+static std::vector<pid_t> findThreads(const std::string& dir, pid_t pid) {
+  std::vector<pid_t> tids;
+  std::string prefix = "loop-trace." + std::to_string(pid) + ".";
+  if (DIR* d = opendir(dir.c_str())) {
+    while (struct dirent* ent = readdir(d)) {
+      std::string name = ent->d_name;
+      if (name.compare(0, prefix.size(), prefix) != 0)
+        continue;
+      std::string suffix = name.substr(prefix.size());
+      if (not suffix.empty()
+          and suffix.find_first_not_of("0123456789") == std::string::npos)
+        tids.push_back(std::atoi(suffix.c_str()));
+    }
+    closedir(d);
+  }
+  std::sort(tids.begin(), tids.end());
+  return tids;
+}
+
+static bool recover(const std::string& dir,
+                    pid_t pid,
+                    pid_t tid,
+                    const std::map<uint32_t, std::string>& loops,
+                    unsigned numEvents) {
+  std::string name = trace::getName(dir, pid, tid);
+  int fd = open(name.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 or st.st_size < (off_t)sizeof(trace::Header)) {
+    close(fd);
+    return false;
+  }
+
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return false;
+
+  const trace::Header* header = static_cast<const trace::Header*>(addr);
+  if (header->magic != trace::magic or header->version != trace::version
+      or (size_t)st.st_size < trace::getSize(header->capacity)) {
+    std::fprintf(stderr, "%s is not a loop-runtime trace\n", name.c_str());
+    munmap(addr, st.st_size);
+    return false;
+  }
+
+  const trace::Record* records = trace::getRecords(header);
+  uint64_t head = header->head.load();
+  uint64_t first = head > header->capacity ? head - header->capacity : 0;
+  uint64_t last = head ? records[(head - 1) % header->capacity].time : 0;
+
+  std::printf("thread %u: %" PRIu64 " events\n", tid, head);
+
+  // The loop stack is kept in the header, so this is correct even if the
+  // entry events of the outer loops have been overwritten.
+  uint32_t depth = header->depth.load();
+  if (not depth)
+    std::printf("  not in any loop\n");
+  for (uint32_t i = std::min(depth, trace::maxDepth); i > 0; i--) {
+    const uint64_t started = header->started[i - 1];
+    std::printf("  #%-3u %s  (entered %.3f ms before the last event)\n",
+                depth - i,
+                getLoop(loops, header->stack[i - 1]).c_str(),
+                (last - started) * header->nsPerTick / 1e6);
+  }
+  if (depth > trace::maxDepth)
+    std::printf("  ... %u more\n", depth - trace::maxDepth);
+
+  if (numEvents and head) {
+    std::printf("  last events:\n");
+    uint64_t from = std::max(first, head - std::min<uint64_t>(head, numEvents));
+    for (uint64_t i = from; i < head; i++) {
+      const trace::Record& rec = records[i % header->capacity];
+      std::printf("    %+12.3f ms  %-5s %s\n",
+                  -((last - rec.time) * header->nsPerTick / 1e6),
+                  rec.kind == trace::Enter ? "enter" : "exit",
+                  getLoop(loops, rec.slot).c_str());
+    }
+  }
+  std::printf("\n");
+
+  munmap(addr, st.st_size);
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  unsigned numEvents = 10;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "e:h")) != -1) {
+    switch (opt) {
+    case 'e':
+      numEvents = std::atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 2)
+    usage(argv[0]);
+
+  std::string dir = argv[optind];
+  pid_t pid = std::atoi(argv[optind + 1]);
+
+  std::map<uint32_t, std::string> loops = readLoops(dir, pid);
+  std::vector<pid_t> tids = findThreads(dir, pid);
+  if (tids.empty()) {
+    std::fprintf(stderr, "No traces for process %d in %s\n", pid, dir.c_str());
+    return 1;
+  }
+
+  for (pid_t tid : tids)
+    recover(dir, pid, tid, loops, numEvents);
+
+  return 0;
+}
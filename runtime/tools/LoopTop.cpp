@@ -0,0 +1,224 @@
+/*
+  Copyright  2022  Tarun Prabhu
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+// A top-like tool that attaches to the shared memory segment published by an
+// instrumented process and shows the loops that are currently the hottest.
+//
+//     loop-top [-n <rows>] [-d <milliseconds>] [-1] <pid>
+//
+// The loops are ordered by the time spent in them since the last refresh. If
+// -1 is given, the cumulative aggregates are printed once and the tool exits.
+
+#include "Clock.h"
+#include "Shm.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace lrt;
+
+struct Row {
+  uint64_t count;
+  uint64_t total;
+  uint64_t self;
+  uint64_t lastSeen;
+  std::string desc;
+
+  // The change since the previous refresh.
+  uint64_t dcount;
+  uint64_t dtotal;
+};
+
+static void usage(const char* prog) {
+  std::fprintf(stderr, "Usage: %s [-n <rows>] [-d <ms>] [-1] <pid>\n", prog);
+  std::exit(1);
+}
+
+static const shm::Header* attach(pid_t pid) {
+  std::string name = shm::getName(pid);
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    std::fprintf(stderr,
+                 "Could not open %s. Was the process started with "
+                 "LOOP_RUNTIME_MONITOR=1?\n",
+                 name.c_str());
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 or st.st_size < (off_t)sizeof(shm::Header)) {
+    close(fd);
+    return nullptr;
+  }
+
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return nullptr;
+
+  const shm::Header* header = static_cast<const shm::Header*>(addr);
+  if (header->magic != shm::magic or header->version != shm::version
+      or (size_t)st.st_size < shm::getSize(header->capacity)) {
+    std::fprintf(stderr, "%s is not a loop-runtime segment\n", name.c_str());
+    return nullptr;
+  }
+
+  return header;
+}
+
+// Read all the published slots. The rows are indexed by slot and any rows
+// that have already been read will be updated in place.
+static void readSlots(const shm::Header* header, std::vector<Row>& rows) {
+  const auto relaxed = std::memory_order_relaxed;
+  const shm::Slot* slots = shm::getSlots(header);
+  uint32_t numLoops = header->numLoops.load(std::memory_order_acquire);
+
+  for (uint32_t slot = 0; slot < numLoops; slot++) {
+    const shm::Slot& src = slots[slot];
+    uint64_t count, total, self, lastSeen;
+    uint32_t seq;
+    do {
+      seq = src.seq.load(std::memory_order_acquire);
+      count = src.count.load(relaxed);
+      total = src.total.load(relaxed);
+      self = src.self.load(relaxed);
+      lastSeen = src.lastSeen.load(relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) or seq != src.seq.load(relaxed));
+
+    if (slot == rows.size()) {
+      std::string desc(src.desc, strnlen(src.desc, shm::descLen));
+      rows.push_back({0, 0, 0, 0, desc, 0, 0});
+    }
+
+    Row& row = rows[slot];
+    row.dcount = count - row.count;
+    row.dtotal = total - row.total;
+    row.count = count;
+    row.total = total;
+    row.self = self;
+    row.lastSeen = lastSeen;
+  }
+}
+
+static void print(const shm::Header* header,
+                  const std::vector<Row>& rows,
+                  unsigned numRows,
+                  double elapsed,
+                  bool cumulative) {
+  std::vector<const Row*> sorted;
+  for (const Row& row : rows)
+    sorted.push_back(&row);
+  std::sort(sorted.begin(), sorted.end(), [&](const Row* l, const Row* r) {
+    if (cumulative or l->dtotal == r->dtotal)
+      return l->total > r->total;
+    return l->dtotal > r->dtotal;
+  });
+
+  uint64_t t = Clock::monotonic();
+  std::printf("pid %u  loops %zu  published %.1fs ago\n\n",
+              header->pid,
+              rows.size(),
+              (t - header->published.load()) / 1e9);
+  std::printf("%7s %12s %12s %12s %12s %10s %9s  %s\n",
+              "%time",
+              "calls/s",
+              "count",
+              "total(ms)",
+              "self(ms)",
+              "avg(us)",
+              "seen(s)",
+              "loop");
+
+  for (unsigned i = 0; i < std::min<size_t>(numRows, sorted.size()); i++) {
+    const Row& row = *sorted[i];
+    double share = cumulative ? 0 : 100.0 * row.dtotal / (elapsed * 1e9);
+    double rate = cumulative ? 0 : row.dcount / elapsed;
+    double avg = row.count ? row.total / 1e3 / row.count : 0;
+    double seen = row.lastSeen ? (t - row.lastSeen) / 1e9 : 0;
+    std::printf("%7.2f %12.0f %12" PRIu64 " %12.3f %12.3f %10.3f %9.1f  %s\n",
+                share,
+                rate,
+                row.count,
+                row.total / 1e6,
+                row.self / 1e6,
+                avg,
+                seen,
+                row.desc.c_str());
+  }
+}
+
+int main(int argc, char* argv[]) {
+  unsigned numRows = 20;
+  unsigned interval = 1000;
+  bool once = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:d:1h")) != -1) {
+    switch (opt) {
+    case 'n':
+      numRows = std::atoi(optarg);
+      break;
+    case 'd':
+      interval = std::max(1, std::atoi(optarg));
+      break;
+    case '1':
+      once = true;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1)
+    usage(argv[0]);
+
+  const shm::Header* header = attach(std::atoi(argv[optind]));
+  if (not header)
+    return 1;
+
+  std::vector<Row> rows;
+  readSlots(header, rows);
+  if (once) {
+    print(header, rows, numRows, 0, true);
+    return 0;
+  }
+
+  // Keep going until the process exits and the segment is removed. The
+  // mapping stays valid after the segment is unlinked, so check for the
+  // process instead.
+  while (kill(header->pid, 0) == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+    readSlots(header, rows);
+    std::printf("\033[H\033[2J");
+    print(header, rows, numRows, interval / 1e3, false);
+    std::fflush(stdout);
+  }
+
+  return 0;
+}